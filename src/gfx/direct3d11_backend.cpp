@@ -0,0 +1,150 @@
+#include "direct3d11_backend.h"
+
+#include "../os/profiler.h"
+
+using namespace gfx;
+
+namespace
+{
+	auto to_d3d(primitive_topology topology) -> D3D11_PRIMITIVE_TOPOLOGY
+	{
+		switch (topology)
+		{
+			case primitive_topology::triangle_list:
+				return D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+			case primitive_topology::line_list:
+				return D3D11_PRIMITIVE_TOPOLOGY_LINELIST;
+		}
+		assert(false);
+		return D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED;
+	}
+}
+
+direct3d11_backend::direct3d11_backend(HWND hWnd)
+{
+	d3d = std::make_unique<direct3d11>(hWnd);
+	rp = std::make_unique<render_pass>(d3d->get_device(), d3d->get_swapchain());
+
+	ui = std::make_unique<gui>(hWnd, d3d->get_device(), d3d->get_context());
+}
+
+direct3d11_backend::~direct3d11_backend() = default;
+
+void direct3d11_backend::resize(uint16_t, uint16_t)
+{
+	// The swapchain takes its size from the window
+	rp.reset(nullptr);
+
+	d3d->resize();
+
+	rp = std::make_unique<render_pass>(d3d->get_device(), d3d->get_swapchain());
+}
+
+auto direct3d11_backend::make_pipeline(const pipeline_desc &description) -> resource_id
+{
+	auto &layout = description.input_element_layout;
+	auto &vso = description.vertex_shader_bytecode;
+	auto &pso = description.pixel_shader_bytecode;
+
+	pipelines.emplace_back(std::make_unique<pipeline>(d3d->get_device(), pipeline::desc
+	{
+		.blend = description.blend,
+		.depth_stencil = description.depth_stencil,
+		.rasterizer = description.rasterizer,
+		.sampler = description.sampler,
+		.primitive_topology = to_d3d(description.topology),
+		.input_element_layout = std::vector(layout.begin(), layout.end()),
+		.vertex_shader_bytecode = std::vector(vso.begin(), vso.end()),
+		.pixel_shader_bytecode = std::vector(pso.begin(), pso.end()),
+	}));
+	return static_cast<resource_id>(pipelines.size() - 1);
+}
+
+auto direct3d11_backend::make_mesh_buffer(const mesh_desc &description) -> resource_id
+{
+	meshes.emplace_back(std::make_unique<mesh_buffer>(d3d->get_device(),
+	                                                  mesh_buffer::make_mesh_desc(description.vertices, description.indices)));
+	return static_cast<resource_id>(meshes.size() - 1);
+}
+
+auto direct3d11_backend::make_constant_buffer(const constant_buffer_desc &description) -> resource_id
+{
+	constant_buffers.emplace_back(std::make_unique<constant_buffer>(d3d->get_device(), constant_buffer::desc
+	{
+		.stage = description.stage,
+		.slot = description.slot,
+		.size = description.size,
+		.data = description.data,
+	}));
+	return static_cast<resource_id>(constant_buffers.size() - 1);
+}
+
+auto direct3d11_backend::make_instance_buffer(const instance_buffer_desc &description) -> resource_id
+{
+	instance_buffers.emplace_back(std::make_unique<instance_buffer>(d3d->get_device(), instance_buffer::desc
+	{
+		.stride = description.stride,
+		.capacity = description.capacity,
+	}));
+	return static_cast<resource_id>(instance_buffers.size() - 1);
+}
+
+void direct3d11_backend::update_constant_buffer(resource_id buffer, std::size_t size, const void *data)
+{
+	constant_buffers[buffer]->update(d3d->get_context(), size, data);
+}
+
+void direct3d11_backend::update_instance_buffer(resource_id buffer, std::size_t size, const void *data)
+{
+	instance_buffers[buffer]->update(d3d->get_device(), d3d->get_context(), size, data);
+}
+
+void direct3d11_backend::begin_frame(const std::array<float, 4> &clear_color)
+{
+	auto context = d3d->get_context();
+
+	rp->activate(context);
+	rp->clear(context, clear_color);
+}
+
+void direct3d11_backend::bind_pipeline(resource_id pl)
+{
+	pipelines[pl]->activate(d3d->get_context());
+}
+
+void direct3d11_backend::bind_constant_buffer(resource_id buffer)
+{
+	constant_buffers[buffer]->activate(d3d->get_context());
+}
+
+void direct3d11_backend::bind_mesh_buffer(resource_id mesh)
+{
+	meshes[mesh]->activate(d3d->get_context());
+	bound_mesh = mesh;
+}
+
+void direct3d11_backend::bind_instance_buffer(resource_id buffer)
+{
+	instance_buffers[buffer]->activate(d3d->get_context());
+}
+
+void direct3d11_backend::draw()
+{
+	meshes[bound_mesh]->draw(d3d->get_context());
+}
+
+void direct3d11_backend::draw_instanced(uint32_t first_instance, uint32_t instance_count)
+{
+	meshes[bound_mesh]->draw_instanced(d3d->get_context(), first_instance, instance_count);
+}
+
+void direct3d11_backend::end_frame(bool vSync)
+{
+	{
+		PROFILE_ZONE("gui");
+		ui->draw_frame();
+	}
+
+	PROFILE_ZONE("present");
+	d3d->present(vSync);
+}
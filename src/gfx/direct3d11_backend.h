@@ -0,0 +1,52 @@
+#pragma once
+
+#include "render_backend.h"
+#include "direct3d11.h"
+#include "pipeline.h"
+#include "gpu_data.h"
+#include "renderpass.h"
+#include "gui.h"
+
+namespace gfx
+{
+	class direct3d11_backend final : public render_backend
+	{
+	public:
+		direct3d11_backend() = delete;
+		direct3d11_backend(HWND hWnd);
+		~direct3d11_backend() override;
+
+		void resize(uint16_t width, uint16_t height) override;
+
+		auto make_pipeline(const pipeline_desc &description) -> resource_id override;
+		auto make_mesh_buffer(const mesh_desc &description) -> resource_id override;
+		auto make_constant_buffer(const constant_buffer_desc &description) -> resource_id override;
+		auto make_instance_buffer(const instance_buffer_desc &description) -> resource_id override;
+
+		void update_constant_buffer(resource_id buffer, std::size_t size, const void *data) override;
+		void update_instance_buffer(resource_id buffer, std::size_t size, const void *data) override;
+
+		void begin_frame(const std::array<float, 4> &clear_color) override;
+		void bind_pipeline(resource_id pipeline) override;
+		void bind_constant_buffer(resource_id buffer) override;
+		void bind_mesh_buffer(resource_id mesh) override;
+		void bind_instance_buffer(resource_id buffer) override;
+		void draw() override;
+		void draw_instanced(uint32_t first_instance, uint32_t instance_count) override;
+
+		// Draws the gui over the frame, then presents
+		void end_frame(bool vSync) override;
+
+	private:
+		std::unique_ptr<direct3d11> d3d{};
+		std::unique_ptr<render_pass> rp{};
+		std::unique_ptr<gui> ui{};
+
+		std::vector<std::unique_ptr<pipeline>> pipelines{};
+		std::vector<std::unique_ptr<mesh_buffer>> meshes{};
+		std::vector<std::unique_ptr<constant_buffer>> constant_buffers{};
+		std::vector<std::unique_ptr<instance_buffer>> instance_buffers{};
+
+		resource_id bound_mesh{};
+	};
+}
@@ -18,11 +18,9 @@ namespace
 	}
 }
 
-auto mesh_buffer::make_mesh_desc(const mesh &mesh) -> mesh_buffer::desc
+auto mesh_buffer::make_mesh_desc(std::span<const vertex> vertices, std::span<const uint32_t> indicies) -> mesh_buffer::desc
 {
-	auto &vertices = mesh.vertices;
-	auto &indicies = mesh.indicies;
-	auto vertex_size = static_cast<uint32_t>(sizeof(vertices.back()));
+	auto vertex_size = static_cast<uint32_t>(sizeof(vertex));
 
 	return mesh_buffer::desc{
 		.vertex_info = {
@@ -78,6 +76,11 @@ void mesh_buffer::draw(context_t context)
 	context->DrawIndexed(index_count, 0, 0);
 }
 
+void mesh_buffer::draw_instanced(context_t context, uint32_t first_instance, uint32_t instance_count)
+{
+	context->DrawIndexedInstanced(index_count, instance_count, 0, 0, first_instance);
+}
+
 constant_buffer::constant_buffer(device_t device, const desc &desc_) :
 	stage{ desc_.stage },
 	slot{ desc_.slot },
@@ -140,4 +143,59 @@ void constant_buffer::update(context_t context, std::size_t new_size, const void
 	std::memcpy(gpu_buffer.pData, buffer_data, new_size);
 
 	context->Unmap(buffer.p, NULL);
+}
+
+instance_buffer::instance_buffer(device_t device, const desc &desc_) :
+	stride{ desc_.stride },
+	capacity{ std::max(desc_.capacity, 1u) }
+{
+	make_buffer(device);
+}
+
+instance_buffer::~instance_buffer() = default;
+
+void instance_buffer::activate(context_t context)
+{
+	auto offset = 0u;
+	ID3D11Buffer *const ib[] = { buffer.p };
+	context->IASetVertexBuffers(1, 1, ib, &stride, &offset);
+}
+
+void instance_buffer::update(device_t device, context_t context, std::size_t size, const void *data)
+{
+	if (size > std::size_t{capacity} * stride)
+	{
+		while (size > std::size_t{capacity} * stride)
+		{
+			capacity *= 2;
+		}
+		make_buffer(device);
+	}
+
+	auto gpu_buffer = D3D11_MAPPED_SUBRESOURCE{};
+	auto hr = context->Map(buffer.p,
+	                       NULL,
+	                       D3D11_MAP_WRITE_DISCARD,
+	                       NULL,
+	                       &gpu_buffer);
+	assert(SUCCEEDED(hr));
+
+	std::memcpy(gpu_buffer.pData, data, size);
+
+	context->Unmap(buffer.p, NULL);
+}
+
+void instance_buffer::make_buffer(device_t device)
+{
+	auto bd = D3D11_BUFFER_DESC
+	{
+		.ByteWidth = capacity * stride,
+		.Usage = D3D11_USAGE_DYNAMIC,
+		.BindFlags = D3D11_BIND_VERTEX_BUFFER,
+		.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE,
+	};
+
+	buffer.Release();
+	auto hr = device->CreateBuffer(&bd, nullptr, &buffer);
+	assert(SUCCEEDED(hr));
 }
\ No newline at end of file
@@ -1,46 +1,10 @@
 #pragma once
 
-#include "pipeline.h"
+#include "render_data.h"
 #include "direct3d11.h"
 
 namespace gfx
 {
-	struct vertex
-	{
-		DirectX::XMFLOAT3 position;
-		DirectX::XMFLOAT4 color;
-	};
-
-	static const auto vertex_elements = std::vector<input_element_name>
-	{
-		input_element_name::position,
-		input_element_name::color,
-	};
-
-	struct mesh
-	{
-		std::vector<vertex> vertices;
-		std::vector<uint32_t> indicies;
-	};
-
-	struct matrix
-	{
-		DirectX::XMMATRIX data;
-	};
-
-	enum class shader_stage
-	{
-		vertex,
-		pixel,
-	};
-
-	enum class shader_slot
-	{
-		projection = 0,
-		view = 1, 
-		transform = 2,
-	};
-
 	class mesh_buffer
 	{
 		using device_t = direct3d11::device_t;
@@ -58,7 +22,7 @@ namespace gfx
 			info vertex_info;
 			info index_info;
 		};
-		static auto make_mesh_desc(const mesh &mesh) -> desc;
+		static auto make_mesh_desc(std::span<const vertex> vertices, std::span<const uint32_t> indicies) -> desc;
 
 	public:
 		mesh_buffer() = delete;
@@ -67,6 +31,7 @@ namespace gfx
 
 		void activate(context_t context);
 		void draw(context_t context);
+		void draw_instanced(context_t context, uint32_t first_instance, uint32_t instance_count);
 
 	private:
 		buffer_t vertex_buffer{},
@@ -110,6 +75,38 @@ namespace gfx
 		set_buffer_fn set_buffer_function;
 	};
 
+	// Per instance vertex data, rewritten whole every frame.
+	// Grows to fit when an update is larger than it.
+	class instance_buffer
+	{
+		using device_t = direct3d11::device_t;
+		using context_t = direct3d11::context_t;
+		using buffer_t = CComPtr<ID3D11Buffer>;
+
+	public:
+		struct desc
+		{
+			uint32_t stride;
+			uint32_t capacity;    // in instances
+		};
+
+	public:
+		instance_buffer() = delete;
+		instance_buffer(device_t device, const desc &description);
+		~instance_buffer();
+
+		void activate(context_t context);
+		void update(device_t device, context_t context, std::size_t size, const void *data);
+
+	private:
+		void make_buffer(device_t device);
+
+	private:
+		buffer_t buffer{};
+		uint32_t stride{};
+		uint32_t capacity{};
+	};
+
 	class shader_resource
 	{
 	public:
@@ -0,0 +1,179 @@
+#include "null_backend.h"
+
+#include <cstring>
+
+using namespace gfx;
+
+null_backend::null_backend()
+{
+	bound_constant_buffers.fill(unbound);
+}
+
+null_backend::~null_backend() = default;
+
+void null_backend::resize(uint16_t, uint16_t)
+{ }
+
+auto null_backend::make_pipeline(const pipeline_desc &) -> resource_id
+{
+	return pipeline_count++;
+}
+
+auto null_backend::make_mesh_buffer(const mesh_desc &description) -> resource_id
+{
+	mesh_index_counts.push_back(static_cast<uint32_t>(description.indices.size()));
+	return static_cast<resource_id>(mesh_index_counts.size() - 1);
+}
+
+auto null_backend::make_constant_buffer(const constant_buffer_desc &description) -> resource_id
+{
+	auto bytes = static_cast<const std::byte *>(description.data);
+	constant_buffers.push_back({
+		.slot = description.slot,
+		.data = std::vector<std::byte>(bytes, bytes + description.size),
+	});
+	return static_cast<resource_id>(constant_buffers.size() - 1);
+}
+
+auto null_backend::make_instance_buffer(const instance_buffer_desc &description) -> resource_id
+{
+	instance_buffers.emplace_back(std::size_t{description.capacity} * description.stride);
+	return static_cast<resource_id>(instance_buffers.size() - 1);
+}
+
+void null_backend::update_constant_buffer(resource_id buffer, std::size_t size, const void *data)
+{
+	auto &dst = constant_buffers[buffer].data;
+	assert(dst.size() >= size);
+	std::memcpy(dst.data(), data, size);
+
+	count.uploads++;
+	count.upload_bytes += size;
+	record(command_type::upload, buffer, static_cast<uint32_t>(size));
+}
+
+void null_backend::update_instance_buffer(resource_id buffer, std::size_t size, const void *data)
+{
+	// Grows to fit, as the real one does
+	auto &dst = instance_buffers[buffer];
+	if (dst.size() < size)
+	{
+		dst.resize(size);
+	}
+	std::memcpy(dst.data(), data, size);
+
+	count.uploads++;
+	count.upload_bytes += size;
+	record(command_type::upload, buffer, static_cast<uint32_t>(size));
+}
+
+void null_backend::begin_frame(const std::array<float, 4> &)
+{
+	// A new frame starts with a fresh context, as far as binds are concerned
+	bound_constant_buffers.fill(unbound);
+	bound_pipeline = unbound;
+	bound_mesh = unbound;
+	bound_instance_buffer = unbound;
+
+	record(command_type::begin_frame);
+}
+
+void null_backend::bind_pipeline(resource_id pl)
+{
+	count.binds++;
+	count.redundant_binds += bound_pipeline == pl ? 1 : 0;
+	bound_pipeline = pl;
+	record(command_type::bind_pipeline, pl);
+}
+
+void null_backend::bind_constant_buffer(resource_id buffer)
+{
+	auto &bound = bound_constant_buffers[static_cast<uint32_t>(constant_buffers[buffer].slot)];
+	count.binds++;
+	count.redundant_binds += bound == buffer ? 1 : 0;
+	bound = buffer;
+	record(command_type::bind_constant_buffer, buffer);
+}
+
+void null_backend::bind_mesh_buffer(resource_id mesh)
+{
+	count.binds++;
+	count.redundant_binds += bound_mesh == mesh ? 1 : 0;
+	bound_mesh = mesh;
+	record(command_type::bind_mesh_buffer, mesh);
+}
+
+void null_backend::bind_instance_buffer(resource_id buffer)
+{
+	count.binds++;
+	count.redundant_binds += bound_instance_buffer == buffer ? 1 : 0;
+	bound_instance_buffer = buffer;
+	record(command_type::bind_instance_buffer, buffer);
+}
+
+void null_backend::draw()
+{
+	assert(bound_mesh != unbound);
+	auto index_count = mesh_index_counts[bound_mesh];
+
+	count.draws++;
+	count.instances++;
+	count.indices += index_count;
+	record(command_type::draw, bound_mesh, index_count);
+}
+
+void null_backend::draw_instanced(uint32_t first_instance, uint32_t instance_count)
+{
+	assert(bound_mesh != unbound and bound_instance_buffer != unbound);
+	auto index_count = mesh_index_counts[bound_mesh];
+
+	count.draws++;
+	count.instances += instance_count;
+	count.indices += uint64_t{index_count} * instance_count;
+	record(command_type::draw_instanced, bound_mesh, instance_count, first_instance);
+}
+
+void null_backend::end_frame(bool)
+{
+	count.frames++;
+	record(command_type::end_frame);
+}
+
+auto null_backend::commands() const -> std::span<const command>
+{
+	return log;
+}
+
+auto null_backend::stats() const -> counters
+{
+	return count;
+}
+
+void null_backend::reset()
+{
+	log.clear();
+	count = {};
+}
+
+void null_backend::set_logging(bool enabled)
+{
+	logging = enabled;
+}
+
+auto null_backend::constant_buffer_data(resource_id buffer) const -> std::span<const std::byte>
+{
+	return constant_buffers[buffer].data;
+}
+
+auto null_backend::instance_buffer_data(resource_id buffer) const -> std::span<const std::byte>
+{
+	return instance_buffers[buffer];
+}
+
+void null_backend::record(command_type type, uint32_t resource, uint32_t size, uint32_t first)
+{
+	if (logging)
+	{
+		log.push_back({.type = type, .resource = resource, .size = size, .first = first});
+	}
+}
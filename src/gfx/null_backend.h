@@ -0,0 +1,106 @@
+#pragma once
+
+#include "render_backend.h"
+
+namespace gfx
+{
+	enum class command_type : uint8_t
+	{
+		begin_frame,
+		end_frame,
+		bind_pipeline,
+		bind_constant_buffer,
+		bind_mesh_buffer,
+		bind_instance_buffer,
+		upload,
+		draw,
+		draw_instanced,
+	};
+
+	struct command
+	{
+		command_type type;
+		uint32_t resource;    // unused for frame markers
+		uint32_t size;        // bytes for uploads, indices for draws, instances for instanced draws
+		uint32_t first;       // first instance for instanced draws
+	};
+
+	// Backend that talks to no GPU. It records what it is asked to do in a
+	// command log and keeps counters, so the CPU side of rendering can be run
+	// and measured headless. Buffers keep their last upload.
+	class null_backend final : public render_backend
+	{
+	public:
+		struct counters
+		{
+			uint64_t frames;
+			uint64_t binds;
+			uint64_t redundant_binds;    // of what was already bound
+			uint64_t uploads;
+			uint64_t upload_bytes;
+			uint64_t draws;
+			uint64_t instances;
+			uint64_t indices;    // over every instance
+		};
+
+	public:
+		null_backend();
+		~null_backend() override;
+
+		void resize(uint16_t width, uint16_t height) override;
+
+		auto make_pipeline(const pipeline_desc &description) -> resource_id override;
+		auto make_mesh_buffer(const mesh_desc &description) -> resource_id override;
+		auto make_constant_buffer(const constant_buffer_desc &description) -> resource_id override;
+		auto make_instance_buffer(const instance_buffer_desc &description) -> resource_id override;
+
+		void update_constant_buffer(resource_id buffer, std::size_t size, const void *data) override;
+		void update_instance_buffer(resource_id buffer, std::size_t size, const void *data) override;
+
+		void begin_frame(const std::array<float, 4> &clear_color) override;
+		void bind_pipeline(resource_id pipeline) override;
+		void bind_constant_buffer(resource_id buffer) override;
+		void bind_mesh_buffer(resource_id mesh) override;
+		void bind_instance_buffer(resource_id buffer) override;
+		void draw() override;
+		void draw_instanced(uint32_t first_instance, uint32_t instance_count) override;
+		void end_frame(bool vSync) override;
+
+		// Everything since the last reset
+		auto commands() const -> std::span<const command>;
+		auto stats() const -> counters;
+		void reset();
+
+		// Set false to only count, for long benchmarks
+		void set_logging(bool enabled);
+
+		auto constant_buffer_data(resource_id buffer) const -> std::span<const std::byte>;
+		auto instance_buffer_data(resource_id buffer) const -> std::span<const std::byte>;
+
+	private:
+		void record(command_type type, uint32_t resource = 0, uint32_t size = 0, uint32_t first = 0);
+
+	private:
+		struct constant_buffer_entry
+		{
+			shader_slot slot;
+			std::vector<std::byte> data;
+		};
+
+		uint32_t pipeline_count{};
+		std::vector<uint32_t> mesh_index_counts{};
+		std::vector<constant_buffer_entry> constant_buffers{};
+		std::vector<std::vector<std::byte>> instance_buffers{};
+
+		// Bound per constant buffer slot, pipeline and mesh
+		static constexpr auto unbound = std::numeric_limits<resource_id>::max();
+		std::array<resource_id, 3> bound_constant_buffers{};
+		resource_id bound_pipeline{unbound};
+		resource_id bound_mesh{unbound};
+		resource_id bound_instance_buffer{unbound};
+
+		std::vector<command> log{};
+		bool logging{true};
+		counters count{};
+	};
+}
@@ -269,9 +269,9 @@ void pipeline::create_input_layout(device_t device, const std::vector<input_elem
 			// 	elem.InputSlot = non_interleaved_idx++;
 			// 	return elem;
 			// }
-			// case ie::instance_float4:
-			// 	assert(transform_idx < 4);
-			// 	return transform.at(transform_idx++);
+			case ie::instance_float4:
+				assert(transform_idx < 4);
+				return transform.at(transform_idx++);
 		}
 		assert(false);
 		return D3D11_INPUT_ELEMENT_DESC{};
@@ -1,50 +1,10 @@
 #pragma once
 
+#include "render_data.h"
 #include "direct3d11.h"
 
 namespace  gfx
 {
-	enum class blend_mode
-	{
-		opaque,
-		alpha,
-		additive,
-		non_premultipled
-	};
-
-	enum class depth_stencil_mode
-	{
-		none,
-		read_write,
-		read_only
-	};
-
-	enum class rasterizer_mode
-	{
-		cull_none,
-		cull_clockwise,
-		cull_anti_clockwise,
-		wireframe
-	};
-
-	enum class sampler_mode
-	{
-		point_wrap,
-		point_clamp,
-		linear_wrap,
-		linear_clamp,
-		anisotropic_wrap,
-		anisotropic_clamp
-	};
-
-	enum class input_element_name
-	{
-		position,
-		normal,
-		color,
-		texcoord,
-	};
-
 	class pipeline
 	{
 		using device_t = direct3d11::device_t;
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "render_data.h"
+
+namespace gfx
+{
+	// What the renderer asks of a graphics API. Pipelines and buffers are
+	// created up front and named by id, a frame is a run of binds, uploads
+	// and draws between begin_frame and end_frame.
+	class render_backend
+	{
+	public:
+		using resource_id = uint32_t;
+
+		// Descriptions in the renderer's terms, each backend maps them to its API
+		struct pipeline_desc
+		{
+			blend_mode blend;
+			depth_stencil_mode depth_stencil;
+			rasterizer_mode rasterizer;
+			sampler_mode sampler;
+			primitive_topology topology;
+
+			std::span<const input_element_name> input_element_layout;
+			std::span<const uint8_t> vertex_shader_bytecode;
+			std::span<const uint8_t> pixel_shader_bytecode;
+		};
+
+		struct mesh_desc
+		{
+			std::span<const vertex> vertices;
+			std::span<const uint32_t> indices;
+		};
+
+		struct constant_buffer_desc
+		{
+			shader_stage stage;
+			shader_slot slot;
+			std::size_t size;
+			const void *data;
+		};
+
+		struct instance_buffer_desc
+		{
+			uint32_t stride;
+			uint32_t capacity;    // in instances
+		};
+
+	public:
+		virtual ~render_backend() = default;
+
+		virtual void resize(uint16_t width, uint16_t height) = 0;
+
+		virtual auto make_pipeline(const pipeline_desc &description) -> resource_id = 0;
+		virtual auto make_mesh_buffer(const mesh_desc &description) -> resource_id = 0;
+		virtual auto make_constant_buffer(const constant_buffer_desc &description) -> resource_id = 0;
+		virtual auto make_instance_buffer(const instance_buffer_desc &description) -> resource_id = 0;
+
+		virtual void update_constant_buffer(resource_id buffer, std::size_t size, const void *data) = 0;
+		virtual void update_instance_buffer(resource_id buffer, std::size_t size, const void *data) = 0;
+
+		virtual void begin_frame(const std::array<float, 4> &clear_color) = 0;
+		virtual void bind_pipeline(resource_id pipeline) = 0;
+		virtual void bind_constant_buffer(resource_id buffer) = 0;
+		virtual void bind_mesh_buffer(resource_id mesh) = 0;
+		virtual void bind_instance_buffer(resource_id buffer) = 0;
+
+		// Every index of the bound mesh buffer
+		virtual void draw() = 0;
+
+		// The bound mesh buffer once per instance, reading instances from first_instance on
+		virtual void draw_instanced(uint32_t first_instance, uint32_t instance_count) = 0;
+
+		virtual void end_frame(bool vSync) = 0;
+	};
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "../os/triple_buffer.h"
+
+// Types shared by the renderer, the sim and every backend. Nothing here
+// names a graphics API, so headless code can use it off Windows.
+namespace gfx
+{
+	enum class blend_mode
+	{
+		opaque,
+		alpha,
+		additive,
+		non_premultipled
+	};
+
+	enum class depth_stencil_mode
+	{
+		none,
+		read_write,
+		read_only
+	};
+
+	enum class rasterizer_mode
+	{
+		cull_none,
+		cull_clockwise,
+		cull_anti_clockwise,
+		wireframe
+	};
+
+	enum class sampler_mode
+	{
+		point_wrap,
+		point_clamp,
+		linear_wrap,
+		linear_clamp,
+		anisotropic_wrap,
+		anisotropic_clamp
+	};
+
+	enum class primitive_topology
+	{
+		triangle_list,
+		line_list,
+	};
+
+	enum class input_element_name
+	{
+		position,
+		normal,
+		color,
+		texcoord,
+		instance_float4,    // one row of the per instance transform, list it four times
+	};
+
+	struct vertex
+	{
+		DirectX::XMFLOAT3 position;
+		DirectX::XMFLOAT4 color;
+	};
+
+	static const auto vertex_elements = std::vector<input_element_name>
+	{
+		input_element_name::position,
+		input_element_name::color,
+	};
+
+	// Vertex layout plus a transform per instance, from the instance buffer in slot 1
+	static const auto instanced_vertex_elements = std::vector<input_element_name>
+	{
+		input_element_name::position,
+		input_element_name::color,
+		input_element_name::instance_float4,
+		input_element_name::instance_float4,
+		input_element_name::instance_float4,
+		input_element_name::instance_float4,
+	};
+
+	struct mesh
+	{
+		std::vector<vertex> vertices;
+		std::vector<uint32_t> indicies;
+	};
+
+	struct matrix
+	{
+		DirectX::XMMATRIX data;
+	};
+
+	// Transforms published by another thread, indexed by transform slot
+	using transform_buffer = os::triple_buffer<std::vector<matrix>>;
+
+	enum class shader_stage
+	{
+		vertex,
+		pixel,
+	};
+
+	enum class shader_slot
+	{
+		projection = 0,
+		view = 1,
+		transform = 2,
+	};
+}
@@ -1,13 +1,10 @@
 #include "renderer.h"
 
-#include "../os/window.h"
 #include "../os/helper.h"
+#include "../os/profiler.h"
 
 #include <imgui.h>
 
-#include <cppitertools/zip.hpp>
-#include <cppitertools/enumerate.hpp>
-
 using namespace gfx;
 
 namespace 
@@ -17,35 +14,47 @@ namespace
 	constexpr auto field_of_view = 60.0f;
 	constexpr auto near_z = 0.1f;
 	constexpr auto far_z = 100.0f;
+	constexpr auto initial_instance_capacity = 256u;
+
+	// Missing shaders load empty, backends that run no shaders never look
+	auto read_shader(const std::filesystem::path &file_path) -> std::vector<uint8_t>
+	{
+		if (not std::filesystem::exists(file_path))
+		{
+			return {};
+		}
+		return os::read_binary_file(file_path);
+	}
 }
 
-renderer::renderer(HWND hWnd)
+renderer::renderer(std::unique_ptr<render_backend> backend_, uint16_t width_, uint16_t height_) :
+	width{width_},
+	height{height_},
+	backend{std::move(backend_)}
 {
-	std::tie(width, height) = os::get_client_area(hWnd);
-	d3d = std::make_unique<direct3d11>(hWnd);
-	rp = std::make_unique<render_pass>(d3d->get_device(), d3d->get_swapchain());
-
-	ui = std::make_unique<gui>(hWnd, d3d->get_device(), d3d->get_context());
-
 	make_pipelines();
 
 	make_proj_cb();
 	make_view_cb();
+
+	instance_buffer_id = backend->make_instance_buffer(render_backend::instance_buffer_desc
+	{
+		.stride = sizeof(matrix),
+		.capacity = initial_instance_capacity,
+	});
 }
 
 renderer::~renderer() = default;
 
-auto renderer::on_resize(uintptr_t wParam, uintptr_t lParam) -> bool
+auto renderer::on_resize(uint16_t width_, uint16_t height_) -> bool
 {
-	std::tie(width, height) = os::get_client_area(lParam);
+	width = width_;
+	height = height_;
 
-	rp.reset(nullptr);
+	backend->resize(width, height);
 
-	d3d->resize();
-
-	rp = std::make_unique<render_pass>(d3d->get_device(), d3d->get_swapchain());
-
-	make_proj_cb();
+	auto proj = projection();
+	backend->update_constant_buffer(proj_cb, sizeof(matrix), reinterpret_cast<const void *>(&proj));
 
 	return true;
 }
@@ -53,7 +62,6 @@ auto renderer::on_resize(uintptr_t wParam, uintptr_t lParam) -> bool
 void renderer::camera_at(const DirectX::XMFLOAT3 &position, const DirectX::XMFLOAT4 &orientation)
 {
 	using namespace DirectX;
-	auto context = d3d->get_context();
 
 	auto cam_pos = XMLoadFloat3(&position);
 	auto cam_orient = XMQuaternionNormalize(XMLoadFloat4(&orientation));
@@ -63,21 +71,56 @@ void renderer::camera_at(const DirectX::XMFLOAT3 &position, const DirectX::XMFLO
 	view.data *= XMMatrixRotationQuaternion(cam_orient);
 
 	view.data = XMMatrixTranspose(view.data);
-	view_cb->update(context, sizeof(matrix), reinterpret_cast<const void *>(&view));
+	backend->update_constant_buffer(view_cb, sizeof(matrix), reinterpret_cast<const void *>(&view));
 }
 
 void renderer::update(const os::clock &clk)
 {
+	PROFILE_ZONE("renderer::update");
+
 	using namespace DirectX;
 	using sec = std::ratio<1>;
 
-	auto context = d3d->get_context();
+	if (layout_dirty)
+	{
+		lay_out_instances();
+	}
 
-	for (auto &&[src, dst] : iter::zip(transforms_src, transforms))
+	for (auto i = 0u; i < transforms_src.size(); i++)
 	{
-		dst->update(context,
-					sizeof(matrix),
-					reinterpret_cast<const void *>(src));
+		if (auto src = transforms_src[i])
+		{
+			instances[object_instance[i]] = *src;
+		}
+	}
+
+	// Published transforms only change when the sim thread has published something new
+	if (published_src and published_src->update())
+	{
+		auto &frame = published_src->front();
+		for (auto [slot, object] : published_slots)
+		{
+			if (slot >= frame.size())
+			{
+				continue;
+			}
+
+			instances[object_instance[object]] = frame[slot];
+		}
+	}
+
+	// One upload for every object
+	if (not instances.empty())
+	{
+		backend->update_instance_buffer(instance_buffer_id,
+		                                instances.size() * sizeof(matrix),
+		                                reinterpret_cast<const void *>(instances.data()));
+	}
+
+	// Headless backends have no gui
+	if (ImGui::GetCurrentContext() == nullptr)
+	{
+		return;
 	}
 
 	static auto frame_count { 0u };
@@ -87,142 +130,188 @@ void renderer::update(const os::clock &clk)
 	ImGui::Begin("Stats", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
 	ImGui::Text("Frame Count: %d", frame_count);
 	ImGui::Text("Total Time: %f", time_count);
-	ImGui::Text("FPS: %f", frame_count/time_count);
+
+	// Rolling rate reacts to hitches, the lifetime average hides them
+	auto &stats = clk.stats();
+	auto rolling_ms = stats.rolling_mean<std::milli>(60);
+	ImGui::Text("FPS: %f", rolling_ms > 0.0 ? 1000.0 / rolling_ms : 0.0);
+	ImGui::Text("Frame ms p50 %.2f  p95 %.2f  p99 %.2f  max %.2f",
+	            stats.percentile<std::milli>(0.50),
+	            stats.percentile<std::milli>(0.95),
+	            stats.percentile<std::milli>(0.99),
+	            stats.max<std::milli>());
+#ifdef PROFILER_ENABLED
+	if (ImGui::Button("Save Trace"))
+	{
+		os::write_chrome_trace("trace.json");
+	}
+#endif
 	ImGui::End();
 }
 
 void renderer::draw()
 {
-	auto context = d3d->get_context();
-	
-	rp->activate(context);
-	rp->clear(context, clear_color);
+	PROFILE_ZONE("renderer::draw");
 
-	proj_cb->activate(context);
-	view_cb->activate(context);
+	// Batch offsets are only right once update has laid out what was added
+	assert(not layout_dirty);
 
-	for (auto &&[i, pl] : pl_list | iter::enumerate)
-	{
-		auto bucket = pl_mesh_map.bucket(static_cast<pipeline_type>(i));
+	backend->begin_frame(clear_color);
 
-		if (pl_mesh_map.bucket_size(bucket) == 0)
-		{
-			continue;
-		}
+	backend->bind_constant_buffer(proj_cb);
+	backend->bind_constant_buffer(view_cb);
 
-		pl->activate(context);
+	backend->bind_instance_buffer(instance_buffer_id);
 
-		for (auto it = pl_mesh_map.cbegin(bucket); 
-			 it != pl_mesh_map.cend(bucket); 
-			 it++)
+	auto bound = static_cast<const instance_batch *>(nullptr);
+	for (auto &batch : batches)
+	{
+		if (bound == nullptr or bound->pl != batch.pl)
 		{
-			auto &[m_id, cb_id] = it->second;
-			auto &mb = meshes[m_id];
-			auto &cb = transforms[cb_id];
-
-			cb->activate(context);
-			mb->activate(context);
-			mb->draw(context);
+			backend->bind_pipeline(pl_list[static_cast<int>(batch.pl)]);
 		}
+		bound = &batch;
+
+		backend->bind_mesh_buffer(mesh_buffers[batch.model]);
+		backend->draw_instanced(batch.first, static_cast<uint32_t>(batch.objects.size()));
 	}
 
-	ui->draw_frame();
+	backend->end_frame(enable_vSync);
+}
 
-	d3d->present(enable_vSync);
+auto renderer::register_mesh(const mesh &model) -> mesh_id
+{
+	mesh_buffers.push_back(backend->make_mesh_buffer({.vertices = model.vertices, .indices = model.indicies}));
+	return static_cast<mesh_id>(mesh_buffers.size() - 1);
 }
 
-void renderer::add_mesh(const mesh &model, const matrix &transform, pipeline_type type)
+void renderer::add_mesh(mesh_id model, const matrix &transform, pipeline_type type)
 {
-	auto device = d3d->get_device();
+	assert(model < mesh_buffers.size());
 
-	transforms_src.push_back(&transform);
-	meshes.emplace_back(std::make_unique<mesh_buffer>(device, mesh_buffer::make_mesh_desc(model)));
-	transforms.emplace_back(std::make_unique<constant_buffer>(device, constant_buffer::desc
+	auto batch = std::find_if(std::begin(batches), std::end(batches), [&](const instance_batch &b)
 	{
-		.stage = shader_stage::vertex,
-		.slot = shader_slot::transform,
-		.size = sizeof(matrix),
-		.data = reinterpret_cast<const void *>(&transform)
-	}));
+		return b.pl == type and b.model == model;
+	});
+
+	if (batch == std::end(batches))
+	{
+		auto at = std::upper_bound(std::begin(batches), std::end(batches), type, [](pipeline_type t, const instance_batch &b)
+		{
+			return t < b.pl;
+		});
+		batch = batches.insert(at, instance_batch{
+			.pl = type,
+			.model = model,
+			.first = 0,
+		});
+	}
+
+	auto object = static_cast<uint32_t>(transforms_src.size());
+	transforms_src.push_back(&transform);
+	batch->objects.push_back(object);
+
+	// Parked at the end until the next update lays instances out
+	object_instance.push_back(static_cast<uint32_t>(instances.size()));
+	instances.push_back(transform);
+	layout_dirty = true;
+}
 
-	auto m_id = meshes.size() - 1,
-		 cb_id = transforms.size() - 1;
+void renderer::add_mesh(mesh_id model, uint32_t transform_slot, pipeline_type type)
+{
+	// Start hidden until the first published transform arrives
+	auto hidden = matrix{ DirectX::XMMatrixScaling(0.0f, 0.0f, 0.0f) };
+	add_mesh(model, hidden, type);
+
+	transforms_src.back() = nullptr;
+	published_slots.push_back({transform_slot, static_cast<uint32_t>(transforms_src.size() - 1)});
+}
 
-	pl_mesh_map.insert({type, {m_id, cb_id}});
+void renderer::consume_transforms(transform_buffer &source)
+{
+	published_src = &source;
+}
+
+void renderer::lay_out_instances()
+{
+	// Batch after batch, every object keeps its transform
+	laid_out.resize(instances.size());
+
+	auto next = 0u;
+	for (auto &b : batches)
+	{
+		b.first = next;
+		for (auto o : b.objects)
+		{
+			laid_out[next] = instances[object_instance[o]];
+			object_instance[o] = next++;
+		}
+	}
+
+	std::swap(instances, laid_out);
+	layout_dirty = false;
 }
 
 void renderer::make_pipelines()
 {
+	auto vso = read_shader("vs.cso"),
+	     pso = read_shader("ps.cso");
+
 	auto pl = static_cast<int>(pipeline_type::basic);
-	pl_list[pl] = std::make_unique<pipeline>(d3d->get_device(), pipeline::desc
+	pl_list[pl] = backend->make_pipeline(render_backend::pipeline_desc
 	{
 		.blend = blend_mode::opaque,
 		.depth_stencil = depth_stencil_mode::read_write,
 		.rasterizer = rasterizer_mode::cull_anti_clockwise,
 		.sampler = sampler_mode::anisotropic_clamp,
-		.primitive_topology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST,
-		.input_element_layout = vertex_elements,
-		.vertex_shader_bytecode = os::read_binary_file("vs.cso"),
-		.pixel_shader_bytecode = os::read_binary_file("ps.cso"),
+		.topology = primitive_topology::triangle_list,
+		.input_element_layout = instanced_vertex_elements,
+		.vertex_shader_bytecode = vso,
+		.pixel_shader_bytecode = pso,
 	});
 
 	pl = static_cast<int>(pipeline_type::wireframe);
-	pl_list[pl] = std::make_unique<pipeline>(d3d->get_device(), pipeline::desc
+	pl_list[pl] = backend->make_pipeline(render_backend::pipeline_desc
 	{
 		.blend = blend_mode::opaque,
 		.depth_stencil = depth_stencil_mode::read_write,
 		.rasterizer = rasterizer_mode::wireframe,
 		.sampler = sampler_mode::anisotropic_clamp,
-		.primitive_topology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST,
-		.input_element_layout = vertex_elements,
-		.vertex_shader_bytecode = os::read_binary_file("vs.cso"),
-		.pixel_shader_bytecode = os::read_binary_file("ps.cso"),
+		.topology = primitive_topology::triangle_list,
+		.input_element_layout = instanced_vertex_elements,
+		.vertex_shader_bytecode = vso,
+		.pixel_shader_bytecode = pso,
 	});
 
 	pl = static_cast<int>(pipeline_type::line_list);
-	pl_list[pl] = std::make_unique<pipeline>(d3d->get_device(), pipeline::desc
+	pl_list[pl] = backend->make_pipeline(render_backend::pipeline_desc
 	{
 		.blend = blend_mode::opaque,
 		.depth_stencil = depth_stencil_mode::read_write,
 		.rasterizer = rasterizer_mode::cull_anti_clockwise,
 		.sampler = sampler_mode::anisotropic_clamp,
-		.primitive_topology = D3D11_PRIMITIVE_TOPOLOGY_LINELIST,
-		.input_element_layout = vertex_elements,
-		.vertex_shader_bytecode = os::read_binary_file("vs.cso"),
-		.pixel_shader_bytecode = os::read_binary_file("ps.cso"),
+		.topology = primitive_topology::line_list,
+		.input_element_layout = instanced_vertex_elements,
+		.vertex_shader_bytecode = vso,
+		.pixel_shader_bytecode = pso,
 	});
 }
 
 void renderer::make_proj_cb()
 {
-	using namespace DirectX;
-	auto device = d3d->get_device();
-
-	proj_cb.reset();
-
-	auto aspect_ratio = width / static_cast<float>(height);
-	auto h_fov = XMConvertToRadians(field_of_view);
-	auto v_fov = 2.0f * std::atan(std::tan(h_fov / 2.0f) * aspect_ratio);
-
-	auto projection = matrix{ XMMatrixIdentity() };
-	projection.data = XMMatrixPerspectiveFovLH(v_fov, aspect_ratio, near_z, far_z);
-	projection.data = XMMatrixTranspose(projection.data);
-	proj_cb = std::make_unique<constant_buffer>(device, constant_buffer::desc
+	auto proj = projection();
+	proj_cb = backend->make_constant_buffer(render_backend::constant_buffer_desc
 	{
 		.stage = shader_stage::vertex,
 		.slot = shader_slot::projection,
 		.size = sizeof(matrix),
-		.data = reinterpret_cast<const void *>(&projection)
+		.data = reinterpret_cast<const void *>(&proj)
 	});
 }
 
 void renderer::make_view_cb()
 {
 	using namespace DirectX;
-	auto device = d3d->get_device();
-
-
-	view_cb.reset();
 
 	auto view = matrix{ XMMatrixIdentity() };
 	auto eye = XMVectorSet(0.0f, 0.0f, 4.0f, 0.0f),
@@ -230,11 +319,24 @@ void renderer::make_view_cb()
 		 up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
 	view.data = XMMatrixLookAtLH(eye, focus, up);
 	view.data = XMMatrixTranspose(view.data);
-	view_cb = std::make_unique<constant_buffer>(device, constant_buffer::desc
+	view_cb = backend->make_constant_buffer(render_backend::constant_buffer_desc
 	{
 		.stage = shader_stage::vertex,
 		.slot = shader_slot::view,
 		.size = sizeof(matrix),
 		.data = reinterpret_cast<const void *>(&view)
 	});
+}
+
+auto renderer::projection() const -> matrix
+{
+	using namespace DirectX;
+
+	auto aspect_ratio = width / static_cast<float>(height);
+	auto h_fov = XMConvertToRadians(field_of_view);
+	auto v_fov = 2.0f * std::atan(std::tan(h_fov / 2.0f) * aspect_ratio);
+
+	auto proj = matrix{ XMMatrixPerspectiveFovLH(v_fov, aspect_ratio, near_z, far_z) };
+	proj.data = XMMatrixTranspose(proj.data);
+	return proj;
 }
\ No newline at end of file
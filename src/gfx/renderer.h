@@ -1,12 +1,8 @@
 #pragma once
 
-#include "direct3d11.h"
-#include "renderpass.h"
-#include "pipeline.h"
-#include "gpu_data.h"
-#include "gui.h"
+#include "render_backend.h"
 
-#include "..\os\clock.h"
+#include "../os/clock.h"
 
 namespace gfx
 {
@@ -19,39 +15,74 @@ namespace gfx
 
 	class renderer
 	{
+		using resource_id = render_backend::resource_id;
+
+	public:
+		using mesh_id = uint32_t;
+
 	public:
 		renderer() = delete;
-		renderer(HWND hWnd);
+		renderer(std::unique_ptr<render_backend> backend, uint16_t width, uint16_t height);
 		~renderer();
 
-		auto on_resize(uintptr_t wParam, uintptr_t lParam) -> bool;
+		auto on_resize(uint16_t width, uint16_t height) -> bool;
 		void camera_at(const DirectX::XMFLOAT3 &position, const DirectX::XMFLOAT4 &orientation);
 		void update(const os::clock &clk);
 		void draw();
 
-		void add_mesh(const mesh &model, const matrix &transform, pipeline_type pl);
+		// Uploads the mesh once, objects added with the returned id share it
+		auto register_mesh(const mesh &model) -> mesh_id;
+
+		void add_mesh(mesh_id model, const matrix &transform, pipeline_type pl);
+		void add_mesh(mesh_id model, uint32_t transform_slot, pipeline_type pl);
+
+		void consume_transforms(transform_buffer &source);
 
 	private:
+		void lay_out_instances();
 		void make_pipelines();
 		void make_proj_cb();
 		void make_view_cb();
+		auto projection() const -> matrix;
 		
 	private:
 		uint16_t width{}, height{};
 
-		std::unique_ptr<direct3d11> d3d{};
-		std::unique_ptr<render_pass> rp{};
-		std::unique_ptr<gui> ui{};
+		std::unique_ptr<render_backend> backend{};
 
-		std::array<std::unique_ptr<pipeline>, 3> pl_list{};
+		std::array<resource_id, 3> pl_list{};
 
-		std::unique_ptr<constant_buffer> proj_cb{};
-		std::unique_ptr<constant_buffer> view_cb{};
+		resource_id proj_cb{};
+		resource_id view_cb{};
 
-		std::vector<std::unique_ptr<mesh_buffer>> meshes{};
+		// Mesh buffer per mesh_id
+		std::vector<resource_id> mesh_buffers{};
+
+		// Objects added with the same mesh and pipeline, drawn with one instanced call
+		struct instance_batch
+		{
+			pipeline_type pl;
+			mesh_id model;
+			uint32_t first;                  // into instances
+			std::vector<uint32_t> objects;
+		};
+
+		// In pipeline order, so each pipeline is bound once a frame
+		std::vector<instance_batch> batches{};
+
+		// Per object, where its transform comes from and where it goes
 		std::vector<const matrix *> transforms_src{};
-		std::vector<std::unique_ptr<constant_buffer>> transforms{};
+		std::vector<uint32_t> object_instance{};
+
+		// Batch after batch, uploaded whole once a frame. Objects added since
+		// the last update sit at the end until it lays them out again.
+		std::vector<matrix> instances{};
+		std::vector<matrix> laid_out{};
+		bool layout_dirty{};
+		resource_id instance_buffer_id{};
 
-		std::unordered_multimap<pipeline_type, std::pair<int, int>> pl_mesh_map{};
+		// Meshes placed by published transforms, pairs of transform slot and object
+		transform_buffer *published_src{};
+		std::vector<std::pair<uint32_t, uint32_t>> published_slots{};
 	};
 }
\ No newline at end of file
@@ -1,10 +1,15 @@
 #include "os/window.h"
 #include "os/clock.h"
+#include "os/frame_pacer.h"
+#include "os/task_graph.h"
 #include "os/input.h"
+#include "os/profiler.h"
 #include "gfx/renderer.h"
+#include "gfx/direct3d11_backend.h"
 #include "sim/simulation.h"
+#include "sim/sim_thread.h"
 
-#include "gfx/gpu_data.h"
+#include "gfx/render_data.h"
 #include "sim/sim_data.h"
 
 #include <imgui.h>
@@ -12,6 +17,15 @@
 
 namespace 
 {
+	// Pass this to step the simulation on its own thread, overlapping it with rendering
+	constexpr auto sim_thread_flag = std::string_view{"--sim-thread"};
+
+	// Pass this to keep each job pool worker on its own core
+	constexpr auto pin_threads_flag = std::string_view{"--pin-threads"};
+
+	// Frame rate cap for when vsync is off, 0 leaves pacing to present
+	constexpr auto frame_rate_limit{ 0.0 };
+
 	auto make_cube_mesh()
 	{
 		return gfx::mesh
@@ -102,13 +116,20 @@ namespace
 		return grid;
 	}
 
-	auto debug_ui(sim::rigid_body &body, float &gravity, DirectX::XMFLOAT3 &cam_pos, DirectX::XMFLOAT4 &cam_rot) -> bool
+	// What the debug UI changed this frame
+	struct ui_edits
+	{
+		bool moved;
+		bool reset;
+		bool gravity;
+	};
+
+	auto debug_ui(sim::rigid_body &body, float &gravity, DirectX::XMFLOAT3 &cam_pos, DirectX::XMFLOAT4 &cam_rot) -> ui_edits
 	{
-		auto update {false};
 		ImGui::Begin("Debug UI", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
 
-		update = update || ImGui::SliderFloat3("Body Location", &body.position.x, -4.0f, 4.0f);
-		update = update || ImGui::SliderFloat("Gravity", &gravity, -50.f, 0.f);
+		auto moved = ImGui::SliderFloat3("Body Location", &body.position.x, -4.0f, 4.0f);
+		auto gravity_changed = ImGui::SliderFloat("Gravity", &gravity, -50.f, 0.f);
 		auto reset = ImGui::Button("Reset");
 
 		ImGui::End();
@@ -124,14 +145,19 @@ namespace
 		ImGui::Text("Orientation: x{%.2f}, y{%.2f}, z{%.2f}, w{%.2f}", cam_rot.x, cam_rot.y, cam_rot.z, cam_rot.w);
 		ImGui::End();
 
-		return reset || update;
+		return {.moved = moved, .reset = reset, .gravity = gravity_changed};
 	}
 }
 
-auto main() -> int
+auto main(int argc, char *argv[]) -> int
 {
 	using sec = std::ratio<1>;
 
+	auto args = std::span(argv, argc);
+	auto use_sim_thread = std::find(std::begin(args) + 1, std::end(args), sim_thread_flag) != std::end(args);
+	auto pin_threads = std::find(std::begin(args) + 1, std::end(args), pin_threads_flag) != std::end(args);
+	os::init_job_pool({.pin_threads = pin_threads});
+
 	// Data holders
 	auto quit{false};
 	auto cam_pos = DirectX::XMFLOAT3{0.0f, 1.0f, -4.0f};
@@ -156,14 +182,18 @@ auto main() -> int
 		.size = { 800, 600 },
 	});
 	auto inpt = os::input(wnd.handle(), {os::input_device::keyboard, os::input_device::mouse});
-	auto rndr = gfx::renderer(wnd.handle());
+	auto [client_width, client_height] = os::get_client_area(wnd.handle());
+	auto rndr = gfx::renderer(std::make_unique<gfx::direct3d11_backend>(wnd.handle()), client_width, client_height);
 	auto sim = sim::simulation({0.0f, gravity, 0.0f});
+	auto sim_worker = sim::sim_thread(sim, {});
 	auto clk = os::clock();
+	auto pacer = os::frame_pacer({.target_rate = frame_rate_limit});
 
 	// Window callbacks
-	wnd.set_callback(os::window_msg::resize, [&](uintptr_t wParam, uintptr_t lParam)
+	wnd.set_callback(os::window_msg::resize, [&](uintptr_t, uintptr_t lParam)
 	{
-		return rndr.on_resize(wParam, lParam);
+		auto [width, height] = os::get_client_area(lParam);
+		return rndr.on_resize(width, height);
 	});
 
 	auto update_input = [&]()
@@ -276,38 +306,168 @@ auto main() -> int
 	};
 
 	// Tell system about data
-	rndr.add_mesh(cube_mesh, cube_matrix, gfx::pipeline_type::basic);
-	sim.add_body(cube_body);
+	auto cube = sim.add_body(cube_body);
+	auto cube_model = rndr.register_mesh(cube_mesh);
+	auto grid_model = rndr.register_mesh(grid_mesh);
+	auto cube_slot = 0u;
+	if (use_sim_thread)
+	{
+		cube_slot = sim_worker.track(cube);
+		rndr.add_mesh(cube_model, cube_slot, gfx::pipeline_type::basic);
+		rndr.consume_transforms(sim_worker.transforms());
+		sim_worker.start();
+	}
+	else
+	{
+		rndr.add_mesh(cube_model, cube_matrix, gfx::pipeline_type::basic);
+	}
 
-	rndr.add_mesh(grid_mesh, grid_matrix, gfx::pipeline_type::line_list);
+	rndr.add_mesh(grid_model, grid_matrix, gfx::pipeline_type::line_list);
 
 	rndr.camera_at(cam_pos, cam_rot);
 
 	// Show window
 	wnd.show();
 
-	// The Loop
-	while (wnd.handle() and not quit)
+	PROFILE_THREAD("main");
+
+	// Frame stages, each names the data it touches so the graph can order them.
+	// The next frame's simulation only waits for the transform upload, so it
+	// runs while this frame draws and presents.
+	auto frame = os::task_graph(os::job_pool());
+
+	frame.add_stage({
+		.name = "messages",
+		.writes = {"window", "input devices", "clock"},
+		.thread = os::task_thread::main,
+	}, [&]()
 	{
 		inpt.process_messages();
 		wnd.process_messages();
 		clk.tick();
+	});
+
+	frame.add_stage({
+		.name = "input",
+		.reads = {"input devices", "clock"},
+		.writes = {"camera", "renderer"},
+		.thread = os::task_thread::main,
+	}, update_input);
 
+	if (not use_sim_thread)
+	{
+		frame.add_stage({
+			.name = "simulation",
+			.writes = {"bodies", "cube transform"},
+		}, [&]()
+		{
+			//sim.update(clk);
 
-		update_input();
-		//sim.update(clk);
+			cube_body = sim.get_body(cube);
+			sim::update_transforms(cube_body, cube_matrix);
+		});
+	}
+	else
+	{
+		// The sim thread owns the body, show where it was last published
+		frame.add_stage({
+			.name = "read back",
+			.reads = {"renderer"},
+			.writes = {"bodies"},
+			.thread = os::task_thread::main,
+		}, [&]()
+		{
+			using namespace DirectX;
 
-		sim::update_transforms(cube_body, cube_matrix);
+			auto &published = sim_worker.transforms().front();
+			if (cube_slot < published.size())
+			{
+				auto transform = XMMatrixTranspose(published[cube_slot].data);
+				XMStoreFloat3(&cube_body.position, transform.r[3]);
+			}
+		});
+	}
 
-		if (debug_ui(cube_body, gravity, cam_pos, cam_rot))
+	frame.add_stage({
+		.name = "debug ui",
+		.reads = {"camera"},
+		.writes = {"bodies", "renderer", "gui"},
+		.thread = os::task_thread::main,
+	}, [&]()
+	{
+		auto edits = debug_ui(cube_body, gravity, cam_pos, cam_rot);
+		if (not (edits.moved or edits.reset or edits.gravity))
 		{
-			sim.change_gravity({0.0f, gravity, 0.0f});
-			rndr.camera_at(cam_pos, cam_rot);
+			return;
+		}
+
+		// Only what the UI changed, the rest of the body is whatever the sim has now
+		auto edit = [=, position = cube_body.position](sim::simulation &s)
+		{
+			if (edits.moved or edits.reset)
+			{
+				auto body = s.get_body(cube);
+				body.position = position;
+				if (edits.reset)
+				{
+					body.velocity = {0.0f, 0.0f, 0.0f};
+				}
+				s.set_body(cube, body);
+			}
+
+			if (edits.gravity)
+			{
+				s.change_gravity({0.0f, gravity, 0.0f});
+			}
+		};
+
+		// Sim thread owns the simulation while running, hand it the edit
+		if (use_sim_thread)
+		{
+			sim_worker.submit(edit);
+		}
+		else
+		{
+			edit(sim);
 		}
+		rndr.camera_at(cam_pos, cam_rot);
+	});
 
+	frame.add_stage({
+		.name = "upload",
+		.reads = {"cube transform", "clock"},
+		.writes = {"renderer", "gui"},
+		.thread = os::task_thread::main,
+	}, [&]()
+	{
 		rndr.update(clk);
+	});
+
+	frame.add_stage({
+		.name = "draw",
+		.writes = {"renderer", "gui", "window"},
+		.thread = os::task_thread::main,
+	}, [&]()
+	{
 		rndr.draw();
+	});
+
+	frame.add_stage({
+		.name = "pacing",
+		.reads = {"window"},
+		.thread = os::task_thread::main,
+	}, [&]()
+	{
+		pacer.wait();
+	});
+
+	// The Loop
+	while (wnd.handle() and not quit)
+	{
+		PROFILE_ZONE("frame");
+		frame.run_frame();
 	}
+	frame.wait_idle();
 	
 	return 0;
 }
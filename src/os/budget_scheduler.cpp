@@ -0,0 +1,78 @@
+#include "budget_scheduler.h"
+
+#include "profiler.h"
+
+using namespace os;
+
+budget_scheduler::budget_scheduler(const desc &desc_) :
+	budget_us{static_cast<double>(desc_.budget.count())}
+{ }
+
+budget_scheduler::~budget_scheduler() = default;
+
+auto budget_scheduler::add_task(const char *name, task_fn fn) -> uint32_t
+{
+	tasks.push_back({name, std::move(fn), false});
+	return static_cast<uint32_t>(tasks.size() - 1);
+}
+
+void budget_scheduler::wake(uint32_t t)
+{
+	tasks[t].pending = true;
+}
+
+auto budget_scheduler::is_pending(uint32_t t) const -> bool
+{
+	return tasks[t].pending;
+}
+
+void budget_scheduler::run(const clock &clk)
+{
+	using us = std::micro;
+
+	auto start = clk.since_tick<us>();
+	auto count = static_cast<uint32_t>(tasks.size());
+	last_units = 0;
+
+	auto idle = 0u;
+	while (idle < count)
+	{
+		if (last_units > 0 and clk.since_tick<us>() - start >= budget_us)
+		{
+			break;
+		}
+
+		auto &t = tasks[next_task];
+		next_task = (next_task + 1) % count;
+
+		if (not t.pending)
+		{
+			idle++;
+			continue;
+		}
+
+		{
+			PROFILE_ZONE(t.name);
+			t.pending = t.function();
+		}
+		last_units++;
+		idle = 0;
+	}
+
+	last_used_us = clk.since_tick<us>() - start;
+}
+
+void budget_scheduler::set_budget(std::chrono::microseconds budget)
+{
+	budget_us = static_cast<double>(budget.count());
+}
+
+auto budget_scheduler::units_run() const -> uint32_t
+{
+	return last_units;
+}
+
+auto budget_scheduler::time_used() const -> std::chrono::microseconds
+{
+	return std::chrono::microseconds{static_cast<int64_t>(last_used_us)};
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "clock.h"
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+namespace os
+{
+	// Background upkeep in small units under a per frame time budget.
+	// A task does one unit of work per call and says whether it has more,
+	// pending tasks take turns so one long job cannot starve the rest.
+	// Whatever is left when the budget runs out carries on next frame.
+	class budget_scheduler
+	{
+	public:
+		// Runs one unit of work, returns false once there is nothing left
+		using task_fn = std::function<bool()>;
+
+		struct desc
+		{
+			std::chrono::microseconds budget{500};
+		};
+
+	public:
+		budget_scheduler() = delete;
+		explicit budget_scheduler(const desc &description);
+		~budget_scheduler();
+
+		auto add_task(const char *name, task_fn fn) -> uint32_t;
+
+		// Task has work, it runs from the next run() on until it reports none left
+		void wake(uint32_t task);
+		auto is_pending(uint32_t task) const -> bool;
+
+		// Runs units until the budget is spent, measured on clk from the call.
+		// At least one unit runs when anything is pending, so work never stalls.
+		void run(const clock &clk);
+
+		void set_budget(std::chrono::microseconds budget);
+
+		// Of the last run
+		auto units_run() const -> uint32_t;
+		auto time_used() const -> std::chrono::microseconds;
+
+	private:
+		struct task
+		{
+			const char *name;
+			task_fn function;
+			bool pending;
+		};
+
+		std::vector<task> tasks{};
+		double budget_us{};
+		uint32_t next_task{};    // round robin start, so the first task does not always go first
+
+		uint32_t last_units{};
+		double last_used_us{};
+	};
+}
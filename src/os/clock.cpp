@@ -1,9 +1,159 @@
 #include "clock.h"
 
+#include <cmath>
+
 using namespace os;
 namespace chrono = std::chrono;
 using hrc = std::chrono::high_resolution_clock;
 
+namespace
+{
+	// Log-linear buckets, exact below 2^sub_bucket_bits ns, then
+	// each power of two is split into half as many linear sub-buckets
+	constexpr auto sub_bucket_bits = 7u;
+	constexpr auto sub_bucket_count = 1u << sub_bucket_bits;
+	constexpr auto half_sub_bucket_count = sub_bucket_count / 2;
+	constexpr auto max_value_bits = 40u;    // ~18 minutes in ns, longer deltas clamp
+	constexpr auto bucket_count = sub_bucket_count + (max_value_bits - sub_bucket_bits) * half_sub_bucket_count;
+
+	auto bucket_of(uint64_t ns) -> uint32_t
+	{
+		ns = std::min(ns, (uint64_t{1} << max_value_bits) - 1);
+
+		auto bits = static_cast<uint32_t>(std::bit_width(ns));
+		if (bits <= sub_bucket_bits)
+		{
+			return static_cast<uint32_t>(ns);
+		}
+
+		// Top sub_bucket_bits of the value, always in [half, full) sub-bucket range
+		auto shift = bits - sub_bucket_bits;
+		auto top = static_cast<uint32_t>(ns >> shift);
+		return sub_bucket_count + (shift - 1) * half_sub_bucket_count + (top - half_sub_bucket_count);
+	}
+
+	// Highest value that lands in a bucket
+	auto bucket_upper(uint32_t bucket) -> uint64_t
+	{
+		if (bucket < sub_bucket_count)
+		{
+			return bucket;
+		}
+
+		auto shift = (bucket - sub_bucket_count) / half_sub_bucket_count + 1;
+		auto top = uint64_t{(bucket - sub_bucket_count) % half_sub_bucket_count + half_sub_bucket_count};
+		return ((top + 1) << shift) - 1;
+	}
+
+	auto to_ms(uint64_t ns) -> double
+	{
+		return ns / 1'000'000.0;
+	}
+}
+
+frame_statistics::frame_statistics() :
+	history(history_size),
+	histogram(bucket_count)
+{ }
+
+frame_statistics::~frame_statistics() = default;
+
+void frame_statistics::add(chrono::nanoseconds delta)
+{
+	auto ns = static_cast<uint64_t>(std::max(delta.count(), chrono::nanoseconds::rep{0}));
+
+	history[recorded % history_size] = ns;
+	histogram[bucket_of(ns)]++;
+
+	recorded++;
+	total_ns += ns;
+	max_ns = std::max(max_ns, ns);
+}
+
+void frame_statistics::reset()
+{
+	std::fill(std::begin(history), std::end(history), 0);
+	std::fill(std::begin(histogram), std::end(histogram), 0);
+	recorded = 0;
+	total_ns = 0;
+	max_ns = 0;
+}
+
+auto frame_statistics::frame_count() const -> uint64_t
+{
+	return recorded;
+}
+
+auto frame_statistics::percentile_ns(double p) const -> uint64_t
+{
+	if (recorded == 0)
+	{
+		return 0;
+	}
+
+	// Rank of the sample at p, then the bucket that holds it
+	auto rank = std::max(static_cast<uint64_t>(std::ceil(std::clamp(p, 0.0, 1.0) * recorded)), uint64_t{1});
+	auto seen = uint64_t{};
+	for (auto b = 0u; b < bucket_count; b++)
+	{
+		seen += histogram[b];
+		if (seen >= rank)
+		{
+			return std::min(bucket_upper(b), max_ns);
+		}
+	}
+	return max_ns;
+}
+
+auto frame_statistics::rolling_total_ns(uint32_t frames) const -> uint64_t
+{
+	auto total = uint64_t{};
+	for (auto i = 0u; i < frames; i++)
+	{
+		total += history[(recorded - 1 - i) % history_size];
+	}
+	return total;
+}
+
+void frame_statistics::write_json(std::ostream &out) const
+{
+	using ms = std::milli;
+
+	out << "{\n"
+		<< "  \"frames\": " << recorded << ",\n"
+		<< "  \"mean_ms\": " << mean<ms>() << ",\n"
+		<< "  \"p50_ms\": " << percentile<ms>(0.50) << ",\n"
+		<< "  \"p95_ms\": " << percentile<ms>(0.95) << ",\n"
+		<< "  \"p99_ms\": " << percentile<ms>(0.99) << ",\n"
+		<< "  \"max_ms\": " << max<ms>() << ",\n"
+		<< "  \"rolling_mean_ms\": {\"16\": " << rolling_mean<ms>(16)
+		<< ", \"64\": " << rolling_mean<ms>(64)
+		<< ", \"256\": " << rolling_mean<ms>(256) << "},\n";
+
+	// Oldest first
+	auto kept = static_cast<uint32_t>(std::min<uint64_t>(recorded, history_size));
+	out << "  \"recent_ms\": [";
+	for (auto i = 0u; i < kept; i++)
+	{
+		out << (i ? ", " : "") << to_ms(history[(recorded - kept + i) % history_size]);
+	}
+	out << "],\n";
+
+	// Non-empty buckets as [upper bound, count]
+	out << "  \"histogram_ms\": [";
+	auto first = true;
+	for (auto b = 0u; b < bucket_count; b++)
+	{
+		if (histogram[b] == 0)
+		{
+			continue;
+		}
+		out << (first ? "" : ", ") << "[" << to_ms(bucket_upper(b)) << ", " << histogram[b] << "]";
+		first = false;
+	}
+	out << "]\n}\n";
+}
+
 clock::clock()
 {
 	tp_previous = hrc::now();
@@ -17,6 +167,13 @@ void clock::tick()
 	delta_time = tp_now - tp_previous;
 	total_time += delta_time;
 	tp_previous = tp_now;
+
+	frame_stats.add(chrono::duration_cast<chrono::nanoseconds>(delta_time));
+
+	if (on_stats and stats_interval > 0 and frame_stats.frame_count() % stats_interval == 0)
+	{
+		on_stats(*this);
+	}
 }
 
 void clock::reset()
@@ -24,4 +181,21 @@ void clock::reset()
 	tp_previous = hrc::now();
 	delta_time = hrc::duration{};
 	total_time = hrc::duration{};
-}
\ No newline at end of file
+	frame_stats.reset();
+}
+
+auto clock::stats() const -> const frame_statistics &
+{
+	return frame_stats;
+}
+
+void clock::reset_stats()
+{
+	frame_stats.reset();
+}
+
+void clock::set_stats_hook(stats_hook hook, uint32_t interval)
+{
+	on_stats = std::move(hook);
+	stats_interval = interval;
+}
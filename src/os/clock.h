@@ -1,11 +1,83 @@
 #pragma once
 
+#include <algorithm>
 #include <chrono>
+#include <functional>
+#include <ostream>
+#include <vector>
 
 namespace os
 {
+	// Frame time statistics.
+	// Keeps a ring of recent deltas for rolling averages and a log-linear
+	// (HDR style) histogram of every delta since reset for percentiles.
+	class frame_statistics
+	{
+	public:
+		static constexpr auto history_size = 256u;
+
+	public:
+		frame_statistics();
+		~frame_statistics();
+
+		void add(std::chrono::nanoseconds delta);
+		void reset();
+
+		auto frame_count() const -> uint64_t;
+
+		// p in [0, 1], accurate to within 1/64 of the value
+		template <typename T>
+		auto percentile(double p) const -> double
+		{
+			return to<T>(percentile_ns(p));
+		}
+
+		template <typename T>
+		auto max() const -> double
+		{
+			return to<T>(max_ns);
+		}
+
+		template <typename T>
+		auto mean() const -> double
+		{
+			return recorded > 0 ? to<T>(total_ns) / recorded : 0.0;
+		}
+
+		// Mean of the last frames deltas, at most history_size
+		template <typename T>
+		auto rolling_mean(uint32_t frames) const -> double
+		{
+			auto n = std::min<uint64_t>({frames, history_size, recorded});
+			return n > 0 ? to<T>(rolling_total_ns(static_cast<uint32_t>(n))) / n : 0.0;
+		}
+
+		// Summary, percentiles, rolling means, recent deltas and histogram as JSON, times in ms
+		void write_json(std::ostream &out) const;
+
+	private:
+		template <typename T>
+		static auto to(uint64_t ns) -> double
+		{
+			return std::chrono::duration<double, T>(std::chrono::nanoseconds(ns)).count();
+		}
+
+		auto percentile_ns(double p) const -> uint64_t;
+		auto rolling_total_ns(uint32_t frames) const -> uint64_t;
+
+	private:
+		std::vector<uint64_t> history{};
+		std::vector<uint64_t> histogram{};
+		uint64_t recorded{};
+		uint64_t total_ns{};
+		uint64_t max_ns{};
+	};
+
 	class clock
 	{
+	public:
+		using stats_hook = std::function<void(const clock &)>;
+
 	public:
 		clock();
 		~clock();
@@ -27,9 +99,27 @@ namespace os
 			return std::chrono::duration_cast<ts>(delta_time).count();
 		};
 
+		// Time since the last tick, for measuring work within a frame
+		template <typename T>
+		auto since_tick() const -> double
+		{
+			using ts = std::chrono::duration<double, T>;
+			return std::chrono::duration_cast<ts>(std::chrono::high_resolution_clock::now() - tp_previous).count();
+		};
+
+		auto stats() const -> const frame_statistics &;
+		void reset_stats();
+
+		// Called from tick every interval frames, for dumping stats from headless runs
+		void set_stats_hook(stats_hook hook, uint32_t interval);
+
 	private:
 		std::chrono::high_resolution_clock::time_point tp_previous{};
 		std::chrono::high_resolution_clock::duration delta_time{};
 		std::chrono::high_resolution_clock::duration total_time{};
+
+		frame_statistics frame_stats{};
+		stats_hook on_stats{};
+		uint32_t stats_interval{};
 	};
 }
@@ -0,0 +1,123 @@
+#include "frame_pacer.h"
+
+#include <cmath>
+
+#ifdef _WIN32
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+using namespace os;
+namespace chrono = std::chrono;
+using steady = std::chrono::steady_clock;
+
+namespace
+{
+	constexpr auto sleep_chunk = chrono::milliseconds(1);
+
+	// Start pessimistic, the estimate settles after a few dozen sleeps
+	constexpr auto initial_sleep_ns = 2'000'000.0;
+	constexpr auto estimate_weight = 1.0 / 32.0;
+}
+
+frame_pacer::frame_pacer(const desc &description) :
+	sleep_mean_ns{initial_sleep_ns}
+{
+	set_target_rate(description.target_rate);
+
+#ifdef _WIN32
+	// Default timer granularity is ~15.6ms, which would leave most of the frame to the spin
+	timeBeginPeriod(1);
+#endif
+}
+
+frame_pacer::~frame_pacer()
+{
+#ifdef _WIN32
+	timeEndPeriod(1);
+#endif
+}
+
+void frame_pacer::wait()
+{
+	if (rate <= 0.0)
+	{
+		return;
+	}
+
+	auto now = steady::now();
+	if (deadline == time_point{})
+	{
+		deadline = now + period;
+	}
+
+	// More than a frame behind, start over rather than rush frames to catch up
+	if (now - deadline > period)
+	{
+		deadline = now;
+	}
+
+	wait_until(deadline);
+	deadline += period;
+}
+
+void frame_pacer::wait_until(time_point tp)
+{
+	auto now = steady::now();
+	if (now >= tp)
+	{
+		return;
+	}
+
+	while (tp - now > spin_threshold())
+	{
+		std::this_thread::sleep_for(sleep_chunk);
+
+		auto woke = steady::now();
+		record_sleep(woke - now);
+		now = woke;
+	}
+
+	while (now < tp)
+	{
+		std::this_thread::yield();
+		now = steady::now();
+	}
+
+	lateness.add(now - tp);
+}
+
+void frame_pacer::set_target_rate(double target)
+{
+	rate = target;
+	period = rate > 0.0
+		? chrono::duration_cast<steady::duration>(chrono::duration<double>(1.0 / rate))
+		: steady::duration{};
+	deadline = time_point{};
+}
+
+auto frame_pacer::target_rate() const -> double
+{
+	return rate;
+}
+
+auto frame_pacer::overshoot() const -> const frame_statistics &
+{
+	return lateness;
+}
+
+auto frame_pacer::spin_threshold() const -> chrono::nanoseconds
+{
+	// Two deviations over the mean covers nearly every wake up
+	auto ns = sleep_mean_ns + 2.0 * std::sqrt(sleep_variance_ns);
+	return chrono::nanoseconds(static_cast<int64_t>(ns));
+}
+
+void frame_pacer::record_sleep(chrono::nanoseconds slept)
+{
+	// Exponentially weighted, so the estimate follows changes in system load
+	auto ns = static_cast<double>(slept.count());
+	auto diff = ns - sleep_mean_ns;
+	sleep_mean_ns += estimate_weight * diff;
+	sleep_variance_ns = (1.0 - estimate_weight) * (sleep_variance_ns + estimate_weight * diff * diff);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "clock.h"
+
+#include <chrono>
+
+namespace os
+{
+	// Holds a loop to a target rate without relying on vsync.
+	// Sleeps while the deadline is further away than the measured wake up
+	// error of the OS scheduler, then spins for the rest, so a core is only
+	// busy for the last fraction of a millisecond of each frame.
+	class frame_pacer
+	{
+	public:
+		using time_point = std::chrono::steady_clock::time_point;
+
+		struct desc
+		{
+			double target_rate = 60.0;    // frames per second, 0 leaves the loop unpaced
+		};
+
+	public:
+		frame_pacer() = delete;
+		explicit frame_pacer(const desc &description);
+		~frame_pacer();
+
+		// Blocks until the next frame is due, deadlines advance by whole periods so the rate does not drift
+		void wait();
+
+		// Blocks until tp, for loops that keep their own schedule
+		void wait_until(time_point tp);
+
+		void set_target_rate(double rate);
+		auto target_rate() const -> double;
+
+		// How late each wait woke up past its deadline
+		auto overshoot() const -> const frame_statistics &;
+
+		// Time left at which waiting switches from sleeping to spinning
+		auto spin_threshold() const -> std::chrono::nanoseconds;
+
+	private:
+		void record_sleep(std::chrono::nanoseconds slept);
+
+	private:
+		double rate{};
+		std::chrono::steady_clock::duration period{};
+		time_point deadline{};
+
+		// Running mean and variance of how long a 1ms sleep really takes
+		double sleep_mean_ns{};
+		double sleep_variance_ns{};
+
+		frame_statistics lateness{};
+	};
+}
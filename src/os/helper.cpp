@@ -1,5 +1,7 @@
 #include "helper.h"
 
+#include <iterator>
+
 using namespace os;
 
 auto os::read_binary_file(const std::filesystem::path &file_path) -> std::vector<uint8_t>
@@ -0,0 +1,477 @@
+#include "job_system.h"
+
+#include "profiler.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace os;
+
+namespace
+{
+	constexpr auto deque_capacity = 4096u;    // per thread, also the size of its job ring
+	constexpr auto deque_mask = deque_capacity - 1;
+
+	// Per element work in most loops is tiny, below this the job costs more than it saves
+	constexpr auto min_default_grain = 16u;
+	constexpr auto ranges_per_thread = 16u;
+
+	// Idle workers keep looking this many times before going to sleep
+	constexpr auto idle_spins = 64u;
+
+	std::atomic<uint64_t> next_pool_id{1};
+
+	void pin_thread(std::jthread &thread, uint32_t core)
+	{
+#if defined(_WIN32)
+		SetThreadAffinityMask(thread.native_handle(), DWORD_PTR{1} << core);
+#elif defined(__linux__)
+		auto set = cpu_set_t{};
+		CPU_ZERO(&set);
+		CPU_SET(core, &set);
+		pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#endif
+	}
+}
+
+// Chase-Lev deque, after Le, Pop, Cohen and Zappa Nardelli's C11 version.
+// Only the owning thread calls push and pop, any thread may steal.
+struct job_system::worker_slot
+{
+	alignas(64) std::atomic<int64_t> top{};
+	alignas(64) std::atomic<int64_t> bottom{};
+
+	std::unique_ptr<std::atomic<job *>[]> buffer = std::make_unique<std::atomic<job *>[]>(deque_capacity);
+
+	// Jobs are handed out round robin. An entry stays live from allocation until the
+	// job is copied out to run, pops are LIFO so the ring can come back to one still queued
+	std::unique_ptr<job[]> jobs = std::make_unique<job[]>(deque_capacity);
+	std::unique_ptr<std::atomic<bool>[]> live = std::make_unique<std::atomic<bool>[]>(deque_capacity);
+	uint32_t next_job{};
+
+	std::thread::id owner{};
+	uint32_t random{};
+
+	auto push(job *j) -> bool
+	{
+		auto b = bottom.load(std::memory_order_relaxed);
+		auto t = top.load(std::memory_order_acquire);
+		if (b - t >= deque_capacity)
+		{
+			return false;
+		}
+
+		// Release so a thief that sees the new bottom also sees the job
+		buffer[b & deque_mask].store(j, std::memory_order_relaxed);
+		bottom.store(b + 1, std::memory_order_release);
+		return true;
+	}
+
+	auto pop() -> job *
+	{
+		auto b = bottom.load(std::memory_order_relaxed) - 1;
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		auto t = top.load(std::memory_order_relaxed);
+
+		if (t > b)
+		{
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		auto j = buffer[b & deque_mask].load(std::memory_order_relaxed);
+		if (t == b)
+		{
+			// Last job, race the thieves for it
+			if (not top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			{
+				j = nullptr;
+			}
+			bottom.store(b + 1, std::memory_order_relaxed);
+		}
+		return j;
+	}
+
+	auto steal() -> job *
+	{
+		auto t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		auto b = bottom.load(std::memory_order_acquire);
+
+		if (t >= b)
+		{
+			return nullptr;
+		}
+
+		auto j = buffer[t & deque_mask].load(std::memory_order_relaxed);
+		if (not top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		{
+			return nullptr;
+		}
+		return j;
+	}
+
+	// Copies a job out of the ring and frees its entry
+	auto take(job *j) -> job
+	{
+		auto local = *j;
+		live[j - jobs.get()].store(false, std::memory_order_release);
+		return local;
+	}
+
+	auto empty() const -> bool
+	{
+		return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+	}
+
+	auto next_random() -> uint32_t
+	{
+		random ^= random << 13;
+		random ^= random >> 17;
+		random ^= random << 5;
+		return random;
+	}
+};
+
+struct job_system::range_task
+{
+	job_system *system;
+	range_function function;
+	const void *context;
+	uint32_t begin;
+	uint32_t end;
+	uint32_t grain;
+};
+
+thread_local job_system::job job_system::overflow_job{};
+
+job_system::job_system(const desc &description) :
+	id{next_pool_id.fetch_add(1, std::memory_order_relaxed)}
+{
+	auto hardware = std::max(std::thread::hardware_concurrency(), 1u);
+	auto count = description.worker_count > 0 ? description.worker_count : hardware - 1;
+
+	// Leave room for the threads that call in from outside
+	count = std::min(count, max_threads / 2);
+
+	for (auto i = 0u; i < count; i++)
+	{
+		register_slot(std::thread::id{});
+	}
+
+	workers.reserve(count);
+	for (auto i = 0u; i < count; i++)
+	{
+		workers.emplace_back([this, i](std::stop_token stop)
+		{
+			worker_main(stop, i);
+		});
+
+		if (description.pin_threads)
+		{
+			pin_thread(workers.back(), (i + 1) % hardware);
+		}
+	}
+}
+
+job_system::~job_system()
+{
+	for (auto &worker : workers)
+	{
+		worker.request_stop();
+	}
+
+	work_epoch.fetch_add(1);
+	work_epoch.notify_all();
+	workers.clear();
+}
+
+void job_system::wait(job_counter &counter)
+{
+	auto *slot = local_slot();
+	auto j = job{};
+	while (not counter.done())
+	{
+		if (find_job(slot, j))
+		{
+			execute(j);
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+auto job_system::help() -> bool
+{
+	auto j = job{};
+	auto found = find_job(local_slot(), j);
+	if (found)
+	{
+		execute(j);
+	}
+	return found;
+}
+
+auto job_system::thread_count() const -> uint32_t
+{
+	return static_cast<uint32_t>(workers.size()) + 1;
+}
+
+auto job_system::allocate_job(job_counter &counter) -> job &
+{
+	counter.pending.fetch_add(1, std::memory_order_relaxed);
+
+	// Threads past max_threads, or whose next ring entry is still queued, run the job inline
+	auto *slot = local_slot();
+	auto index = slot ? slot->next_job++ & deque_mask : 0u;
+	if (slot == nullptr or slot->live[index].load(std::memory_order_acquire))
+	{
+		overflow_job.counter = &counter;
+		return overflow_job;
+	}
+
+	auto &j = slot->jobs[index];
+	slot->live[index].store(true, std::memory_order_relaxed);
+	j.counter = &counter;
+	return j;
+}
+
+void job_system::push(job &j)
+{
+	if (&j == &overflow_job)
+	{
+		execute(j);
+		return;
+	}
+
+	auto *slot = local_slot();
+	if (not slot->push(&j))
+	{
+		execute(slot->take(&j));
+		return;
+	}
+
+	// Sleepers check the epoch after registering, so either they see the bump or we see them
+	work_epoch.fetch_add(1);
+	if (sleeping.load() > 0)
+	{
+		work_epoch.notify_one();
+	}
+}
+
+void job_system::run_range(uint32_t begin, uint32_t end, uint32_t grain, range_function fn, const void *context)
+{
+	if (begin >= end)
+	{
+		return;
+	}
+
+	auto count = end - begin;
+	if (grain == 0)
+	{
+		grain = std::max(count / (thread_count() * ranges_per_thread), min_default_grain);
+	}
+
+	if (count <= grain or workers.empty())
+	{
+		fn(context, begin, end);
+		return;
+	}
+
+	auto counter = job_counter{};
+	split(range_task{this, fn, context, begin, end, grain}, counter);
+	wait(counter);
+}
+
+void job_system::split(range_task task, job_counter &counter)
+{
+	auto *slot = local_slot();
+	if (slot == nullptr)
+	{
+		task.function(task.context, task.begin, task.end);
+		return;
+	}
+
+	// Lazy binary splitting, only split again once the last half was stolen,
+	// otherwise keep working through grain sized pieces
+	while (task.end - task.begin > task.grain)
+	{
+		if (slot->empty())
+		{
+			auto half = task;
+			half.begin = task.begin + (task.end - task.begin) / 2;
+			task.end = half.begin;
+
+			auto &j = allocate_job(counter);
+			j.function = [](const job &self)
+			{
+				auto t = range_task{};
+				std::memcpy(&t, self.payload.data(), sizeof(t));
+				t.system->split(t, *self.counter);
+			};
+			static_assert(sizeof(range_task) <= payload_size);
+			std::memcpy(j.payload.data(), &half, sizeof(half));
+			push(j);
+		}
+		else
+		{
+			task.function(task.context, task.begin, task.begin + task.grain);
+			task.begin += task.grain;
+		}
+	}
+
+	task.function(task.context, task.begin, task.end);
+}
+
+auto job_system::local_slot() -> worker_slot *
+{
+	thread_local auto cached_pool = uint64_t{};
+	thread_local auto cached_slot = static_cast<worker_slot *>(nullptr);
+
+	if (cached_pool != id)
+	{
+		cached_slot = register_slot(std::this_thread::get_id());
+		cached_pool = id;
+	}
+	return cached_slot;
+}
+
+auto job_system::register_slot(std::thread::id owner) -> worker_slot *
+{
+	auto lock = std::lock_guard{slot_mutex};
+	auto count = slot_count.load(std::memory_order_relaxed);
+
+	// A thread that used this pool before keeps its slot, its deque is empty between waits
+	if (owner != std::thread::id{})
+	{
+		for (auto i = 0u; i < count; i++)
+		{
+			if (slots[i]->owner == owner)
+			{
+				return slots[i].get();
+			}
+		}
+	}
+
+	if (count == max_threads)
+	{
+		return nullptr;
+	}
+
+	auto &slot = slots[count];
+	slot = std::make_unique<worker_slot>();
+	slot->owner = owner;
+	slot->random = count * 2654435761u + 1;
+
+	slot_count.store(count + 1, std::memory_order_release);
+	return slot.get();
+}
+
+auto job_system::find_job(worker_slot *slot, job &out) -> bool
+{
+	// Jobs only ever sit in their own thread's deque, so the victim also owns the ring entry
+	if (slot)
+	{
+		if (auto *j = slot->pop())
+		{
+			out = slot->take(j);
+			return true;
+		}
+	}
+
+	// Start at a random victim so thieves spread out
+	auto count = slot_count.load(std::memory_order_acquire);
+	auto start = slot ? slot->next_random() : 0u;
+	for (auto i = 0u; i < count; i++)
+	{
+		auto *victim = slots[(start + i) % count].get();
+		if (victim == slot)
+		{
+			continue;
+		}
+
+		if (auto *j = victim->steal())
+		{
+			out = victim->take(j);
+			return true;
+		}
+	}
+	return false;
+}
+
+void job_system::execute(const job &j)
+{
+	// Run a copy, the ring entry or overflow job may be handed out again while this runs
+	auto local = j;
+	local.function(local);
+	local.counter->pending.fetch_sub(1, std::memory_order_release);
+}
+
+void job_system::worker_main(std::stop_token stop, uint32_t index)
+{
+	PROFILE_THREAD("job worker");
+
+	// Claim the slot made for this worker, so local_slot() finds it rather than registering another
+	{
+		auto lock = std::lock_guard{slot_mutex};
+		slots[index]->owner = std::this_thread::get_id();
+	}
+	auto *slot = local_slot();
+	auto j = job{};
+
+	while (not stop.stop_requested())
+	{
+		auto found = find_job(slot, j);
+		for (auto spin = 0u; not found and spin < idle_spins; spin++)
+		{
+			std::this_thread::yield();
+			found = find_job(slot, j);
+		}
+
+		if (found)
+		{
+			execute(j);
+			continue;
+		}
+
+		auto epoch = work_epoch.load();
+		sleeping.fetch_add(1);
+		if (not (found = find_job(slot, j)) and not stop.stop_requested())
+		{
+			work_epoch.wait(epoch);
+		}
+		sleeping.fetch_sub(1);
+
+		if (found)
+		{
+			execute(j);
+		}
+	}
+}
+
+namespace
+{
+	auto pool_desc = job_system::desc{};
+	auto pool_started = std::atomic<bool>{};
+}
+
+void os::init_job_pool(const job_system::desc &description)
+{
+	assert(not pool_started and "the job pool has started, configure it before first use");
+	pool_desc = description;
+}
+
+auto os::job_pool() -> job_system &
+{
+	static auto pool = []()
+	{
+		pool_started = true;
+		return job_system(pool_desc);
+	}();
+	return pool;
+}
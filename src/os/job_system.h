@@ -0,0 +1,153 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace os
+{
+	// Number of jobs still to finish, wait() on it helps run jobs until it reaches zero
+	class job_counter
+	{
+	public:
+		job_counter() = default;
+		~job_counter() = default;
+
+		job_counter(const job_counter &) = delete;
+		auto operator=(const job_counter &) -> job_counter & = delete;
+
+		auto done() const -> bool
+		{
+			return pending.load(std::memory_order_acquire) == 0;
+		}
+
+	private:
+		friend class job_system;
+
+		std::atomic<uint32_t> pending{};
+	};
+
+	// Work stealing thread pool.
+	// Every thread that spawns jobs gets its own Chase-Lev deque and job ring,
+	// the owner pushes and pops at the bottom while idle threads steal from
+	// the top. Spawning never allocates or locks, so it is safe to use from
+	// inside a simulation step. Threads waiting on a counter run jobs too.
+	class job_system
+	{
+	public:
+		struct desc
+		{
+			uint32_t worker_count = 0;    // 0 uses one per hardware thread, less the caller's
+			bool pin_threads = false;     // worker i stays on core i + 1, leaving core 0 to the main thread
+		};
+
+		static constexpr auto max_threads = 64u;
+		static constexpr auto payload_size = 48u;
+
+	public:
+		job_system() = delete;
+		explicit job_system(const desc &description);
+		~job_system();
+
+		job_system(const job_system &) = delete;
+		auto operator=(const job_system &) -> job_system & = delete;
+
+		// Runs fn() on any thread, fn is copied into the job so it must be small and trivially copyable
+		template <typename Fn>
+		void submit(const Fn &fn, job_counter &counter)
+		{
+			static_assert(sizeof(Fn) <= payload_size, "capture pointers or references, not values");
+			static_assert(std::is_trivially_copyable_v<Fn>);
+
+			auto &j = allocate_job(counter);
+			j.function = [](const job &self)
+			{
+				(*reinterpret_cast<const Fn *>(self.payload.data()))();
+			};
+			std::memcpy(j.payload.data(), &fn, sizeof(Fn));
+			push(j);
+		}
+
+		void wait(job_counter &counter);
+
+		// Runs one queued job on the calling thread, false if there was none
+		auto help() -> bool;
+
+		// Calls fn(i) for every i in [begin, end) and returns when all are done.
+		// Ranges are split in halves down to grain, thieves take the largest
+		// halves first. grain 0 picks one from the range and the pool size.
+		template <typename Fn>
+		void parallel_for(uint32_t begin, uint32_t end, const Fn &fn, uint32_t grain = 0)
+		{
+			run_range(begin, end, grain, [](const void *context, uint32_t first, uint32_t last)
+			{
+				auto &f = *static_cast<const Fn *>(context);
+				for (auto i = first; i < last; i++)
+				{
+					f(i);
+				}
+			}, &fn);
+		}
+
+		// Workers plus the calling thread
+		auto thread_count() const -> uint32_t;
+
+	private:
+		struct alignas(64) job
+		{
+			void (*function)(const job &);
+			job_counter *counter;
+			alignas(16) std::array<std::byte, payload_size> payload;
+		};
+
+		using range_function = void (*)(const void *context, uint32_t begin, uint32_t end);
+
+		struct worker_slot;
+		struct range_task;
+
+		// Run inline by threads without a free ring entry
+		static thread_local job overflow_job;
+
+		auto allocate_job(job_counter &counter) -> job &;
+		void push(job &j);
+		void run_range(uint32_t begin, uint32_t end, uint32_t grain, range_function fn, const void *context);
+		void split(range_task task, job_counter &counter);
+
+		auto local_slot() -> worker_slot *;
+		auto register_slot(std::thread::id owner) -> worker_slot *;
+		auto find_job(worker_slot *slot, job &out) -> bool;
+		void execute(const job &j);
+		void worker_main(std::stop_token stop, uint32_t index);
+
+	private:
+		std::array<std::unique_ptr<worker_slot>, max_threads> slots{};
+		std::atomic<uint32_t> slot_count{};
+		std::mutex slot_mutex{};
+
+		// Bumped on every push, idle workers sleep on it
+		std::atomic<uint32_t> work_epoch{};
+		std::atomic<uint32_t> sleeping{};
+
+		std::vector<std::jthread> workers{};
+
+		// Threads cache their slot by pool id, a new pool can reuse a destroyed one's address
+		uint64_t id{};
+	};
+
+	// Sets up the shared pool, call before anything uses it or it starts with desc{}
+	void init_job_pool(const job_system::desc &description);
+
+	// The one pool shared by the simulation, the renderer and tools, started on first use
+	auto job_pool() -> job_system &;
+
+	template <typename Fn>
+	void parallel_for(uint32_t begin, uint32_t end, const Fn &fn, uint32_t grain = 0)
+	{
+		job_pool().parallel_for(begin, end, fn, grain);
+	}
+}
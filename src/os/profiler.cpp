@@ -0,0 +1,247 @@
+#include "profiler.h"
+
+#include <iomanip>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define PROFILER_USE_TSC
+#endif
+
+using namespace os;
+using hrc = std::chrono::high_resolution_clock;
+
+namespace
+{
+	constexpr auto events_per_thread = 1u << 16;
+
+	// Raw counter, a clock read costs more than the zone budget on most machines
+	auto timestamp() -> uint64_t
+	{
+#ifdef PROFILER_USE_TSC
+		return __rdtsc();
+#else
+		return static_cast<uint64_t>(hrc::now().time_since_epoch().count());
+#endif
+	}
+
+	struct zone_event
+	{
+		const char *name;
+		uint64_t start;
+		uint64_t end;
+		uint32_t depth;
+	};
+
+	// Only the owning thread writes, written is published with release so readers see whole events.
+	// A clear bumps the registry's epoch and the owner resets its own ring when it next records.
+	struct thread_events
+	{
+		uint32_t thread_index{};
+		const char *thread_name{};
+		uint32_t depth{};
+		std::atomic<uint32_t> epoch{};
+		std::atomic<uint64_t> written{};
+		std::unique_ptr<zone_event[]> events = std::make_unique<zone_event[]>(events_per_thread);
+	};
+
+	struct profile_registry
+	{
+		// Timestamps are converted to time on export, against the clock at start up
+		const hrc::time_point epoch = hrc::now();
+		const uint64_t epoch_ticks = timestamp();
+
+		// Buffers live until exit, so exported names and events stay valid after a thread ends
+		std::mutex mutex{};
+		std::vector<std::unique_ptr<thread_events>> threads{};
+
+		// Only changes under the mutex, threads whose epoch is behind count as empty
+		std::atomic<uint32_t> clear_epoch{};
+	};
+
+	auto registry() -> profile_registry &
+	{
+		static auto reg = profile_registry{};
+		return reg;
+	}
+
+	auto local_events() -> thread_events &
+	{
+		thread_local auto *events = []()
+		{
+			auto &reg = registry();
+			auto lock = std::lock_guard{reg.mutex};
+
+			auto &entry = reg.threads.emplace_back(std::make_unique<thread_events>());
+			entry->thread_index = static_cast<uint32_t>(reg.threads.size() - 1);
+			entry->epoch.store(reg.clear_epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			return entry.get();
+		}();
+		return *events;
+	}
+
+	// Whether a thread has applied the last clear, call with the registry locked
+	auto is_current(const profile_registry &reg, const thread_events &thread) -> bool
+	{
+		return thread.epoch.load(std::memory_order_acquire) == reg.clear_epoch.load(std::memory_order_relaxed);
+	}
+
+	// JSON string escape for the few characters zone names could contain
+	void write_escaped(std::ostream &out, const char *text)
+	{
+		for (; *text; text++)
+		{
+			if (*text == '"' or *text == '\\')
+			{
+				out << '\\';
+			}
+			out << *text;
+		}
+	}
+}
+
+profile_zone::profile_zone(const char *zone_name) noexcept :
+	name{zone_name}
+{
+	local_events().depth++;
+	start = timestamp();
+}
+
+profile_zone::~profile_zone()
+{
+	auto end = timestamp();
+	auto &local = local_events();
+	local.depth--;
+
+	auto n = local.written.load(std::memory_order_relaxed);
+	auto epoch = registry().clear_epoch.load(std::memory_order_relaxed);
+	if (epoch != local.epoch.load(std::memory_order_relaxed))
+	{
+		n = 0;
+		local.written.store(0, std::memory_order_relaxed);
+		local.epoch.store(epoch, std::memory_order_release);
+	}
+
+	// Keeps the event from landing before the last publish, an exporter uses written to spot overwrites
+	std::atomic_thread_fence(std::memory_order_release);
+	local.events[n & (events_per_thread - 1)] = zone_event
+	{
+		.name = name,
+		.start = start,
+		.end = end,
+		.depth = local.depth,
+	};
+	local.written.store(n + 1, std::memory_order_release);
+}
+
+void os::set_profile_thread_name(const char *name)
+{
+	local_events().thread_name = name;
+}
+
+auto os::get_profile_stats() -> profile_stats
+{
+	auto &reg = registry();
+	auto lock = std::lock_guard{reg.mutex};
+
+	auto stats = profile_stats{.thread_count = static_cast<uint32_t>(reg.threads.size())};
+	for (auto &thread : reg.threads)
+	{
+		if (is_current(reg, *thread))
+		{
+			stats.zone_count += thread->written.load(std::memory_order_acquire);
+		}
+	}
+	return stats;
+}
+
+void os::clear_profile()
+{
+	auto &reg = registry();
+	auto lock = std::lock_guard{reg.mutex};
+
+	// Recording threads own their rings, each resets its own on its next zone
+	reg.clear_epoch.fetch_add(1, std::memory_order_relaxed);
+}
+
+auto os::write_chrome_trace(const std::filesystem::path &file_path) -> bool
+{
+	auto file = std::ofstream(file_path);
+	if (not file)
+	{
+		return false;
+	}
+
+	auto &reg = registry();
+	auto lock = std::lock_guard{reg.mutex};
+
+	// Ticks per microsecond, measured over the whole run so far
+	auto elapsed_us = std::chrono::duration<double, std::micro>(hrc::now() - reg.epoch).count();
+	auto elapsed_ticks = static_cast<double>(timestamp() - reg.epoch_ticks);
+	auto us_per_tick = elapsed_ticks > 0.0 ? elapsed_us / elapsed_ticks : 0.0;
+	auto to_us = [&](uint64_t ticks)
+	{
+		return static_cast<double>(static_cast<int64_t>(ticks - reg.epoch_ticks)) * us_per_tick;
+	};
+
+	file << std::fixed << std::setprecision(3);
+	file << "{\"traceEvents\":[\n";
+	auto first = true;
+	auto separator = [&]()
+	{
+		file << (first ? "" : ",\n");
+		first = false;
+	};
+
+	auto events = std::vector<zone_event>{};
+
+	for (auto &thread : reg.threads)
+	{
+		if (thread->thread_name)
+		{
+			separator();
+			file << R"({"name":"thread_name","ph":"M","pid":0,"tid":)" << thread->thread_index
+				 << R"(,"args":{"name":")";
+			write_escaped(file, thread->thread_name);
+			file << "\"}}";
+		}
+
+		if (not is_current(reg, *thread))
+		{
+			continue;
+		}
+
+		// Copy the ring out, the owner may still be recording over its oldest events
+		auto written = thread->written.load(std::memory_order_acquire);
+		auto begin = written > events_per_thread ? written - events_per_thread : 0;
+		events.clear();
+		for (auto n = begin; n < written; n++)
+		{
+			events.push_back(thread->events[n & (events_per_thread - 1)]);
+		}
+
+		// Event n is overwritten by event n + events_per_thread, drop any the owner
+		// reached while copying before a torn name gets dereferenced
+		std::atomic_thread_fence(std::memory_order_acquire);
+		auto rewritten = thread->written.load(std::memory_order_relaxed);
+		auto valid = rewritten >= events_per_thread ? rewritten - events_per_thread + 1 : 0;
+		auto skip = std::min(std::max(valid, begin) - begin, written - begin);
+
+		for (auto &e : std::span(events).subspan(skip))
+		{
+			separator();
+			file << R"({"name":")";
+			write_escaped(file, e.name);
+			file << R"(","ph":"X","pid":0,"tid":)" << thread->thread_index
+				 << R"(,"ts":)" << to_us(e.start)
+				 << R"(,"dur":)" << static_cast<double>(e.end - e.start) * us_per_tick
+				 << R"(,"args":{"depth":)" << e.depth << "}}";
+		}
+	}
+
+	file << "\n],\"displayTimeUnit\":\"ns\"}\n";
+	return static_cast<bool>(file);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+
+namespace os
+{
+	// Records one zone per scope into the calling thread's own ring buffer.
+	// Recording never locks, only a thread's first zone registers its buffer.
+	class profile_zone
+	{
+	public:
+		profile_zone() = delete;
+		explicit profile_zone(const char *zone_name) noexcept;
+		~profile_zone();
+
+		profile_zone(const profile_zone &) = delete;
+		auto operator=(const profile_zone &) -> profile_zone & = delete;
+
+	private:
+		const char *name;
+		uint64_t start;
+	};
+
+	struct profile_stats
+	{
+		uint32_t thread_count;
+		uint64_t zone_count;     // recorded since the last clear, including overwritten ones
+	};
+
+	// Names must outlive the profiler, string literals in practice
+	void set_profile_thread_name(const char *name);
+
+	auto get_profile_stats() -> profile_stats;
+	void clear_profile();
+
+	// Chrome trace event JSON, opens in Perfetto or chrome://tracing
+	auto write_chrome_trace(const std::filesystem::path &file_path) -> bool;
+}
+
+#ifdef PROFILER_ENABLED
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+#define PROFILE_ZONE(name) const auto PROFILE_CONCAT(profile_zone_, __LINE__) = os::profile_zone{name}
+#define PROFILE_FUNCTION() PROFILE_ZONE(__func__)
+#define PROFILE_THREAD(name) os::set_profile_thread_name(name)
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_FUNCTION() ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#endif
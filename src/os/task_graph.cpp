@@ -0,0 +1,305 @@
+#include "task_graph.h"
+
+#include "profiler.h"
+
+using namespace os;
+
+namespace
+{
+	auto touches(const std::vector<std::string_view> &names, std::string_view resource) -> bool
+	{
+		return std::find(std::begin(names), std::end(names), resource) != std::end(names);
+	}
+
+	// Order matters when either side writes something the other reads or writes
+	auto conflicts(const task_graph::desc &a, const task_graph::desc &b) -> bool
+	{
+		for (auto w : a.writes)
+		{
+			if (touches(b.reads, w) or touches(b.writes, w))
+			{
+				return true;
+			}
+		}
+
+		for (auto w : b.writes)
+		{
+			if (touches(a.reads, w))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+struct task_graph::node
+{
+	uint32_t stage{};
+	bool on_main{};
+
+	std::vector<uint32_t> successors{};         // same frame
+	std::vector<uint32_t> next_successors{};    // next frame
+	uint32_t predecessor_count{};
+	uint32_t previous_count{};
+
+	// Predecessors left per frame slot, plus one until the frame is opened
+	std::array<std::atomic<uint32_t>, frame_slots> pending{};
+};
+
+task_graph::task_graph(job_system &jobs_) :
+	jobs{jobs_}
+{ }
+
+task_graph::~task_graph()
+{
+	wait_idle();
+}
+
+auto task_graph::add_stage(const desc &stage, task_fn fn) -> uint32_t
+{
+	// Workers look stages up while they run
+	wait_idle();
+
+	stages.push_back({stage, std::move(fn), true});
+	dirty = true;
+	return static_cast<uint32_t>(stages.size() - 1);
+}
+
+void task_graph::set_enabled(uint32_t stage, bool enabled)
+{
+	if (stages[stage].enabled != enabled)
+	{
+		wait_idle();
+		stages[stage].enabled = enabled;
+		dirty = true;
+	}
+}
+
+void task_graph::run_frame()
+{
+	// Only rebuild when nothing of this frame has started early on the old graph
+	if (dirty and opened == frame)
+	{
+		rebuild();
+	}
+
+	auto current = frame;
+
+	// Its slot is about to be reused for the frame after next
+	if (current > first_frame)
+	{
+		wait_frame(current - 1);
+	}
+	reset_frame(current + 2);
+
+	// Hold back the next frame while a rebuild is pending, so it starts on the new graph
+	auto last_open = dirty ? current : current + 1;
+	while (opened <= last_open)
+	{
+		open_frame(opened++);
+	}
+
+	auto slot = current % frame_slots;
+	while (main_outstanding[slot] > 0)
+	{
+		auto n = uint32_t{};
+		auto ready = false;
+		{
+			// Ready main stages run in the order they were added
+			auto lock = std::lock_guard{main_mutex};
+			auto &queue = main_ready[slot];
+			if (not queue.empty())
+			{
+				auto first = std::min_element(std::begin(queue), std::end(queue));
+				n = *first;
+				queue.erase(first);
+				ready = true;
+			}
+		}
+
+		if (ready)
+		{
+			run_node(n, current);
+		}
+		else if (not jobs.help())
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	frame++;
+}
+
+void task_graph::wait_idle()
+{
+	jobs.wait(in_flight);
+}
+
+auto task_graph::frame_count() const -> uint64_t
+{
+	return frame;
+}
+
+auto task_graph::rebuild_count() const -> uint32_t
+{
+	return rebuilds;
+}
+
+void task_graph::rebuild()
+{
+	wait_idle();
+
+	auto active = std::vector<uint32_t>{};
+	for (auto i = 0u; i < stages.size(); i++)
+	{
+		if (stages[i].enabled)
+		{
+			active.push_back(i);
+		}
+	}
+
+	node_count = static_cast<uint32_t>(active.size());
+	nodes = std::make_unique<node[]>(node_count);
+	main_node_count = 0;
+
+	for (auto a = 0u; a < node_count; a++)
+	{
+		auto &na = nodes[a];
+		na.stage = active[a];
+		na.on_main = stages[na.stage].info.thread == task_thread::main;
+		main_node_count += na.on_main ? 1 : 0;
+	}
+
+	for (auto a = 0u; a < node_count; a++)
+	{
+		auto &da = stages[nodes[a].stage].info;
+		for (auto b = 0u; b < node_count; b++)
+		{
+			auto &db = stages[nodes[b].stage].info;
+			auto conflict = conflicts(da, db);
+
+			// Within a frame the earlier stage goes first
+			if (a < b and conflict)
+			{
+				nodes[a].successors.push_back(b);
+				nodes[b].predecessor_count++;
+			}
+
+			// Across frames every conflict waits, and a stage never overlaps itself
+			if (a == b or conflict)
+			{
+				nodes[a].next_successors.push_back(b);
+				nodes[b].previous_count++;
+			}
+		}
+	}
+
+	for (auto &ready : main_ready)
+	{
+		ready.clear();
+		ready.reserve(main_node_count);
+	}
+
+	first_frame = frame;
+	opened = frame;
+	reset_frame(frame);
+	reset_frame(frame + 1);
+
+	dirty = false;
+	rebuilds++;
+}
+
+void task_graph::reset_frame(uint64_t frame_index)
+{
+	auto slot = frame_index % frame_slots;
+	auto has_previous = frame_index > first_frame;
+
+	for (auto n = 0u; n < node_count; n++)
+	{
+		auto &nd = nodes[n];
+		nd.pending[slot].store(nd.predecessor_count + (has_previous ? nd.previous_count : 0) + 1,
+		                       std::memory_order_relaxed);
+	}
+
+	outstanding[slot].store(node_count, std::memory_order_release);
+	main_outstanding[slot] = main_node_count;
+
+	auto lock = std::lock_guard{main_mutex};
+	main_ready[slot].clear();
+}
+
+void task_graph::open_frame(uint64_t frame_index)
+{
+	auto slot = frame_index % frame_slots;
+	for (auto n = 0u; n < node_count; n++)
+	{
+		if (nodes[n].pending[slot].fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			launch(n, frame_index);
+		}
+	}
+}
+
+void task_graph::launch(uint32_t n, uint64_t frame_index)
+{
+	if (nodes[n].on_main)
+	{
+		auto lock = std::lock_guard{main_mutex};
+		main_ready[frame_index % frame_slots].push_back(n);
+		return;
+	}
+
+	jobs.submit([this, n, frame_index]()
+	{
+		run_node(n, frame_index);
+	}, in_flight);
+}
+
+void task_graph::run_node(uint32_t n, uint64_t frame_index)
+{
+	auto &nd = nodes[n];
+	auto &st = stages[nd.stage];
+	{
+		PROFILE_ZONE(st.info.name);
+		st.function();
+	}
+
+	auto slot = frame_index % frame_slots;
+	auto next_slot = (frame_index + 1) % frame_slots;
+
+	for (auto s : nd.successors)
+	{
+		if (nodes[s].pending[slot].fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			launch(s, frame_index);
+		}
+	}
+
+	for (auto s : nd.next_successors)
+	{
+		if (nodes[s].pending[next_slot].fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			launch(s, frame_index + 1);
+		}
+	}
+
+	// Only the main thread runs main stages, so only it counts them
+	if (nd.on_main)
+	{
+		main_outstanding[slot]--;
+	}
+	outstanding[slot].fetch_sub(1, std::memory_order_release);
+}
+
+void task_graph::wait_frame(uint64_t frame_index)
+{
+	auto slot = frame_index % frame_slots;
+	while (outstanding[slot].load(std::memory_order_acquire) > 0)
+	{
+		if (not jobs.help())
+		{
+			std::this_thread::yield();
+		}
+	}
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "job_system.h"
+
+#include <functional>
+#include <string_view>
+#include <vector>
+
+namespace os
+{
+	enum class task_thread
+	{
+		main,    // window, input, gui and device context work
+		any,     // free to run on a job worker
+	};
+
+	// Per frame stage scheduler.
+	// Stages name the data they read and write. Two stages that touch the same
+	// data with at least one writer run in the order they were added, in the
+	// same frame and across frames, everything else is free to run at once.
+	// Worker stages of the next frame start as soon as the stages they
+	// conflict with are done, so they overlap the tail of the current frame.
+	class task_graph
+	{
+	public:
+		using task_fn = std::function<void()>;
+
+		struct desc
+		{
+			const char *name;
+			std::vector<std::string_view> reads{};
+			std::vector<std::string_view> writes{};
+			task_thread thread = task_thread::any;
+		};
+
+	public:
+		task_graph() = delete;
+		explicit task_graph(job_system &jobs);
+		~task_graph();
+
+		task_graph(const task_graph &) = delete;
+		auto operator=(const task_graph &) -> task_graph & = delete;
+
+		// Changes take effect at the next frame that has nothing started early
+		auto add_stage(const desc &stage, task_fn fn) -> uint32_t;
+		void set_enabled(uint32_t stage, bool enabled);
+
+		// Call from the main thread. Returns when this frame's main thread
+		// stages are done, its worker stages may still be running.
+		void run_frame();
+
+		// Waits for worker stages still in flight
+		void wait_idle();
+
+		auto frame_count() const -> uint64_t;
+		auto rebuild_count() const -> uint32_t;
+
+	private:
+		struct stage_entry
+		{
+			desc info;
+			task_fn function;
+			bool enabled;
+		};
+
+		struct node;
+
+		void rebuild();
+		void reset_frame(uint64_t frame_index);
+		void open_frame(uint64_t frame_index);
+		void launch(uint32_t n, uint64_t frame_index);
+		void run_node(uint32_t n, uint64_t frame_index);
+		void wait_frame(uint64_t frame_index);
+
+	private:
+		job_system &jobs;
+
+		std::vector<stage_entry> stages{};
+		bool dirty{true};
+		uint32_t rebuilds{};
+
+		std::unique_ptr<node[]> nodes{};
+		uint32_t node_count{};
+		uint32_t main_node_count{};
+
+		// Three frames can be live, the one finishing, the one running and the one starting early
+		static constexpr auto frame_slots = 3u;
+		std::array<std::atomic<uint32_t>, frame_slots> outstanding{};
+		std::array<uint32_t, frame_slots> main_outstanding{};
+		std::array<std::vector<uint32_t>, frame_slots> main_ready{};
+		std::mutex main_mutex{};
+
+		uint64_t frame{};
+		uint64_t first_frame{};    // of the current build, it has no previous frame to wait on
+		uint64_t opened{};         // frames below this may start
+
+		job_counter in_flight{};
+	};
+}
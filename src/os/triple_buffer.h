@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+
+namespace os
+{
+	// Single producer, single consumer handoff that never blocks either side.
+	// Writer fills back() and publishes it, reader picks up the latest
+	// published buffer with update(). Frames the reader misses are dropped.
+	template <typename T>
+	class triple_buffer
+	{
+	public:
+		triple_buffer() = default;
+		~triple_buffer() = default;
+
+		triple_buffer(const triple_buffer &) = delete;
+		auto operator=(const triple_buffer &) -> triple_buffer & = delete;
+
+		// Writer side
+		auto back() -> T &
+		{
+			return buffers[back_index];
+		}
+
+		void publish()
+		{
+			auto previous = middle.exchange(back_index | dirty_bit, std::memory_order_acq_rel);
+			back_index = previous & index_mask;
+		}
+
+		// Reader side, returns true if front() changed
+		auto update() -> bool
+		{
+			if ((middle.load(std::memory_order_relaxed) & dirty_bit) == 0)
+			{
+				return false;
+			}
+
+			auto previous = middle.exchange(front_index, std::memory_order_acq_rel);
+			front_index = previous & index_mask;
+			return true;
+		}
+
+		auto front() const -> const T &
+		{
+			return buffers[front_index];
+		}
+
+	private:
+		static constexpr auto dirty_bit = uint8_t{0b100};
+		static constexpr auto index_mask = uint8_t{0b011};
+
+		std::array<T, 3> buffers{};
+
+		// Keep each side's state on its own cache line
+		alignas(64) uint8_t back_index{0};
+		alignas(64) std::atomic<uint8_t> middle{1};
+		alignas(64) uint8_t front_index{2};
+	};
+}
@@ -5,20 +5,7 @@
 
 #include <d3d11_4.h>
 #include <dxgi1_6.h>
-#include <DirectXMath.h>
 #include <atlbase.h>
 
-#include <string_view>
-#include <functional>
-#include <numeric>
-#include <memory>
-#include <utility>
-#include <array>
-#include <vector>
-#include <unordered_map>
-#include <cstdint>
-#include <cassert>
-#include <filesystem>
-#include <iostream>
-#include <fstream>
-#include <ratio>
\ No newline at end of file
+// What the headless code needs, the tests precompile only this
+#include "pch_headless.h"
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <DirectXMath.h>
+
+#include <string_view>
+#include <functional>
+#include <numeric>
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <array>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <span>
+#include <bit>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cassert>
+#include <filesystem>
+#include <iostream>
+#include <fstream>
+#include <ratio>
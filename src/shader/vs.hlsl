@@ -8,15 +8,16 @@ cbuffer objectBuffer : register(b1)
 	matrix wrld;
 }
 
-cbuffer transformBuffer : register(b2)
-{
-	matrix transform;
-}
-
 struct VS_INPUT
 {
 	float4 pos : POSITION;
 	float4 col : COLOR;
+
+	// Per instance, from the instance buffer
+	float4 transform0 : TRANSFORM0;
+	float4 transform1 : TRANSFORM1;
+	float4 transform2 : TRANSFORM2;
+	float4 transform3 : TRANSFORM3;
 };
 
 struct VS_OUTPUT
@@ -31,7 +32,10 @@ VS_OUTPUT main(VS_INPUT input)
 
 	input.pos.w = 1.0f;
 
-	output.pos = mul(input.pos, transform);
+	// Rows arrive as stored, which is the transpose of how a cbuffer reads the same matrix
+	float4x4 transform = float4x4(input.transform0, input.transform1, input.transform2, input.transform3);
+
+	output.pos = mul(transform, input.pos);
 	output.pos = mul(output.pos, wrld);
 	output.pos = mul(output.pos, viewProj);
 	output.col = input.col;
@@ -0,0 +1,296 @@
+#include "body_registry.h"
+
+#include "../os/job_system.h"
+
+using namespace sim;
+using namespace DirectX;
+
+namespace
+{
+    // Move the last element into the hole and drop the tail
+    template <typename T>
+    void swap_and_pop(std::vector<T> &v, uint32_t index)
+    {
+        v[index] = v.back();
+        v.pop_back();
+    }
+
+    // out[i] = v[order[i]]
+    template <typename T>
+    void gather(const std::vector<T> &v, std::vector<T> &out, std::span<const uint32_t> order)
+    {
+        out.resize(v.size());
+        os::parallel_for(0, static_cast<uint32_t>(v.size()), [&](uint32_t i)
+        {
+            out[i] = v[order[i]];
+        });
+    }
+}
+
+body_registry::body_registry() = default;
+
+body_registry::~body_registry() = default;
+
+auto body_registry::add(const rigid_body &body) -> body_handle
+{
+    auto index = size();
+
+    auto s = free_slot;
+    if (s == invalid_index)
+    {
+        s = static_cast<uint32_t>(slots.size());
+        slots.push_back({.index = index, .generation = 0});
+    }
+    else
+    {
+        free_slot = slots[s].index;
+        slots[s].index = index;
+    }
+
+    dense_slots.push_back(s);
+    positions.push_back(body.position);
+    velocities.push_back(body.velocity);
+    orientations.push_back(body.orientation);
+    angular_velocities.push_back(body.angular_velocity);
+    masses.push_back(body.mass);
+    bounding_boxes.push_back(body.bounding_box);
+    previous_positions.push_back(body.position);
+    previous_orientations.push_back(body.orientation);
+    importances.push_back(body.importance);
+    lod_tiers.push_back(0);
+    lod_pending.push_back(0.0f);
+    collision_layers.push_back(body.collision_layer);
+    collision_masks.push_back(body.collision_mask);
+    triggers.push_back(body.trigger ? 1 : 0);
+
+    // Reorder staging grows with the store, so reordering never allocates
+    std::apply([&](auto &...copies)
+    {
+        (copies.resize(size()), ...);
+    }, staged);
+
+    return {.slot = s, .generation = slots[s].generation};
+}
+
+auto body_registry::remove(body_handle handle) -> bool
+{
+    auto index = index_of(handle);
+    if (index == invalid_index)
+    {
+        return false;
+    }
+
+    // Last body takes over the hole, point its slot at the new index
+    auto last_slot = dense_slots.back();
+    slots[last_slot].index = index;
+
+    swap_and_pop(dense_slots, index);
+    swap_and_pop(positions, index);
+    swap_and_pop(velocities, index);
+    swap_and_pop(orientations, index);
+    swap_and_pop(angular_velocities, index);
+    swap_and_pop(masses, index);
+    swap_and_pop(bounding_boxes, index);
+    swap_and_pop(previous_positions, index);
+    swap_and_pop(previous_orientations, index);
+    swap_and_pop(importances, index);
+    swap_and_pop(lod_tiers, index);
+    swap_and_pop(lod_pending, index);
+    swap_and_pop(collision_layers, index);
+    swap_and_pop(collision_masks, index);
+    swap_and_pop(triggers, index);
+
+    // Bump the generation so every outstanding handle to this slot goes stale
+    auto &s = slots[handle.slot];
+    s.generation++;
+    s.index = free_slot;
+    free_slot = handle.slot;
+
+    return true;
+}
+
+void body_registry::clear()
+{
+    for (auto s : dense_slots)
+    {
+        slots[s].generation++;
+        slots[s].index = free_slot;
+        free_slot = s;
+    }
+
+    dense_slots.clear();
+    positions.clear();
+    velocities.clear();
+    orientations.clear();
+    angular_velocities.clear();
+    masses.clear();
+    bounding_boxes.clear();
+    previous_positions.clear();
+    previous_orientations.clear();
+    importances.clear();
+    lod_tiers.clear();
+    lod_pending.clear();
+    collision_layers.clear();
+    collision_masks.clear();
+    triggers.clear();
+}
+
+void body_registry::reserve(uint32_t count)
+{
+    slots.reserve(count);
+    dense_slots.reserve(count);
+    positions.reserve(count);
+    velocities.reserve(count);
+    orientations.reserve(count);
+    angular_velocities.reserve(count);
+    masses.reserve(count);
+    bounding_boxes.reserve(count);
+    previous_positions.reserve(count);
+    previous_orientations.reserve(count);
+    importances.reserve(count);
+    lod_tiers.reserve(count);
+    lod_pending.reserve(count);
+    collision_layers.reserve(count);
+    collision_masks.reserve(count);
+    triggers.reserve(count);
+
+    std::apply([&](auto &...copies)
+    {
+        (copies.reserve(count), ...);
+    }, staged);
+}
+
+auto body_registry::is_valid(body_handle handle) const -> bool
+{
+    return index_of(handle) != invalid_index;
+}
+
+auto body_registry::index_of(body_handle handle) const -> uint32_t
+{
+    if (handle.slot >= slots.size() or slots[handle.slot].generation != handle.generation)
+    {
+        return invalid_index;
+    }
+
+    // A free slot keeps its generation until reused, so check it still maps back
+    auto index = slots[handle.slot].index;
+    if (index >= size() or dense_slots[index] != handle.slot)
+    {
+        return invalid_index;
+    }
+    return index;
+}
+
+auto body_registry::handle_of(uint32_t index) const -> body_handle
+{
+    auto s = dense_slots[index];
+    return {.slot = s, .generation = slots[s].generation};
+}
+
+auto body_registry::size() const -> uint32_t
+{
+    return static_cast<uint32_t>(dense_slots.size());
+}
+
+auto body_registry::get(body_handle handle) const -> rigid_body
+{
+    auto index = index_of(handle);
+    assert(index != invalid_index);
+    return body(index);
+}
+
+void body_registry::set(body_handle handle, const rigid_body &body)
+{
+    auto index = index_of(handle);
+    assert(index != invalid_index);
+    store(index, body);
+}
+
+auto body_registry::body(uint32_t index) const -> rigid_body
+{
+    return rigid_body
+    {
+        .position = positions[index],
+        .velocity = velocities[index],
+        .bounding_box = bounding_boxes[index],
+        .mass = masses[index],
+        .orientation = orientations[index],
+        .angular_velocity = angular_velocities[index],
+        .importance = importances[index],
+        .collision_layer = collision_layers[index],
+        .collision_mask = collision_masks[index],
+        .trigger = triggers[index] != 0,
+    };
+}
+
+void body_registry::store(uint32_t index, const rigid_body &body)
+{
+    positions[index] = body.position;
+    velocities[index] = body.velocity;
+    bounding_boxes[index] = body.bounding_box;
+    masses[index] = body.mass;
+    orientations[index] = body.orientation;
+    angular_velocities[index] = body.angular_velocity;
+    importances[index] = body.importance;
+    collision_layers[index] = body.collision_layer;
+    collision_masks[index] = body.collision_mask;
+    triggers[index] = body.trigger ? 1 : 0;
+
+    // Treat as a teleport, nothing to interpolate from or catch up on
+    previous_positions[index] = body.position;
+    previous_orientations[index] = body.orientation;
+    lod_pending[index] = 0.0f;
+}
+
+auto body_registry::reorder_arrays()
+{
+    // Arrays only add, remove and set write come first, then those a step writes too
+    return std::tie(dense_slots, masses, bounding_boxes, importances, collision_layers, collision_masks, triggers,
+                    positions, velocities, orientations, angular_velocities,
+                    previous_positions, previous_orientations, lod_tiers, lod_pending);
+}
+
+void body_registry::stage_reorder(uint32_t array, std::span<const uint32_t> order)
+{
+    assert(array < reorder_array_count and order.size() == size());
+
+    auto live = reorder_arrays();
+    static_assert(std::tuple_size_v<decltype(live)> == reorder_array_count);
+
+    [&]<std::size_t... I>(std::index_sequence<I...>)
+    {
+        ((array == I ? gather(std::get<I>(live), std::get<I>(staged), order) : void()), ...);
+    }(std::make_index_sequence<reorder_array_count>{});
+}
+
+void body_registry::commit_reorder()
+{
+    // Swapping keeps the old arrays' memory for the next reorder to stage into
+    auto live = reorder_arrays();
+    [&]<std::size_t... I>(std::index_sequence<I...>)
+    {
+        assert(((std::get<I>(staged).size() == size()) and ...));
+        (std::swap(std::get<I>(live), std::get<I>(staged)), ...);
+    }(std::make_index_sequence<reorder_array_count>{});
+
+    for (auto i = 0u; i < size(); i++)
+    {
+        slots[dense_slots[i]].index = i;
+    }
+}
+
+void body_registry::translate(const XMFLOAT3 &offset)
+{
+    auto d = XMLoadFloat3(&offset);
+    os::parallel_for(0, size(), [&, d](uint32_t i)
+    {
+        XMStoreFloat3(&positions[i], XMLoadFloat3(&positions[i]) + d);
+        XMStoreFloat3(&previous_positions[i], XMLoadFloat3(&previous_positions[i]) + d);
+    });
+}
+
+void body_registry::save_previous_pose()
+{
+    previous_positions = positions;
+    previous_orientations = orientations;
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "sim_data.h"
+#include "frame_arena.h"
+
+#include <tuple>
+
+namespace sim
+{
+    // Stable reference to a registered body.
+    // Slots are reused after a remove, the generation tells a stale handle
+    // apart from whatever body lives in the slot now.
+    struct body_handle
+    {
+        uint32_t slot = std::numeric_limits<uint32_t>::max();
+        uint32_t generation = 0;
+
+        friend auto operator==(const body_handle &a, const body_handle &b) -> bool = default;
+    };
+
+    // Same key for (a, b) and (b, a). Each side packs a 24 bit slot with the
+    // low 8 bits of its generation, so a pair keyed before a slot was reused
+    // does not match the new body's pair.
+    inline auto pair_key(body_handle a, body_handle b) -> uint64_t
+    {
+        assert(a.slot < (1u << 24) and b.slot < (1u << 24));
+
+        auto side = [](body_handle h)
+        {
+            return static_cast<uint64_t>((h.slot << 8) | (h.generation & 0xff));
+        };
+        auto lo = a.slot < b.slot ? a : b;
+        auto hi = a.slot < b.slot ? b : a;
+        return (side(lo) << 32) | side(hi);
+    }
+
+    // Owns all rigid bodies as dense SoA arrays.
+    // Remove swaps the last body into the hole so the arrays stay packed,
+    // a sparse slot table maps each handle to its body's current dense index.
+    class body_registry
+    {
+    public:
+        static constexpr auto invalid_index = std::numeric_limits<uint32_t>::max();
+
+    public:
+        body_registry();
+        ~body_registry();
+
+        auto add(const rigid_body &body) -> body_handle;
+        auto remove(body_handle handle) -> bool;
+        void clear();
+        void reserve(uint32_t count);
+
+        auto is_valid(body_handle handle) const -> bool;
+        auto index_of(body_handle handle) const -> uint32_t;
+        auto handle_of(uint32_t index) const -> body_handle;
+        auto size() const -> uint32_t;
+
+        auto get(body_handle handle) const -> rigid_body;
+        void set(body_handle handle, const rigid_body &body);
+
+        auto body(uint32_t index) const -> rigid_body;
+        void store(uint32_t index, const rigid_body &body);
+
+        // Moves body order[i] to dense index i, handles keep resolving to the same bodies.
+        // Done in slices, stage_reorder gathers one array into a staging copy and
+        // commit_reorder swaps every copy in at once, so readers never see a mix.
+        // Arrays from first_step_written on are ones a simulation step writes to.
+        static constexpr auto reorder_array_count = 15u;
+        static constexpr auto first_step_written = 7u;
+        void stage_reorder(uint32_t array, std::span<const uint32_t> order);
+        void commit_reorder();
+
+        // Moves every body, current and previous pose, by offset
+        void translate(const DirectX::XMFLOAT3 &offset);
+
+        // Remember the current pose as the previous one, for interpolating between steps
+        void save_previous_pose();
+
+    public:
+        // Dense body data, index is only stable until the next remove or reorder
+        std::vector<DirectX::XMFLOAT3> positions{};
+        std::vector<DirectX::XMFLOAT3> velocities{};
+        std::vector<DirectX::XMFLOAT4> orientations{};
+        std::vector<DirectX::XMFLOAT3> angular_velocities{};
+        std::vector<float> masses{};
+        std::vector<std::array<DirectX::XMFLOAT3, 2>> bounding_boxes{};
+
+        // Pose at the start of the last step
+        std::vector<DirectX::XMFLOAT3> previous_positions{};
+        std::vector<DirectX::XMFLOAT4> previous_orientations{};
+
+        // Simulation LOD, tier t moves every 2^t steps and keeps the time it skipped
+        std::vector<float> importances{};
+        std::vector<uint8_t> lod_tiers{};
+        std::vector<float> lod_pending{};
+
+        // Collision filtering, see rigid_body
+        std::vector<uint32_t> collision_layers{};
+        std::vector<uint32_t> collision_masks{};
+        std::vector<uint8_t> triggers{};
+
+    private:
+        auto reorder_arrays();
+
+    private:
+        struct slot
+        {
+            uint32_t index;      // dense index while alive, next free slot once removed
+            uint32_t generation;
+        };
+
+        std::vector<slot> slots{};
+        std::vector<uint32_t> dense_slots{};
+        uint32_t free_slot{invalid_index};
+
+        // Reordered copies, in reorder_arrays() order
+        template <typename... T>
+        using staging = std::tuple<std::vector<T>...>;
+        staging<uint32_t, float, std::array<DirectX::XMFLOAT3, 2>, float, uint32_t, uint32_t, uint8_t,
+                DirectX::XMFLOAT3, DirectX::XMFLOAT3, DirectX::XMFLOAT4, DirectX::XMFLOAT3,
+                DirectX::XMFLOAT3, DirectX::XMFLOAT4, uint8_t, float> staged{};
+    };
+}
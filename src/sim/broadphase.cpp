@@ -0,0 +1,606 @@
+#include "broadphase.h"
+
+#include "simd.h"
+
+#include "../os/job_system.h"
+
+using namespace sim;
+using namespace sim::simd;
+using namespace DirectX;
+
+namespace
+{
+    constexpr auto leaf_size = 4u;
+    constexpr auto max_stack = 64u;
+    constexpr auto rays_per_task = 64u;
+    constexpr auto bodies_per_task = 64u;
+
+    // Keeps 1/d finite so slab tests never see 0 * inf
+    constexpr auto min_direction = 1e-20f;
+
+    auto component(const XMFLOAT3 &v, uint32_t axis) -> float
+    {
+        return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+    }
+
+    auto octant_of(const XMFLOAT3 &d) -> uint32_t
+    {
+        return (d.x < 0.0f ? 1u : 0u) | (d.y < 0.0f ? 2u : 0u) | (d.z < 0.0f ? 4u : 0u);
+    }
+
+    auto safe_direction(FXMVECTOR d) -> XMVECTOR
+    {
+        auto tiny = XMVectorLess(XMVectorAbs(d), XMVectorReplicate(min_direction));
+        auto signed_min = XMVectorSelect(XMVectorReplicate(min_direction), XMVectorReplicate(-min_direction),
+                                         XMVectorLess(d, XMVectorZero()));
+        return XMVectorSelect(d, signed_min, tiny);
+    }
+
+    auto merge(const aabb &a, const aabb &b) -> aabb
+    {
+        auto result = aabb{};
+        XMStoreFloat3(&result.min, XMVectorMin(XMLoadFloat3(&a.min), XMLoadFloat3(&b.min)));
+        XMStoreFloat3(&result.max, XMVectorMax(XMLoadFloat3(&a.max), XMLoadFloat3(&b.max)));
+        return result;
+    }
+
+    auto overlaps(const aabb &a, const aabb &b) -> bool
+    {
+        return a.min.x <= b.max.x and b.min.x <= a.max.x
+           and a.min.y <= b.max.y and b.min.y <= a.max.y
+           and a.min.z <= b.max.z and b.min.z <= a.max.z;
+    }
+
+    auto radius_of(const ray &) -> float
+    {
+        return 0.0f;
+    }
+
+    auto radius_of(const sphere_sweep &sweep) -> float
+    {
+        return sweep.radius;
+    }
+}
+
+auto sim::world_bounds(const XMFLOAT3 &position,
+                       const XMFLOAT4 &orientation,
+                       const std::array<XMFLOAT3, 2> &bounding_box) -> aabb
+{
+    auto lo = XMLoadFloat3(&bounding_box[0]),
+         hi = XMLoadFloat3(&bounding_box[1]);
+    auto local_centre = (lo + hi) * 0.5f;
+    auto local_extent = (hi - lo) * 0.5f;
+
+    auto q = XMLoadFloat4(&orientation);
+    auto rot = XMMatrixRotationQuaternion(q);
+
+    // Extent of a rotated box is |R| applied to the local extent
+    auto extent = XMVectorAbs(rot.r[0]) * XMVectorSplatX(local_extent)
+                + XMVectorAbs(rot.r[1]) * XMVectorSplatY(local_extent)
+                + XMVectorAbs(rot.r[2]) * XMVectorSplatZ(local_extent);
+    auto centre = XMLoadFloat3(&position) + XMVector3Rotate(local_centre, q);
+
+    auto result = aabb{};
+    XMStoreFloat3(&result.min, centre - extent);
+    XMStoreFloat3(&result.max, centre + extent);
+    return result;
+}
+
+// Up to 4 rays traversing together, SoA across the vector lanes
+struct broadphase::packet
+{
+    XMVECTOR ox, oy, oz;
+    XMVECTOR ix, iy, iz;
+    XMVECTOR radius;
+    XMVECTOR t_max;
+    XMVECTOR active;
+
+    uint32_t lanes;
+    uint32_t octant;
+    std::array<XMFLOAT3, simd_width> origin;
+    std::array<XMFLOAT3, simd_width> direction;
+    std::array<ray_hit, simd_width> hits;
+};
+
+broadphase::broadphase() = default;
+
+broadphase::~broadphase() = default;
+
+broadphase::broadphase(broadphase &&) noexcept = default;
+auto broadphase::operator=(broadphase &&) noexcept -> broadphase & = default;
+
+void broadphase::build(const body_registry &bodies)
+{
+    begin_build(bodies);
+    while (build_slice(std::numeric_limits<uint32_t>::max()))
+    { }
+}
+
+void broadphase::begin_build(const body_registry &bodies)
+{
+    auto count = bodies.size();
+    load_boxes(bodies);
+
+    body_ids.resize(count);
+    std::iota(std::begin(body_ids), std::end(body_ids), 0u);
+
+    nodes.clear();
+    pending.clear();
+    if (count == 0)
+    {
+        return;
+    }
+
+    nodes.reserve(2 * (count / leaf_size + 1));
+    nodes.push_back({});
+    pending.push_back({.index = 0, .first = 0, .count = count});
+}
+
+auto broadphase::build_slice(uint32_t node_budget) -> bool
+{
+    for (auto n = 0u; n < node_budget and not pending.empty(); n++)
+    {
+        auto range = pending.back();
+        pending.pop_back();
+        build_node(range.index, range.first, range.count);
+    }
+    return not pending.empty();
+}
+
+void broadphase::refit(const body_registry &bodies)
+{
+    assert(bodies.size() == boxes.size() and pending.empty());
+
+    load_boxes(bodies);
+
+    // Children always come after their parent, so a backwards pass sees them first
+    for (auto i = static_cast<uint32_t>(nodes.size()); i-- > 0;)
+    {
+        auto &nd = nodes[i];
+        if (nd.count > 0)
+        {
+            auto first = body_ids[nd.first];
+            nd.bounds = boxes[first];
+            nd.layers = layers[first];
+            nd.masks = masks[first];
+            for (auto b = nd.first + 1; b < nd.first + nd.count; b++)
+            {
+                nd.bounds = merge(nd.bounds, boxes[body_ids[b]]);
+                nd.layers |= layers[body_ids[b]];
+                nd.masks |= masks[body_ids[b]];
+            }
+        }
+        else
+        {
+            auto &a = nodes[nd.first];
+            auto &b = nodes[nd.first + 1];
+            nd.bounds = merge(a.bounds, b.bounds);
+            nd.layers = a.layers | b.layers;
+            nd.masks = a.masks | b.masks;
+        }
+    }
+}
+
+void broadphase::reserve(uint32_t count)
+{
+    // Geometric, so growing a body at a time stays linear
+    auto grow = [](auto &v, std::size_t size)
+    {
+        if (v.capacity() < size)
+        {
+            v.reserve(std::max(size, 2 * v.capacity()));
+        }
+    };
+
+    grow(boxes, count);
+    grow(centres, count);
+    grow(layers, count);
+    grow(masks, count);
+    grow(body_ids, count);
+    grow(nodes, 2 * (count / leaf_size + 1));
+    grow(pending, max_stack);
+}
+
+auto broadphase::body_count() const -> uint32_t
+{
+    return static_cast<uint32_t>(boxes.size());
+}
+
+void broadphase::load_boxes(const body_registry &bodies)
+{
+    auto count = bodies.size();
+
+    boxes.resize(count);
+    centres.resize(count);
+    layers.assign(std::begin(bodies.collision_layers), std::end(bodies.collision_layers));
+    masks.assign(std::begin(bodies.collision_masks), std::end(bodies.collision_masks));
+    os::parallel_for(0, count, [&](uint32_t i)
+    {
+        boxes[i] = world_bounds(bodies.positions[i], bodies.orientations[i], bodies.bounding_boxes[i]);
+        XMStoreFloat3(&centres[i], (XMLoadFloat3(&boxes[i].min) + XMLoadFloat3(&boxes[i].max)) * 0.5f);
+    });
+}
+
+void broadphase::build_node(uint32_t index, uint32_t first, uint32_t count)
+{
+    auto bounds = boxes[body_ids[first]];
+    auto centre_lo = XMLoadFloat3(&centres[body_ids[first]]),
+         centre_hi = centre_lo;
+    auto node_layers = layers[body_ids[first]],
+         node_masks = masks[body_ids[first]];
+    for (auto i = first + 1; i < first + count; i++)
+    {
+        bounds = merge(bounds, boxes[body_ids[i]]);
+        node_layers |= layers[body_ids[i]];
+        node_masks |= masks[body_ids[i]];
+        auto c = XMLoadFloat3(&centres[body_ids[i]]);
+        centre_lo = XMVectorMin(centre_lo, c);
+        centre_hi = XMVectorMax(centre_hi, c);
+    }
+
+    if (count <= leaf_size)
+    {
+        nodes[index] = {.bounds = bounds, .first = first, .count = count, .axis = 0,
+                        .layers = node_layers, .masks = node_masks};
+        return;
+    }
+
+    // Median split along the widest spread of centres
+    auto spread = XMFLOAT3{};
+    XMStoreFloat3(&spread, centre_hi - centre_lo);
+    auto axis = spread.x > spread.y ? (spread.x > spread.z ? 0u : 2u)
+                                    : (spread.y > spread.z ? 1u : 2u);
+
+    auto begin = std::begin(body_ids) + first;
+    auto half = count / 2;
+    std::nth_element(begin, begin + half, begin + count, [&, axis](uint32_t a, uint32_t b)
+    {
+        return component(centres[a], axis) < component(centres[b], axis);
+    });
+
+    auto child = static_cast<uint32_t>(nodes.size());
+    nodes.push_back({});
+    nodes.push_back({});
+    nodes[index] = {.bounds = bounds, .first = child, .count = 0, .axis = axis,
+                    .layers = node_layers, .masks = node_masks};
+
+    // Depth first, so pending holds at most a node per level
+    pending.push_back({.index = child + 1, .first = first + half, .count = count - half});
+    pending.push_back({.index = child, .first = first, .count = half});
+}
+
+void broadphase::cast(const body_registry &bodies, std::span<const ray> rays, std::span<ray_hit> hits) const
+{
+    cast_batch(bodies, rays, hits);
+}
+
+void broadphase::cast(const body_registry &bodies, std::span<const sphere_sweep> sweeps, std::span<ray_hit> hits) const
+{
+    cast_batch(bodies, sweeps, hits);
+}
+
+auto broadphase::find_pairs(const body_registry &bodies, std::span<const uint64_t> excluded, frame_arena &arena) const
+    -> std::span<const body_pair>
+{
+    if (nodes.empty())
+    {
+        return {};
+    }
+
+    auto is_trigger = [&](uint32_t i)
+    {
+        return bodies.triggers[i] != 0;
+    };
+
+    return collect_pairs(static_cast<uint32_t>(boxes.size()), arena, [&](uint32_t i, auto &&emit)
+    {
+        if (is_trigger(i))
+        {
+            return;
+        }
+
+        for_each_overlap(i, i + 1, [&](uint32_t j)
+        {
+            if (not is_trigger(j)
+                and (excluded.empty()
+                     or not std::binary_search(std::begin(excluded), std::end(excluded),
+                                               pair_key(bodies.handle_of(i), bodies.handle_of(j)))))
+            {
+                emit(i, j);
+            }
+        });
+    });
+}
+
+auto broadphase::find_overlaps(std::span<const uint32_t> queries, frame_arena &arena) const -> std::span<const body_pair>
+{
+    if (nodes.empty())
+    {
+        return {};
+    }
+
+    return collect_pairs(static_cast<uint32_t>(queries.size()), arena, [&](uint32_t q, auto &&emit)
+    {
+        auto body = queries[q];
+        for_each_overlap(body, 0, [&](uint32_t other)
+        {
+            emit(body, other);
+        });
+    });
+}
+
+template <typename Visit>
+auto broadphase::collect_pairs(uint32_t count, frame_arena &arena, const Visit &visit) const -> std::span<const body_pair>
+{
+    // Count, then fill at each task's offset, so the output is in item order without locks
+    auto task_count = (count + bodies_per_task - 1) / bodies_per_task;
+    auto offsets = arena.allocate_array<uint32_t>(task_count + 1);
+    os::parallel_for(0, task_count, [&, count](uint32_t task)
+    {
+        auto found = 0u;
+        for (auto i = task * bodies_per_task; i < std::min((task + 1) * bodies_per_task, count); i++)
+        {
+            visit(i, [&](uint32_t, uint32_t)
+            {
+                found++;
+            });
+        }
+        offsets[task + 1] = found;
+    }, 1);
+
+    std::partial_sum(std::begin(offsets), std::end(offsets), std::begin(offsets));
+
+    auto pairs = arena.allocate_array<body_pair>(offsets[task_count]);
+    os::parallel_for(0, task_count, [&, count](uint32_t task)
+    {
+        auto next = offsets[task];
+        for (auto i = task * bodies_per_task; i < std::min((task + 1) * bodies_per_task, count); i++)
+        {
+            visit(i, [&](uint32_t a, uint32_t b)
+            {
+                pairs[next++] = {a, b};
+            });
+        }
+    }, 1);
+
+    return pairs;
+}
+
+template <typename Fn>
+void broadphase::for_each_overlap(uint32_t body, uint32_t first_other, const Fn &fn) const
+{
+    auto &box = boxes[body];
+    auto layer = layers[body],
+         mask = masks[body];
+
+    auto stack = std::array<uint32_t, max_stack>{};
+    auto top = 0u;
+    stack[top++] = 0;
+
+    while (top > 0)
+    {
+        auto &n = nodes[stack[--top]];
+
+        // Nothing below is on a layer this body takes, or takes this body's layer
+        if ((n.layers & mask) == 0 or (layer & n.masks) == 0 or not overlaps(n.bounds, box))
+        {
+            continue;
+        }
+
+        if (n.count == 0)
+        {
+            stack[top++] = n.first;
+            stack[top++] = n.first + 1;
+            continue;
+        }
+
+        for (auto k = n.first; k < n.first + n.count; k++)
+        {
+            auto other = body_ids[k];
+            if (other >= first_other and other != body
+                and (layers[other] & mask) != 0
+                and (layer & masks[other]) != 0
+                and overlaps(boxes[other], box))
+            {
+                fn(other);
+            }
+        }
+    }
+}
+
+template <typename T>
+void broadphase::cast_batch(const body_registry &bodies, std::span<const T> queries, std::span<ray_hit> hits) const
+{
+    assert(hits.size() >= queries.size());
+
+    auto count = static_cast<uint32_t>(queries.size());
+    auto task_count = (count + rays_per_task - 1) / rays_per_task;
+
+    // Tasks are already a packet batch each, let every one be stolen
+    os::parallel_for(0, task_count, [&, count](uint32_t task)
+    {
+        auto end = std::min(count, (task + 1) * rays_per_task);
+        for (auto i = task * rays_per_task; i < end;)
+        {
+            // Consecutive rays heading into the same octant share a packet
+            auto octant = octant_of(queries[i].direction);
+            auto lanes = 1u;
+            while (lanes < simd_width and i + lanes < end and octant_of(queries[i + lanes].direction) == octant)
+            {
+                lanes++;
+            }
+
+            alignas(16) auto ox = std::array<float, simd_width>{},
+                             oy = std::array<float, simd_width>{},
+                             oz = std::array<float, simd_width>{},
+                             radius = std::array<float, simd_width>{};
+            alignas(16) auto t_max = std::array<float, simd_width>{-1.0f, -1.0f, -1.0f, -1.0f};
+            alignas(16) auto dx = std::array<float, simd_width>{1.0f, 1.0f, 1.0f, 1.0f},
+                             dy = dx,
+                             dz = dx;
+
+            auto pk = packet{};
+            pk.lanes = lanes;
+            pk.octant = octant;
+            for (auto l = 0u; l < lanes; l++)
+            {
+                auto &q = queries[i + l];
+                pk.origin[l] = q.origin;
+                XMStoreFloat3(&pk.direction[l], XMVector3Normalize(XMLoadFloat3(&q.direction)));
+
+                ox[l] = q.origin.x;
+                oy[l] = q.origin.y;
+                oz[l] = q.origin.z;
+                dx[l] = pk.direction[l].x;
+                dy[l] = pk.direction[l].y;
+                dz[l] = pk.direction[l].z;
+                radius[l] = radius_of(q);
+                t_max[l] = q.max_distance;
+            }
+
+            auto load = [](const std::array<float, simd_width> &v)
+            {
+                return XMLoadFloat4A(reinterpret_cast<const XMFLOAT4A *>(v.data()));
+            };
+
+            pk.ox = load(ox);
+            pk.oy = load(oy);
+            pk.oz = load(oz);
+            pk.ix = XMVectorReciprocal(safe_direction(load(dx)));
+            pk.iy = XMVectorReciprocal(safe_direction(load(dy)));
+            pk.iz = XMVectorReciprocal(safe_direction(load(dz)));
+            pk.radius = load(radius);
+            pk.t_max = load(t_max);
+            pk.active = lane_mask(lanes);
+
+            cast_packet(bodies, pk);
+
+            std::copy_n(std::begin(pk.hits), lanes, std::begin(hits) + i);
+            i += lanes;
+        }
+    }, 1);
+}
+
+void broadphase::cast_packet(const body_registry &bodies, packet &pk) const
+{
+    for (auto l = 0u; l < pk.lanes; l++)
+    {
+        pk.hits[l] = {.hit = false};
+    }
+
+    if (nodes.empty())
+    {
+        return;
+    }
+
+    // Slab test of all lanes against one box, grown by each lane's sweep radius
+    auto box_hit = [&](const aabb &b)
+    {
+        auto min_x = XMVectorReplicate(b.min.x) - pk.radius,
+             min_y = XMVectorReplicate(b.min.y) - pk.radius,
+             min_z = XMVectorReplicate(b.min.z) - pk.radius;
+        auto max_x = XMVectorReplicate(b.max.x) + pk.radius,
+             max_y = XMVectorReplicate(b.max.y) + pk.radius,
+             max_z = XMVectorReplicate(b.max.z) + pk.radius;
+
+        auto t1x = (min_x - pk.ox) * pk.ix, t2x = (max_x - pk.ox) * pk.ix;
+        auto t1y = (min_y - pk.oy) * pk.iy, t2y = (max_y - pk.oy) * pk.iy;
+        auto t1z = (min_z - pk.oz) * pk.iz, t2z = (max_z - pk.oz) * pk.iz;
+
+        auto t_near = XMVectorMax(XMVectorMax(XMVectorMin(t1x, t2x), XMVectorMin(t1y, t2y)), XMVectorMin(t1z, t2z));
+        auto t_far = XMVectorMin(XMVectorMin(XMVectorMax(t1x, t2x), XMVectorMax(t1y, t2y)), XMVectorMax(t1z, t2z));
+
+        auto mask = XMVectorAndInt(XMVectorLessOrEqual(t_near, t_far), XMVectorGreaterOrEqual(t_far, XMVectorZero()));
+        mask = XMVectorAndInt(mask, XMVectorLessOrEqual(t_near, pk.t_max));
+        return XMVectorAndInt(mask, pk.active);
+    };
+
+    auto stack = std::array<uint32_t, max_stack>{};
+    auto top = 0u;
+    stack[top++] = 0;
+
+    while (top > 0)
+    {
+        auto &nd = nodes[stack[--top]];
+
+        auto mask = box_hit(nd.bounds);
+        if (XMVector4EqualInt(mask, XMVectorZero()))
+        {
+            continue;
+        }
+
+        if (nd.count == 0)
+        {
+            // Nearer child last so it pops first, the packet shares one octant
+            auto flip = (pk.octant >> nd.axis) & 1u;
+            stack[top++] = nd.first + 1 - flip;
+            stack[top++] = nd.first + flip;
+            continue;
+        }
+
+        for (auto l = 0u; l < pk.lanes; l++)
+        {
+            if (XMVectorGetIntByIndex(mask, l) == 0)
+            {
+                continue;
+            }
+
+            auto origin = XMLoadFloat3(&pk.origin[l]);
+            auto direction = XMLoadFloat3(&pk.direction[l]);
+            auto radius = XMVectorGetByIndex(pk.radius, l);
+            auto closest = XMVectorGetByIndex(pk.t_max, l);
+
+            for (auto e = nd.first; e < nd.first + nd.count; e++)
+            {
+                auto b = body_ids[e];
+                auto q = XMLoadFloat4(&bodies.orientations[b]);
+
+                // Ray into body space against the box grown by the radius
+                auto lo = XMVector3InverseRotate(origin - XMLoadFloat3(&bodies.positions[b]), q);
+                auto ld = safe_direction(XMVector3InverseRotate(direction, q));
+                auto inv = XMVectorReciprocal(ld);
+
+                auto r = XMVectorReplicate(radius);
+                auto t1 = (XMLoadFloat3(&bodies.bounding_boxes[b][0]) - r - lo) * inv;
+                auto t2 = (XMLoadFloat3(&bodies.bounding_boxes[b][1]) + r - lo) * inv;
+                auto t_min = XMVectorMin(t1, t2),
+                     t_max = XMVectorMax(t1, t2);
+
+                auto near_x = XMVectorGetX(t_min), near_y = XMVectorGetY(t_min), near_z = XMVectorGetZ(t_min);
+                auto t_near = std::max({near_x, near_y, near_z});
+                auto t_far = std::min({XMVectorGetX(t_max), XMVectorGetY(t_max), XMVectorGetZ(t_max)});
+
+                if (t_near > t_far or t_far < 0.0f or t_near > closest)
+                {
+                    continue;
+                }
+
+                auto normal = XMVECTOR{};
+                if (t_near < 0.0f)
+                {
+                    // Started inside
+                    t_near = 0.0f;
+                    normal = -direction;
+                }
+                else
+                {
+                    auto axis = t_near == near_x ? 0 : (t_near == near_y ? 1 : 2);
+                    auto sign = XMVectorGetByIndex(ld, axis) > 0.0f ? -1.0f : 1.0f;
+                    auto local = XMVectorSetByIndex(XMVectorZero(), sign, axis);
+                    normal = XMVector3Rotate(local, q);
+                }
+
+                closest = t_near;
+
+                auto &hit = pk.hits[l];
+                hit.hit = true;
+                hit.body = bodies.handle_of(b);
+                hit.distance = t_near;
+                XMStoreFloat3(&hit.position, origin + direction * t_near);
+                XMStoreFloat3(&hit.normal, normal);
+            }
+
+            pk.t_max = XMVectorSetByIndex(pk.t_max, closest, l);
+        }
+    }
+}
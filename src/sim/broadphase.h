@@ -0,0 +1,137 @@
+#pragma once
+
+#include "body_registry.h"
+#include "frame_arena.h"
+
+namespace sim
+{
+    struct aabb
+    {
+        DirectX::XMFLOAT3 min;
+        DirectX::XMFLOAT3 max;
+    };
+
+    // World space box around a body's rotated local bounding box
+    auto world_bounds(const DirectX::XMFLOAT3 &position,
+                      const DirectX::XMFLOAT4 &orientation,
+                      const std::array<DirectX::XMFLOAT3, 2> &bounding_box) -> aabb;
+
+    struct ray
+    {
+        DirectX::XMFLOAT3 origin;
+        DirectX::XMFLOAT3 direction;
+        float max_distance = std::numeric_limits<float>::infinity();
+    };
+
+    struct sphere_sweep
+    {
+        DirectX::XMFLOAT3 origin;
+        DirectX::XMFLOAT3 direction;
+        float radius;
+        float max_distance = std::numeric_limits<float>::infinity();
+    };
+
+    struct ray_hit
+    {
+        bool hit;
+        body_handle body;
+        float distance;
+        DirectX::XMFLOAT3 position;    // ray point, or sweep centre, at impact
+        DirectX::XMFLOAT3 normal;
+    };
+
+    // Dense indices of two bodies whose boxes overlap
+    struct body_pair
+    {
+        uint32_t a;
+        uint32_t b;
+    };
+
+    // Bounding volume hierarchy over the bodies' world boxes.
+    // Casts run in packets of 4 rays where consecutive rays head the same way,
+    // and batches are split across threads.
+    class broadphase
+    {
+    public:
+        broadphase();
+        ~broadphase();
+
+        broadphase(broadphase &&) noexcept;
+        auto operator=(broadphase &&) noexcept -> broadphase &;
+
+        void build(const body_registry &bodies);
+
+        // The same build spread over calls, build_slice returns true while nodes
+        // are left. Boxes are as of begin_build, queries wait until it finishes.
+        void begin_build(const body_registry &bodies);
+        auto build_slice(uint32_t node_budget) -> bool;
+
+        // Keeps the tree's shape and recomputes every box from the bodies, which
+        // must be as many as it was built over. Far cheaper than a build, but the
+        // tree loosens as bodies move away from where it was built.
+        void refit(const body_registry &bodies);
+
+        // Grows buffers for this many bodies, so later builds do not allocate
+        void reserve(uint32_t count);
+        auto body_count() const -> uint32_t;
+
+        void cast(const body_registry &bodies, std::span<const ray> rays, std::span<ray_hit> hits) const;
+        void cast(const body_registry &bodies, std::span<const sphere_sweep> sweeps, std::span<ray_hit> hits) const;
+
+        // Every overlapping pair, a < b, that passes the layer filter and is
+        // not in the sorted excluded keys. Triggers are left out. Subtrees that
+        // hold no layer a body can collide with are skipped whole. Pairs live
+        // in the arena.
+        auto find_pairs(const body_registry &bodies, std::span<const uint64_t> excluded, frame_arena &arena) const
+            -> std::span<const body_pair>;
+
+        // Every body each query body overlaps and whose layers and masks
+        // accept it, as (query, other) in query order
+        auto find_overlaps(std::span<const uint32_t> queries, frame_arena &arena) const -> std::span<const body_pair>;
+
+    private:
+        struct node
+        {
+            aabb bounds;
+            uint32_t first;    // first child when interior, first entry in body_ids when leaf
+            uint32_t count;    // 0 when interior
+            uint32_t axis;     // split axis, picks which child to visit first
+            uint32_t layers;   // every layer below, or-ed
+            uint32_t masks;    // every mask below, or-ed
+        };
+
+        struct packet;
+
+        // A node still to build over body_ids [first, first + count)
+        struct build_range
+        {
+            uint32_t index;
+            uint32_t first;
+            uint32_t count;
+        };
+
+        void load_boxes(const body_registry &bodies);
+        void build_node(uint32_t index, uint32_t first, uint32_t count);
+
+        template <typename T>
+        void cast_batch(const body_registry &bodies, std::span<const T> queries, std::span<ray_hit> hits) const;
+        void cast_packet(const body_registry &bodies, packet &pk) const;
+
+        // visit(i, emit) calls emit(a, b) for each pair item i yields
+        template <typename Visit>
+        auto collect_pairs(uint32_t count, frame_arena &arena, const Visit &visit) const -> std::span<const body_pair>;
+
+        // Bodies from first_other on, other than body, that overlap it and pass the layer filter
+        template <typename Fn>
+        void for_each_overlap(uint32_t body, uint32_t first_other, const Fn &fn) const;
+
+    private:
+        std::vector<node> nodes{};
+        std::vector<uint32_t> body_ids{};
+        std::vector<aabb> boxes{};
+        std::vector<DirectX::XMFLOAT3> centres{};
+        std::vector<uint32_t> layers{};
+        std::vector<uint32_t> masks{};
+        std::vector<build_range> pending{};
+    };
+}
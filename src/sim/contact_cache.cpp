@@ -0,0 +1,187 @@
+#include "contact_cache.h"
+
+#include "../os/job_system.h"
+
+using namespace sim;
+
+namespace
+{
+    constexpr auto min_capacity = 64u;
+
+    // Grow before a batch could take the table past half full
+    constexpr auto max_load_num = 1u;
+    constexpr auto max_load_den = 2u;
+}
+
+contact_cache::contact_cache()
+{
+    grow(0);
+}
+
+contact_cache::~contact_cache() = default;
+
+void contact_cache::next_frame()
+{
+    frame++;
+}
+
+auto contact_cache::find(uint64_t pair) const -> const contact_manifold *
+{
+    for (auto i = home_of(pair);; i = (i + 1) & mask)
+    {
+        auto key = keys[i].load(std::memory_order_relaxed);
+        if (key == pair)
+        {
+            return &manifolds[i];
+        }
+        if (key == empty_key)
+        {
+            return nullptr;
+        }
+    }
+}
+
+void contact_cache::insert(std::span<const uint64_t> pairs, std::span<const contact_manifold> batch)
+{
+    assert(pairs.size() == batch.size());
+
+    auto batch_size = static_cast<uint32_t>(pairs.size());
+    grow(size() + batch_size);
+
+    os::parallel_for(0, batch_size, [&](uint32_t p)
+    {
+        auto pair = pairs[p];
+        for (auto i = home_of(pair);; i = (i + 1) & mask)
+        {
+            auto key = keys[i].load(std::memory_order_acquire);
+            if (key == empty_key and keys[i].compare_exchange_strong(key, pair, std::memory_order_acq_rel))
+            {
+                count.fetch_add(1, std::memory_order_relaxed);
+                store(i, batch[p]);
+                return;
+            }
+
+            // Either already ours, or another thread just claimed the slot
+            if (key == pair)
+            {
+                store(i, batch[p]);
+                return;
+            }
+        }
+    });
+}
+
+auto contact_cache::evict(uint32_t max_age) -> uint32_t
+{
+    auto evicted = 0u;
+    auto capacity_ = mask + 1;
+
+    for (auto i = 0u; i < capacity_; i++)
+    {
+        // A shifted in entry lands on i, so look at i again until it holds one to keep
+        while (keys[i].load(std::memory_order_relaxed) != empty_key and frame - last_seen[i] > max_age)
+        {
+            // Backward shift, pull later entries of the chain into the hole
+            // unless that would put them before their home slot
+            auto hole = i;
+            for (auto j = (i + 1) & mask;; j = (j + 1) & mask)
+            {
+                auto key = keys[j].load(std::memory_order_relaxed);
+                if (key == empty_key)
+                {
+                    break;
+                }
+
+                auto home = home_of(key);
+                auto distance_to_j = (j - home) & mask;
+                auto distance_to_hole = (hole - home) & mask;
+                if (distance_to_hole <= distance_to_j)
+                {
+                    keys[hole].store(key, std::memory_order_relaxed);
+                    last_seen[hole] = last_seen[j];
+                    manifolds[hole] = manifolds[j];
+                    hole = j;
+                }
+            }
+
+            keys[hole].store(empty_key, std::memory_order_relaxed);
+            count.fetch_sub(1, std::memory_order_relaxed);
+            evicted++;
+        }
+    }
+
+    return evicted;
+}
+
+void contact_cache::clear()
+{
+    for (auto i = 0u; i <= mask; i++)
+    {
+        keys[i].store(empty_key, std::memory_order_relaxed);
+    }
+    count.store(0, std::memory_order_relaxed);
+}
+
+auto contact_cache::size() const -> uint32_t
+{
+    return count.load(std::memory_order_relaxed);
+}
+
+auto contact_cache::capacity() const -> uint32_t
+{
+    return mask + 1;
+}
+
+auto contact_cache::home_of(uint64_t key) const -> uint32_t
+{
+    // Fibonacci hashing, the top bits are the best mixed
+    auto bits = static_cast<uint32_t>(std::countr_zero(mask + 1));
+    return bits == 0 ? 0 : static_cast<uint32_t>((key * 0x9e37'79b9'7f4a'7c15ull) >> (64 - bits));
+}
+
+void contact_cache::grow(uint32_t needed)
+{
+    auto capacity_ = std::max(std::bit_ceil(needed * max_load_den / max_load_num), min_capacity);
+    if (keys and capacity_ <= mask + 1)
+    {
+        return;
+    }
+
+    auto old_keys = std::move(keys);
+    auto old_seen = std::move(last_seen);
+    auto old_manifolds = std::move(manifolds);
+    auto old_capacity = old_keys ? mask + 1 : 0;
+
+    mask = capacity_ - 1;
+    keys = std::make_unique<std::atomic<uint64_t>[]>(capacity_);
+    for (auto i = 0u; i < capacity_; i++)
+    {
+        keys[i].store(empty_key, std::memory_order_relaxed);
+    }
+    last_seen.assign(capacity_, 0);
+    manifolds.assign(capacity_, contact_manifold{});
+
+    for (auto o = 0u; o < old_capacity; o++)
+    {
+        auto key = old_keys[o].load(std::memory_order_relaxed);
+        if (key == empty_key)
+        {
+            continue;
+        }
+
+        auto i = home_of(key);
+        while (keys[i].load(std::memory_order_relaxed) != empty_key)
+        {
+            i = (i + 1) & mask;
+        }
+        keys[i].store(key, std::memory_order_relaxed);
+        last_seen[i] = old_seen[o];
+        manifolds[i] = old_manifolds[o];
+    }
+}
+
+void contact_cache::store(uint32_t slot, const contact_manifold &manifold)
+{
+    manifolds[slot] = manifold;
+    last_seen[slot] = frame;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "body_registry.h"
+
+namespace sim
+{
+    struct contact_point
+    {
+        DirectX::XMFLOAT3 local_a;    // in body a space, to match points across frames
+        DirectX::XMFLOAT3 local_b;
+        float normal_impulse;
+        std::array<float, 2> tangent_impulses;
+    };
+
+    struct contact_manifold
+    {
+        static constexpr auto max_points = 4u;
+
+        DirectX::XMFLOAT3 normal;     // from a to b
+        uint32_t point_count;
+        std::array<contact_point, max_points> points;
+    };
+
+    // Last step's contacts per body pair, for warm starting.
+    // Flat open addressing with linear probing over SoA arrays, so steady
+    // state lookups and inserts never allocate. Inserts after narrowphase
+    // run in parallel, claiming slots with a compare exchange on the key.
+    // Pairs not seen for a few steps are evicted with backward shifting,
+    // which keeps probe chains short without tombstones.
+    class contact_cache
+    {
+    public:
+        contact_cache();
+        ~contact_cache();
+
+        contact_cache(const contact_cache &) = delete;
+        auto operator=(const contact_cache &) -> contact_cache & = delete;
+
+        // Call once per step, before its inserts
+        void next_frame();
+
+        // Pointer is valid until the next insert or evict
+        auto find(uint64_t pair) const -> const contact_manifold *;
+
+        // Pairs must be unique within a batch
+        void insert(std::span<const uint64_t> pairs, std::span<const contact_manifold> manifolds);
+
+        // Drops pairs not inserted in the last max_age frames, returns how many went
+        auto evict(uint32_t max_age) -> uint32_t;
+
+        void clear();
+        auto size() const -> uint32_t;
+        auto capacity() const -> uint32_t;
+
+    private:
+        static constexpr auto empty_key = std::numeric_limits<uint64_t>::max();
+
+        auto home_of(uint64_t key) const -> uint32_t;
+        void grow(uint32_t count);
+        void store(uint32_t slot, const contact_manifold &manifold);
+
+    private:
+        uint32_t mask{};
+        std::unique_ptr<std::atomic<uint64_t>[]> keys{};
+        std::vector<uint32_t> last_seen{};
+        std::vector<contact_manifold> manifolds{};
+
+        std::atomic<uint32_t> count{};
+        uint32_t frame{};
+    };
+}
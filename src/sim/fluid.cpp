@@ -0,0 +1,322 @@
+#include "fluid.h"
+
+#include "simd.h"
+#include "morton.h"
+#include "radix_sort.h"
+
+#include "../gfx/render_data.h"
+#include "../os/job_system.h"
+
+using namespace sim;
+using namespace DirectX;
+
+namespace
+{
+    using namespace sim::simd;
+
+    constexpr auto min_distance_sq = 1e-12f;
+
+    template <typename T>
+    void gather(std::vector<T> &data, std::vector<T> &scratch, const std::vector<uint32_t> &order, uint32_t count)
+    {
+        os::parallel_for(0, count, [&](uint32_t i)
+        {
+            scratch[i] = data[order[i]];
+        });
+        std::swap(data, scratch);
+    }
+}
+
+fluid::fluid(const std::vector<XMFLOAT3> &particles, const desc &desc_) :
+    particle_mass{desc_.particle_mass},
+    rest_density{desc_.rest_density},
+    stiffness{desc_.stiffness},
+    viscosity{desc_.viscosity},
+    smoothing_radius{desc_.smoothing_radius},
+    boundary_damping{desc_.boundary_damping},
+    bounds{desc_.bounds},
+    substeps{std::max<uint8_t>(desc_.substeps, 1)},
+    count{static_cast<uint32_t>(particles.size())}
+{
+    // An empty box would clamp every particle onto one point
+    assert(bounds[0].x < bounds[1].x and bounds[0].y < bounds[1].y and bounds[0].z < bounds[1].z);
+
+    auto padded = count + simd_width - 1;
+    for (auto v : {&px, &py, &pz, &vx, &vy, &vz, &ax, &ay, &az, &density, &pressure, &scratch})
+    {
+        v->resize(padded, 0.0f);
+    }
+
+    for (auto i = 0u; i < count; i++)
+    {
+        px[i] = particles[i].x;
+        py[i] = particles[i].y;
+        pz[i] = particles[i].z;
+    }
+
+    // Compact hash table with at least twice as many buckets as particles
+    auto table_size = std::bit_ceil(std::max(count * 2, 64u));
+    table_mask = table_size - 1;
+
+    particle_hash.resize(count);
+    sorted_ids.resize(count);
+    cell_start.resize(table_size + 1);
+}
+
+fluid::~fluid() = default;
+
+void fluid::step(const XMFLOAT3 &gravity, double dt, frame_arena &arena)
+{
+    if (dt <= 0.0 or count == 0)
+    {
+        return;
+    }
+
+    auto sdt = static_cast<float>(dt) / substeps;
+
+    for (auto s = 0u; s < substeps; s++)
+    {
+        build_cell_list(arena);
+        compute_density();
+        compute_forces(gravity);
+        integrate(sdt);
+    }
+}
+
+auto fluid::particle_count() const -> uint32_t
+{
+    return count;
+}
+
+auto fluid::position(uint32_t particle) const -> XMFLOAT3
+{
+    return {px[particle], py[particle], pz[particle]};
+}
+
+auto fluid::density_of(uint32_t particle) const -> float
+{
+    return density[particle];
+}
+
+void fluid::translate(const XMFLOAT3 &offset)
+{
+    os::parallel_for(0, count, [&](uint32_t i)
+    {
+        px[i] += offset.x;
+        py[i] += offset.y;
+        pz[i] += offset.z;
+    });
+
+    for (auto &b : bounds)
+    {
+        XMStoreFloat3(&b, XMLoadFloat3(&b) + XMLoadFloat3(&offset));
+    }
+}
+
+void fluid::build_cell_list(frame_arena &arena)
+{
+    os::parallel_for(0, count, [&](uint32_t i)
+    {
+        auto c = cell_of(px[i], py[i], pz[i]);
+        particle_hash[i] = cell_hash(c.x, c.y, c.z);
+        sorted_ids[i] = i;
+    });
+
+    // Stable, so particles in a bucket keep their order from the last step
+    radix_sort(particle_hash, sorted_ids, arena);
+
+    // Each particle starts the buckets after its predecessor's, up to its own, the end closes the rest
+    auto table_size = static_cast<uint32_t>(cell_start.size() - 1);
+    os::parallel_for(0, count + 1, [&, table_size](uint32_t i)
+    {
+        auto first = i == 0 ? 0u : particle_hash[i - 1] + 1;
+        auto last = i == count ? table_size : particle_hash[i];
+        for (auto h = first; h <= last; h++)
+        {
+            cell_start[h] = i;
+        }
+    });
+
+    // Hash is the low bits of the cell's Morton code, so bucket order is Z-order
+    for (auto v : {&px, &py, &pz, &vx, &vy, &vz})
+    {
+        gather(*v, scratch, sorted_ids, count);
+    }
+}
+
+void fluid::compute_density()
+{
+    auto h2 = smoothing_radius * smoothing_radius;
+    auto poly6 = 315.0f / (64.0f * XM_PI * std::pow(smoothing_radius, 9.0f));
+
+    os::parallel_for(0, count, [&, h2, poly6](uint32_t i)
+    {
+        auto h2v = XMVectorReplicate(h2);
+        auto xi = XMVectorReplicate(px[i]),
+             yi = XMVectorReplicate(py[i]),
+             zi = XMVectorReplicate(pz[i]);
+        auto sum = XMVectorZero();
+
+        auto cells = std::array<uint32_t, 27>{};
+        auto cell_count_ = neighbour_cells(i, cells);
+        for (auto c = 0u; c < cell_count_; c++)
+        {
+            auto end = cell_start[cells[c] + 1];
+            for (auto j = cell_start[cells[c]]; j < end; j += simd_width)
+            {
+                auto dx = load4(px, j) - xi,
+                     dy = load4(py, j) - yi,
+                     dz = load4(pz, j) - zi;
+                auto r2 = dx * dx + dy * dy + dz * dz;
+
+                auto inside = XMVectorAndInt(XMVectorLess(r2, h2v), lane_mask(end - j));
+                auto t = h2v - r2;
+                sum += XMVectorSelect(XMVectorZero(), t * t * t, inside);
+            }
+        }
+
+        density[i] = particle_mass * poly6 * horizontal_sum(sum);
+        pressure[i] = stiffness * (density[i] - rest_density);
+    });
+}
+
+void fluid::compute_forces(const XMFLOAT3 &gravity)
+{
+    auto h = smoothing_radius;
+    auto kernel = particle_mass * 45.0f / (XM_PI * std::pow(h, 6.0f));
+
+    os::parallel_for(0, count, [&, h, kernel](uint32_t i)
+    {
+        auto hv = XMVectorReplicate(h);
+        auto h2v = XMVectorReplicate(h * h);
+        auto eps = XMVectorReplicate(min_distance_sq);
+        auto half = XMVectorReplicate(0.5f);
+        auto mu = XMVectorReplicate(viscosity);
+
+        auto xi = XMVectorReplicate(px[i]),
+             yi = XMVectorReplicate(py[i]),
+             zi = XMVectorReplicate(pz[i]);
+        auto vxi = XMVectorReplicate(vx[i]),
+             vyi = XMVectorReplicate(vy[i]),
+             vzi = XMVectorReplicate(vz[i]);
+        auto pi = XMVectorReplicate(pressure[i]);
+        auto fx = XMVectorZero(),
+             fy = XMVectorZero(),
+             fz = XMVectorZero();
+
+        auto cells = std::array<uint32_t, 27>{};
+        auto cell_count_ = neighbour_cells(i, cells);
+        for (auto c = 0u; c < cell_count_; c++)
+        {
+            auto end = cell_start[cells[c] + 1];
+            for (auto j = cell_start[cells[c]]; j < end; j += simd_width)
+            {
+                auto dx = xi - load4(px, j),
+                     dy = yi - load4(py, j),
+                     dz = zi - load4(pz, j);
+                auto r2 = dx * dx + dy * dy + dz * dz;
+
+                auto inside = XMVectorAndInt(XMVectorAndInt(XMVectorLess(r2, h2v), XMVectorGreater(r2, eps)),
+                                             lane_mask(end - j));
+
+                auto r = XMVectorSqrt(r2);
+                auto hr = hv - r;
+                auto inv_rho = XMVectorReciprocal(load4(density, j));
+
+                // Spiky kernel gradient for pressure, viscosity kernel laplacian for viscosity
+                auto press = (pi + load4(pressure, j)) * half * inv_rho * hr * hr / r;
+                auto visc = mu * hr * inv_rho;
+
+                fx += XMVectorSelect(XMVectorZero(), press * dx + visc * (load4(vx, j) - vxi), inside);
+                fy += XMVectorSelect(XMVectorZero(), press * dy + visc * (load4(vy, j) - vyi), inside);
+                fz += XMVectorSelect(XMVectorZero(), press * dz + visc * (load4(vz, j) - vzi), inside);
+            }
+        }
+
+        auto scale = kernel / density[i];
+        ax[i] = horizontal_sum(fx) * scale + gravity.x;
+        ay[i] = horizontal_sum(fy) * scale + gravity.y;
+        az[i] = horizontal_sum(fz) * scale + gravity.z;
+    });
+}
+
+void fluid::integrate(float dt)
+{
+    auto &[lo, hi] = bounds;
+
+    os::parallel_for(0, count, [&, dt](uint32_t i)
+    {
+        auto bounce = [&](float &p, float &v, float min_p, float max_p)
+        {
+            if (p < min_p)
+            {
+                p = min_p;
+                v *= -boundary_damping;
+            }
+            else if (p > max_p)
+            {
+                p = max_p;
+                v *= -boundary_damping;
+            }
+        };
+
+        vx[i] += ax[i] * dt;
+        vy[i] += ay[i] * dt;
+        vz[i] += az[i] * dt;
+
+        px[i] += vx[i] * dt;
+        py[i] += vy[i] * dt;
+        pz[i] += vz[i] * dt;
+
+        bounce(px[i], vx[i], lo.x, hi.x);
+        bounce(py[i], vy[i], lo.y, hi.y);
+        bounce(pz[i], vz[i], lo.z, hi.z);
+    });
+}
+
+auto fluid::cell_of(float x, float y, float z) const -> XMINT3
+{
+    auto inv_h = 1.0f / smoothing_radius;
+    return
+    {
+        static_cast<int32_t>(std::floor(x * inv_h)),
+        static_cast<int32_t>(std::floor(y * inv_h)),
+        static_cast<int32_t>(std::floor(z * inv_h)),
+    };
+}
+
+auto fluid::cell_hash(int32_t x, int32_t y, int32_t z) const -> uint32_t
+{
+    return morton_code(x, y, z) & table_mask;
+}
+
+auto fluid::neighbour_cells(uint32_t particle, std::array<uint32_t, 27> &cells) const -> uint32_t
+{
+    auto c = cell_of(px[particle], py[particle], pz[particle]);
+
+    auto n = 0u;
+    for (auto z = -1; z <= 1; z++)
+    {
+        for (auto y = -1; y <= 1; y++)
+        {
+            for (auto x = -1; x <= 1; x++)
+            {
+                cells[n++] = cell_hash(c.x + x, c.y + y, c.z + z);
+            }
+        }
+    }
+
+    // Different cells can land in the same bucket, visit each bucket once
+    std::sort(std::begin(cells), std::end(cells));
+    return static_cast<uint32_t>(std::distance(std::begin(cells), std::unique(std::begin(cells), std::end(cells))));
+}
+
+void sim::update_vertices(const fluid &body, gfx::mesh &model)
+{
+    assert(model.vertices.size() <= body.particle_count());
+
+    for (auto i = 0u; i < model.vertices.size(); i++)
+    {
+        model.vertices[i].position = body.position(i);
+    }
+}
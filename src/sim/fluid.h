@@ -0,0 +1,92 @@
+#pragma once
+
+#include "frame_arena.h"
+
+namespace gfx
+{
+    struct mesh;
+};
+
+namespace sim
+{
+    // Smoothed-particle hydrodynamics fluid.
+    // Particles are kept in SoA arrays, reordered every step along a Z-order
+    // curve by a stable radix sort into a compact hashed cell list, so a step
+    // gives the same result however its jobs were scheduled.
+    class fluid
+    {
+    public:
+        // Default bounds, particles only bounce off walls that were set
+        static constexpr auto no_wall = std::numeric_limits<float>::max();
+        static constexpr auto unbounded = std::array
+        {
+            DirectX::XMFLOAT3{-no_wall, -no_wall, -no_wall},
+            DirectX::XMFLOAT3{no_wall, no_wall, no_wall},
+        };
+
+        struct desc
+        {
+            float particle_mass = 0.02f;
+            float rest_density = 998.29f;
+            float stiffness = 3.0f;
+            float viscosity = 3.5f;
+            float smoothing_radius = 0.0457f;
+            float boundary_damping = 0.5f;
+            std::array<DirectX::XMFLOAT3, 2> bounds = unbounded;
+            uint8_t substeps = 4;
+        };
+
+    public:
+        fluid() = delete;
+        fluid(const std::vector<DirectX::XMFLOAT3> &particles, const desc &description);
+        ~fluid();
+
+        void step(const DirectX::XMFLOAT3 &gravity, double dt, frame_arena &arena);
+
+        auto particle_count() const -> uint32_t;
+        auto position(uint32_t particle) const -> DirectX::XMFLOAT3;
+
+        // As of the last substep's density pass, particles are in cell order after a step
+        auto density_of(uint32_t particle) const -> float;
+
+        // Moves the particles and the bounds together
+        void translate(const DirectX::XMFLOAT3 &offset);
+
+    private:
+        void build_cell_list(frame_arena &arena);
+        void compute_density();
+        void compute_forces(const DirectX::XMFLOAT3 &gravity);
+        void integrate(float dt);
+
+        auto cell_of(float x, float y, float z) const -> DirectX::XMINT3;
+        auto cell_hash(int32_t x, int32_t y, int32_t z) const -> uint32_t;
+        auto neighbour_cells(uint32_t particle, std::array<uint32_t, 27> &cells) const -> uint32_t;
+
+    private:
+        float particle_mass{},
+              rest_density{},
+              stiffness{},
+              viscosity{},
+              smoothing_radius{},
+              boundary_damping{};
+        std::array<DirectX::XMFLOAT3, 2> bounds{};
+        uint8_t substeps{};
+
+        uint32_t count{};
+        uint32_t table_mask{};
+
+        // SoA particle data, padded by a SIMD width so neighbour loops can over-read
+        std::vector<float> px{}, py{}, pz{};
+        std::vector<float> vx{}, vy{}, vz{};
+        std::vector<float> ax{}, ay{}, az{};
+        std::vector<float> density{}, pressure{};
+
+        // Cell list, particles of bucket h are [cell_start[h], cell_start[h + 1])
+        std::vector<uint32_t> particle_hash{};
+        std::vector<uint32_t> sorted_ids{};
+        std::vector<uint32_t> cell_start{};
+        std::vector<float> scratch{};
+    };
+
+    void update_vertices(const fluid &body, gfx::mesh &model);
+};
@@ -0,0 +1,126 @@
+#include "frame_arena.h"
+
+using namespace sim;
+
+namespace
+{
+    auto align_up(std::uintptr_t value, std::size_t alignment) -> std::uintptr_t
+    {
+        assert(std::has_single_bit(alignment));
+        return (value + alignment - 1) & ~(static_cast<std::uintptr_t>(alignment) - 1);
+    }
+}
+
+frame_arena::frame_arena() :
+    frame_arena(desc{})
+{ }
+
+frame_arena::frame_arena(const desc &desc_) :
+    sub_arena_count{std::max(desc_.sub_arena_count, 1u)}
+{
+    sub_arenas = std::make_unique<sub_arena[]>(sub_arena_count);
+    for (auto i = 0u; i < sub_arena_count; i++)
+    {
+        auto &arena = sub_arenas[i];
+        arena.capacity = desc_.sub_arena_size;
+        arena.block = std::make_unique<std::byte[]>(arena.capacity);
+    }
+}
+
+frame_arena::~frame_arena()
+{
+    // Not reset(), that would grow the blocks for a frame that never comes
+    free_overflow_blocks();
+}
+
+void frame_arena::reset()
+{
+    for (auto i = 0u; i < sub_arena_count; i++)
+    {
+        auto &arena = sub_arenas[i];
+
+        auto used = arena.offset.load(std::memory_order_relaxed)
+                  + arena.overflow_bytes.load(std::memory_order_relaxed);
+        arena.high_water_mark = std::max(arena.high_water_mark, used);
+
+        // Grow once so the next frame fits, steady state then never touches the heap
+        if (arena.overflow_bytes.load(std::memory_order_relaxed) > 0)
+        {
+            arena.capacity = std::bit_ceil(arena.high_water_mark);
+            arena.block = std::make_unique<std::byte[]>(arena.capacity);
+        }
+
+        arena.offset.store(0, std::memory_order_relaxed);
+        arena.overflow_bytes.store(0, std::memory_order_relaxed);
+    }
+
+    free_overflow_blocks();
+}
+
+auto frame_arena::allocate(std::size_t size, std::size_t alignment) -> void *
+{
+    auto &arena = current_sub_arena();
+    auto base = reinterpret_cast<std::uintptr_t>(arena.block.get());
+
+    auto offset = arena.offset.load(std::memory_order_relaxed);
+    auto next = std::size_t{};
+    auto start = std::uintptr_t{};
+    do
+    {
+        start = align_up(base + offset, alignment);
+        next = (start - base) + size;
+        if (next > arena.capacity)
+        {
+            return allocate_overflow(arena, size, alignment);
+        }
+    }
+    while (not arena.offset.compare_exchange_weak(offset, next, std::memory_order_relaxed));
+
+    return reinterpret_cast<void *>(start);
+}
+
+auto frame_arena::stats() const -> statistics
+{
+    auto result = statistics{};
+    for (auto i = 0u; i < sub_arena_count; i++)
+    {
+        auto &arena = sub_arenas[i];
+        result.capacity += arena.capacity;
+        result.used += arena.offset.load(std::memory_order_relaxed)
+                     + arena.overflow_bytes.load(std::memory_order_relaxed);
+        result.high_water_mark += arena.high_water_mark;
+        result.overflow_count += arena.overflow_count;
+    }
+    return result;
+}
+
+auto frame_arena::current_sub_arena() -> sub_arena &
+{
+    static const auto hasher = std::hash<std::thread::id>{};
+    thread_local const auto thread_hash = hasher(std::this_thread::get_id());
+
+    return sub_arenas[thread_hash % sub_arena_count];
+}
+
+auto frame_arena::allocate_overflow(sub_arena &arena, std::size_t size, std::size_t alignment) -> void *
+{
+    alignment = std::max(alignment, alignof(std::max_align_t));
+    auto block = ::operator new(size, std::align_val_t{alignment});
+
+    auto lock = std::lock_guard{overflow_mutex};
+    overflow_blocks.emplace_back(block, alignment);
+    arena.overflow_bytes.fetch_add(size + alignment, std::memory_order_relaxed);
+    arena.overflow_count++;
+
+    return block;
+}
+
+void frame_arena::free_overflow_blocks()
+{
+    auto lock = std::lock_guard{overflow_mutex};
+    for (auto &[block, alignment] : overflow_blocks)
+    {
+        ::operator delete(block, std::align_val_t{alignment});
+    }
+    overflow_blocks.clear();
+}
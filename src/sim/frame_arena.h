@@ -0,0 +1,111 @@
+#pragma once
+
+namespace sim
+{
+    // Linear allocator for per step temporaries.
+    // One sub-arena per worker thread, each a bump pointer over a single block.
+    // Nothing is freed individually, reset() rewinds every sub-arena at once.
+    class frame_arena
+    {
+    public:
+        struct desc
+        {
+            std::size_t sub_arena_size = 256 * 1024;
+            uint32_t sub_arena_count = std::max(std::thread::hardware_concurrency(), 1u);
+        };
+
+        struct statistics
+        {
+            std::size_t capacity;
+            std::size_t used;
+            std::size_t high_water_mark;
+            uint32_t overflow_count;
+        };
+
+    public:
+        frame_arena();
+        frame_arena(const desc &description);
+        ~frame_arena();
+
+        frame_arena(const frame_arena &) = delete;
+        auto operator=(const frame_arena &) -> frame_arena & = delete;
+
+        void reset();
+
+        auto allocate(std::size_t size, std::size_t alignment) -> void *;
+
+        template <typename T>
+        auto allocate_array(std::size_t count, std::size_t alignment = alignof(T)) -> std::span<T>
+        {
+            static_assert(std::is_trivially_destructible_v<T>);
+
+            auto data = static_cast<T *>(allocate(count * sizeof(T), std::max(alignment, alignof(T))));
+            std::uninitialized_value_construct_n(data, count);
+            return {data, count};
+        }
+
+        auto stats() const -> statistics;
+
+    private:
+        struct sub_arena
+        {
+            std::unique_ptr<std::byte[]> block{};
+            std::size_t capacity{};
+            std::atomic<std::size_t> offset{};
+            std::atomic<std::size_t> overflow_bytes{};
+            std::size_t high_water_mark{};
+            uint32_t overflow_count{};
+        };
+
+        auto current_sub_arena() -> sub_arena &;
+        auto allocate_overflow(sub_arena &arena, std::size_t size, std::size_t alignment) -> void *;
+        void free_overflow_blocks();
+
+    private:
+        uint32_t sub_arena_count{};
+        std::unique_ptr<sub_arena[]> sub_arenas{};
+
+        // Requests that did not fit, freed on reset and the sub-arena grown to fit next time
+        std::mutex overflow_mutex{};
+        std::vector<std::pair<void *, std::size_t>> overflow_blocks{};
+    };
+
+    // Standard allocator over a frame arena, deallocate is a no-op
+    template <typename T>
+    class arena_allocator
+    {
+    public:
+        using value_type = T;
+
+        arena_allocator(frame_arena &arena) noexcept :
+            arena{&arena}
+        { }
+
+        template <typename U>
+        arena_allocator(const arena_allocator<U> &other) noexcept :
+            arena{other.arena}
+        { }
+
+        auto allocate(std::size_t count) -> T *
+        {
+            return static_cast<T *>(arena->allocate(count * sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T *, std::size_t) noexcept
+        { }
+
+        friend auto operator==(const arena_allocator &a, const arena_allocator &b) -> bool
+        {
+            return a.arena == b.arena;
+        }
+
+    private:
+        template <typename U>
+        friend class arena_allocator;
+
+        frame_arena *arena;
+    };
+
+    template <typename T>
+    using arena_vector = std::vector<T, arena_allocator<T>>;
+}
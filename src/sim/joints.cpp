@@ -0,0 +1,453 @@
+#include "joints.h"
+
+using namespace sim;
+using namespace DirectX;
+
+namespace
+{
+    constexpr auto solver_iterations = uint8_t{10};
+    constexpr auto baumgarte = 0.2f;
+    constexpr auto warm_start_factor = 0.8f;
+
+    auto rows_per_joint(joint_type type) -> uint32_t
+    {
+        switch (type)
+        {
+            case joint_type::distance:
+                return 1;
+            case joint_type::ball:
+                return 3;
+            case joint_type::hinge:
+            case joint_type::slider:
+                return 5;
+        }
+        return 0;
+    }
+
+    // Two unit vectors perpendicular to n and to each other
+    auto perpendicular_basis(FXMVECTOR n) -> std::pair<XMVECTOR, XMVECTOR>
+    {
+        auto helper = std::abs(XMVectorGetX(n)) < 0.57f ? XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f)
+                                                         : XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+        auto t1 = XMVector3Normalize(XMVector3Cross(n, helper));
+        auto t2 = XMVector3Cross(n, t1);
+        return {t1, t2};
+    }
+
+    template <typename T>
+    auto load(const T &v, uint32_t i) -> XMVECTOR
+    {
+        return XMLoadFloat3(&v[i]);
+    }
+}
+
+joint_system::joint_system() :
+    iterations{solver_iterations}
+{ }
+
+joint_system::~joint_system() = default;
+
+auto joint_system::add_joint(const desc &desc_, const body_registry &bodies) -> uint32_t
+{
+    assert(desc_.body_a == world or bodies.is_valid(desc_.body_a));
+    assert(desc_.body_b == world or bodies.is_valid(desc_.body_b));
+
+    auto position_of = [&](body_handle b)
+    {
+        return b == world ? XMLoadFloat3(&world_position) : XMLoadFloat3(&bodies.positions[bodies.index_of(b)]);
+    };
+    auto orientation_of = [&](body_handle b)
+    {
+        return b == world ? XMQuaternionIdentity() : XMLoadFloat4(&bodies.orientations[bodies.index_of(b)]);
+    };
+
+    auto qa = orientation_of(desc_.body_a),
+         qb = orientation_of(desc_.body_b);
+
+    auto pa = position_of(desc_.body_a) + XMVector3Rotate(XMLoadFloat3(&desc_.anchor_a), qa),
+         pb = position_of(desc_.body_b) + XMVector3Rotate(XMLoadFloat3(&desc_.anchor_b), qb);
+
+    // Axis is given in body a space, keep body b's copy so both start aligned
+    auto axis_a = XMVector3Normalize(XMLoadFloat3(&desc_.axis));
+    auto axis_b = XMVector3InverseRotate(XMVector3Rotate(axis_a, qa), qb);
+
+    auto to_float3 = [](FXMVECTOR v)
+    {
+        auto f = XMFLOAT3{};
+        XMStoreFloat3(&f, v);
+        return f;
+    };
+    auto to_float4 = [](FXMVECTOR v)
+    {
+        auto f = XMFLOAT4{};
+        XMStoreFloat4(&f, v);
+        return f;
+    };
+
+    types.push_back(desc_.type);
+    bodies_a.push_back(desc_.body_a);
+    bodies_b.push_back(desc_.body_b);
+    anchors_a.push_back(desc_.anchor_a);
+    anchors_b.push_back(desc_.anchor_b);
+    axes_a.push_back(to_float3(axis_a));
+    axes_b.push_back(to_float3(axis_b));
+    rest_lengths.push_back(XMVectorGetX(XMVector3Length(pa - pb)));
+    // q_a = q_b * rest, so rest = conj(q_b) * q_a
+    rest_orientations.push_back(to_float4(XMQuaternionMultiply(qa, XMQuaternionConjugate(qb))));
+    break_impulses.push_back(desc_.break_impulse);
+    broken.push_back(false);
+    collide_connected.push_back(desc_.collide_connected);
+    cached_impulses.push_back({});
+
+    return joint_count() - 1;
+}
+
+auto joint_system::is_broken(uint32_t joint) const -> bool
+{
+    return broken[joint];
+}
+
+auto joint_system::joint_count() const -> uint32_t
+{
+    return static_cast<uint32_t>(types.size());
+}
+
+auto joint_system::excluded_pairs(frame_arena &arena) const -> std::span<const uint64_t>
+{
+    auto pairs = arena.allocate_array<uint64_t>(joint_count());
+    auto count = 0u;
+    for (auto j = 0u; j < joint_count(); j++)
+    {
+        if (not broken[j] and not collide_connected[j] and bodies_a[j] != world and bodies_b[j] != world)
+        {
+            pairs[count++] = pair_key(bodies_a[j], bodies_b[j]);
+        }
+    }
+
+    auto excluded = pairs.first(count);
+    std::sort(std::begin(excluded), std::end(excluded));
+    return excluded;
+}
+
+void joint_system::mark_jointed(const body_registry &bodies, std::span<uint8_t> jointed) const
+{
+    for (auto j = 0u; j < joint_count(); j++)
+    {
+        if (broken[j])
+        {
+            continue;
+        }
+
+        for (auto body : {bodies_a[j], bodies_b[j]})
+        {
+            if (body != world and bodies.is_valid(body))
+            {
+                jointed[bodies.index_of(body)] = 1;
+            }
+        }
+    }
+}
+
+void joint_system::solve(body_registry &bodies, double dt, frame_arena &arena)
+{
+    if (dt <= 0.0 or types.empty())
+    {
+        return;
+    }
+
+    load_bodies(bodies, arena);
+    resolve_bodies(bodies, arena);
+    allocate_rows(arena);
+    build_rows(static_cast<float>(dt));
+    warm_start();
+
+    for (auto i = 0u; i < iterations; i++)
+    {
+        solve_rows();
+    }
+
+    store_impulses(arena);
+    store_bodies(bodies);
+}
+
+void joint_system::set_world_position(const XMFLOAT3 &position)
+{
+    world_position = position;
+}
+
+void joint_system::load_bodies(const body_registry &bodies, frame_arena &arena)
+{
+    auto count = bodies.size() + 1;
+    positions = arena.allocate_array<XMFLOAT3>(count);
+    orientations = arena.allocate_array<XMFLOAT4>(count);
+    velocities = arena.allocate_array<XMFLOAT3>(count);
+    angular_velocities = arena.allocate_array<XMFLOAT3>(count);
+    inverse_masses = arena.allocate_array<float>(count);
+    inverse_inertias = arena.allocate_array<XMFLOAT4X4>(count);
+
+    std::copy(std::begin(bodies.positions), std::end(bodies.positions), std::begin(positions));
+    std::copy(std::begin(bodies.orientations), std::end(bodies.orientations), std::begin(orientations));
+    std::copy(std::begin(bodies.velocities), std::end(bodies.velocities), std::begin(velocities));
+    std::copy(std::begin(bodies.angular_velocities), std::end(bodies.angular_velocities), std::begin(angular_velocities));
+
+    for (auto i = 0u; i < bodies.size(); i++)
+    {
+        auto mass = bodies.masses[i];
+        inverse_masses[i] = mass > 0.0f ? 1.0f / mass : 0.0f;
+
+        // World inverse inertia R * D * R^T
+        auto d = inverse_inertia(mass, bodies.bounding_boxes[i]);
+        auto rot = XMMatrixRotationQuaternion(XMLoadFloat4(&orientations[i]));
+        auto world_inertia = XMMatrixTranspose(rot) * XMMatrixScaling(d.x, d.y, d.z) * rot;
+        XMStoreFloat4x4(&inverse_inertias[i], world_inertia);
+    }
+
+    // Static world body
+    auto w = bodies.size();
+    positions[w] = world_position;
+    orientations[w] = {0.0f, 0.0f, 0.0f, 1.0f};
+    velocities[w] = {};
+    angular_velocities[w] = {};
+    inverse_masses[w] = 0.0f;
+    XMStoreFloat4x4(&inverse_inertias[w], XMMatrixScaling(0.0f, 0.0f, 0.0f));
+}
+
+void joint_system::store_bodies(body_registry &bodies) const
+{
+    std::copy_n(std::begin(velocities), bodies.size(), std::begin(bodies.velocities));
+    std::copy_n(std::begin(angular_velocities), bodies.size(), std::begin(bodies.angular_velocities));
+}
+
+void joint_system::resolve_bodies(const body_registry &bodies, frame_arena &arena)
+{
+    joint_bodies_a = arena.allocate_array<uint32_t>(joint_count());
+    joint_bodies_b = arena.allocate_array<uint32_t>(joint_count());
+
+    auto world_index = bodies.size();
+    auto resolve = [&](body_handle b)
+    {
+        return b == world ? world_index : bodies.index_of(b);
+    };
+
+    for (auto j = 0u; j < joint_count(); j++)
+    {
+        joint_bodies_a[j] = resolve(bodies_a[j]);
+        joint_bodies_b[j] = resolve(bodies_b[j]);
+
+        // A joint whose body was removed goes with it
+        if (joint_bodies_a[j] == body_registry::invalid_index or joint_bodies_b[j] == body_registry::invalid_index)
+        {
+            broken[j] = true;
+            cached_impulses[j] = {};
+        }
+    }
+}
+
+void joint_system::allocate_rows(frame_arena &arena)
+{
+    auto count = std::size_t{};
+    for (auto j = 0u; j < joint_count(); j++)
+    {
+        count += broken[j] ? 0 : rows_per_joint(types[j]);
+    }
+
+    row_count = 0;
+    row_joints = arena.allocate_array<uint32_t>(count);
+    row_bodies_a = arena.allocate_array<uint32_t>(count);
+    row_bodies_b = arena.allocate_array<uint32_t>(count);
+    row_linear = arena.allocate_array<XMFLOAT3>(count);
+    row_angular_a = arena.allocate_array<XMFLOAT3>(count);
+    row_angular_b = arena.allocate_array<XMFLOAT3>(count);
+    row_effective_mass = arena.allocate_array<float>(count);
+    row_bias = arena.allocate_array<float>(count);
+    row_impulse = arena.allocate_array<float>(count);
+}
+
+void joint_system::build_rows(float dt)
+{
+    auto inv_dt = 1.0f / dt;
+    auto zero = XMVectorZero();
+
+    for (auto j = 0u; j < joint_count(); j++)
+    {
+        if (broken[j])
+        {
+            continue;
+        }
+
+        auto a = joint_bodies_a[j],
+             b = joint_bodies_b[j];
+
+        auto qa = XMLoadFloat4(&orientations[a]),
+             qb = XMLoadFloat4(&orientations[b]);
+        auto ra = XMVector3Rotate(load(anchors_a, j), qa),
+             rb = XMVector3Rotate(load(anchors_b, j), qb);
+        auto d = (load(positions, a) + ra) - (load(positions, b) + rb);
+
+        // Point to point rows, C = p_a - p_b
+        auto point_rows = [&]()
+        {
+            for (auto axis : {XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f),
+                              XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f),
+                              XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f)})
+            {
+                add_row(j, a, b, axis, XMVector3Cross(ra, axis), -XMVector3Cross(rb, axis),
+                        XMVectorGetX(XMVector3Dot(d, axis)), inv_dt);
+            }
+        };
+
+        switch (types[j])
+        {
+            case joint_type::distance:
+            {
+                auto length = XMVectorGetX(XMVector3Length(d));
+                auto n = length > 1e-6f ? d / length : XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+                add_row(j, a, b, n, XMVector3Cross(ra, n), -XMVector3Cross(rb, n),
+                        length - rest_lengths[j], inv_dt);
+                break;
+            }
+            case joint_type::ball:
+            {
+                point_rows();
+                break;
+            }
+            case joint_type::hinge:
+            {
+                point_rows();
+
+                // Keep the hinge axes aligned, C = (axis_b x axis_a) . t
+                auto axis_a = XMVector3Rotate(load(axes_a, j), qa),
+                     axis_b = XMVector3Rotate(load(axes_b, j), qb);
+                auto error = XMVector3Cross(axis_b, axis_a);
+                auto [t1, t2] = perpendicular_basis(axis_a);
+                for (auto t : {t1, t2})
+                {
+                    add_row(j, a, b, zero, t, -t, XMVectorGetX(XMVector3Dot(error, t)), inv_dt);
+                }
+                break;
+            }
+            case joint_type::slider:
+            {
+                // Lock relative rotation, C = 2 * vec(q_a * conj(q_b * rest))
+                auto target = XMQuaternionMultiply(XMLoadFloat4(&rest_orientations[j]), qb);
+                auto error = XMQuaternionMultiply(XMQuaternionConjugate(target), qa);
+                if (XMVectorGetW(error) < 0.0f)
+                {
+                    error = -error;
+                }
+                error = error * 2.0f;
+
+                for (auto axis : {XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f),
+                                  XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f),
+                                  XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f)})
+                {
+                    add_row(j, a, b, zero, axis, -axis, XMVectorGetX(XMVector3Dot(error, axis)), inv_dt);
+                }
+
+                // Keep anchor b on the line through anchor a along the axis
+                auto axis_a = XMVector3Rotate(load(axes_a, j), qa);
+                auto [t1, t2] = perpendicular_basis(axis_a);
+                for (auto t : {t1, t2})
+                {
+                    add_row(j, a, b, t, XMVector3Cross(ra - d, t), -XMVector3Cross(rb, t),
+                            XMVectorGetX(XMVector3Dot(d, t)), inv_dt);
+                }
+                break;
+            }
+        }
+    }
+}
+
+void joint_system::add_row(uint32_t joint, uint32_t a, uint32_t b,
+                           FXMVECTOR linear, FXMVECTOR angular_a, FXMVECTOR angular_b,
+                           float error, float inv_dt)
+{
+    auto ia = XMLoadFloat4x4(&inverse_inertias[a]),
+         ib = XMLoadFloat4x4(&inverse_inertias[b]);
+
+    // J * M^-1 * J^T
+    auto k = XMVectorGetX(XMVector3LengthSq(linear)) * (inverse_masses[a] + inverse_masses[b])
+           + XMVectorGetX(XMVector3Dot(angular_a, XMVector3TransformNormal(angular_a, ia)))
+           + XMVectorGetX(XMVector3Dot(angular_b, XMVector3TransformNormal(angular_b, ib)));
+
+    auto r = row_count++;
+    row_joints[r] = joint;
+    row_bodies_a[r] = a;
+    row_bodies_b[r] = b;
+    XMStoreFloat3(&row_linear[r], linear);
+    XMStoreFloat3(&row_angular_a[r], angular_a);
+    XMStoreFloat3(&row_angular_b[r], angular_b);
+    row_effective_mass[r] = k > 0.0f ? 1.0f / k : 0.0f;
+    row_bias[r] = baumgarte * inv_dt * error;
+    row_impulse[r] = 0.0f;
+}
+
+void joint_system::warm_start()
+{
+    // Rows of a joint are contiguous and in the order they were built
+    for (auto r = 0u, local = 0u; r < row_count; r++)
+    {
+        local = (r > 0 and row_joints[r - 1] == row_joints[r]) ? local + 1 : 0;
+
+        auto impulse = cached_impulses[row_joints[r]][local] * warm_start_factor;
+        row_impulse[r] = impulse;
+        apply_impulse(r, impulse);
+    }
+}
+
+void joint_system::solve_rows()
+{
+    for (auto r = 0u; r < row_count; r++)
+    {
+        auto a = row_bodies_a[r],
+             b = row_bodies_b[r];
+
+        auto jv = XMVectorGetX(XMVector3Dot(load(row_linear, r), load(velocities, a) - load(velocities, b))
+                             + XMVector3Dot(load(row_angular_a, r), load(angular_velocities, a))
+                             + XMVector3Dot(load(row_angular_b, r), load(angular_velocities, b)));
+
+        auto impulse = -row_effective_mass[r] * (jv + row_bias[r]);
+        row_impulse[r] += impulse;
+        apply_impulse(r, impulse);
+    }
+}
+
+void joint_system::store_impulses(frame_arena &arena)
+{
+    auto totals = arena.allocate_array<float>(joint_count());
+
+    for (auto r = 0u, local = 0u; r < row_count; r++)
+    {
+        local = (r > 0 and row_joints[r - 1] == row_joints[r]) ? local + 1 : 0;
+
+        auto j = row_joints[r];
+        cached_impulses[j][local] = row_impulse[r];
+        totals[j] += row_impulse[r] * row_impulse[r];
+    }
+
+    for (auto j = 0u; j < joint_count(); j++)
+    {
+        if (not broken[j] and totals[j] > break_impulses[j] * break_impulses[j])
+        {
+            broken[j] = true;
+            cached_impulses[j] = {};
+        }
+    }
+}
+
+void joint_system::apply_impulse(uint32_t row, float impulse)
+{
+    auto a = row_bodies_a[row],
+         b = row_bodies_b[row];
+
+    auto linear = load(row_linear, row) * impulse;
+    auto ia = XMLoadFloat4x4(&inverse_inertias[a]),
+         ib = XMLoadFloat4x4(&inverse_inertias[b]);
+
+    XMStoreFloat3(&velocities[a], load(velocities, a) + linear * inverse_masses[a]);
+    XMStoreFloat3(&velocities[b], load(velocities, b) - linear * inverse_masses[b]);
+    XMStoreFloat3(&angular_velocities[a], load(angular_velocities, a)
+                                        + XMVector3TransformNormal(load(row_angular_a, row), ia) * impulse);
+    XMStoreFloat3(&angular_velocities[b], load(angular_velocities, b)
+                                        + XMVector3TransformNormal(load(row_angular_b, row), ib) * impulse);
+}
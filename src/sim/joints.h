@@ -0,0 +1,110 @@
+#pragma once
+
+#include "body_registry.h"
+#include "frame_arena.h"
+
+namespace sim
+{
+    enum class joint_type : uint8_t
+    {
+        distance,
+        ball,
+        hinge,
+        slider,
+    };
+
+    // Joints between rigid bodies.
+    // Every joint type is lowered to Jacobian rows in one SoA row table,
+    // and a single sequential impulse loop solves all rows.
+    class joint_system
+    {
+    public:
+        // Use as a body handle to pin a joint to the world
+        static constexpr auto world = body_handle{};
+
+        struct desc
+        {
+            joint_type type;
+            body_handle body_a;
+            body_handle body_b;
+            DirectX::XMFLOAT3 anchor_a;    // in body a space
+            DirectX::XMFLOAT3 anchor_b;    // in body b space
+            DirectX::XMFLOAT3 axis{1.0f, 0.0f, 0.0f}; // hinge/slide axis, in body a space
+            float break_impulse = std::numeric_limits<float>::infinity();
+            bool collide_connected = false;    // otherwise the broadphase skips this pair
+        };
+
+    public:
+        joint_system();
+        ~joint_system();
+
+        auto add_joint(const desc &description, const body_registry &bodies) -> uint32_t;
+        auto is_broken(uint32_t joint) const -> bool;
+        auto joint_count() const -> uint32_t;
+
+        // Sorted pair keys of bodies held by an unbroken joint that should not collide
+        auto excluded_pairs(frame_arena &arena) const -> std::span<const uint64_t>;
+
+        // Sets jointed[i] for every dense body index held by an unbroken joint
+        void mark_jointed(const body_registry &bodies, std::span<uint8_t> jointed) const;
+
+        void solve(body_registry &bodies, double dt, frame_arena &arena);
+
+        // Where the static world body sits, it moves when the simulation rebases its origin
+        void set_world_position(const DirectX::XMFLOAT3 &position);
+
+    private:
+        static constexpr auto max_rows = 5u;
+
+        void load_bodies(const body_registry &bodies, frame_arena &arena);
+        void store_bodies(body_registry &bodies) const;
+        void resolve_bodies(const body_registry &bodies, frame_arena &arena);
+        void allocate_rows(frame_arena &arena);
+        void build_rows(float dt);
+        void warm_start();
+        void solve_rows();
+        void store_impulses(frame_arena &arena);
+
+        void add_row(uint32_t joint, uint32_t a, uint32_t b,
+                     DirectX::FXMVECTOR linear, DirectX::FXMVECTOR angular_a, DirectX::FXMVECTOR angular_b,
+                     float error, float inv_dt);
+        void apply_impulse(uint32_t row, float impulse);
+
+    private:
+        uint8_t iterations{};
+        DirectX::XMFLOAT3 world_position{};
+
+        // Joints
+        std::vector<joint_type> types{};
+        std::vector<body_handle> bodies_a{}, bodies_b{};
+        std::vector<DirectX::XMFLOAT3> anchors_a{}, anchors_b{};
+        std::vector<DirectX::XMFLOAT3> axes_a{}, axes_b{};
+        std::vector<float> rest_lengths{};
+        std::vector<DirectX::XMFLOAT4> rest_orientations{};
+        std::vector<float> break_impulses{};
+        std::vector<uint8_t> broken{};
+        std::vector<uint8_t> collide_connected{};
+        std::vector<std::array<float, max_rows>> cached_impulses{};
+
+        // Dense solver index of each joint's bodies, resolved from the handles every step
+        std::span<uint32_t> joint_bodies_a{}, joint_bodies_b{};
+
+        // Jacobian rows, linear part for body b is the negated linear part for body a.
+        // Rebuilt every step in the frame arena.
+        uint32_t row_count{};
+        std::span<uint32_t> row_joints{};
+        std::span<uint32_t> row_bodies_a{}, row_bodies_b{};
+        std::span<DirectX::XMFLOAT3> row_linear{};
+        std::span<DirectX::XMFLOAT3> row_angular_a{}, row_angular_b{};
+        std::span<float> row_effective_mass{};
+        std::span<float> row_bias{};
+        std::span<float> row_impulse{};
+
+        // Solver copy of body state in the frame arena, world is the last entry
+        std::span<DirectX::XMFLOAT3> positions{};
+        std::span<DirectX::XMFLOAT4> orientations{};
+        std::span<DirectX::XMFLOAT3> velocities{}, angular_velocities{};
+        std::span<float> inverse_masses{};
+        std::span<DirectX::XMFLOAT4X4> inverse_inertias{};
+    };
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+// Morton (Z-order) codes for 3D integer coordinates
+namespace sim
+{
+    // Spread the low 10 bits of v so there are two zero bits between each
+    inline auto part_1_by_2(uint32_t v) -> uint32_t
+    {
+        v &= 0x0000'03ff;
+        v = (v | (v << 16)) & 0x0300'00ff;
+        v = (v | (v << 8))  & 0x0300'f00f;
+        v = (v | (v << 4))  & 0x030c'30c3;
+        v = (v | (v << 2))  & 0x0924'9249;
+        return v;
+    }
+
+    // Spread the low 21 bits of v so there are two zero bits between each
+    inline auto part_1_by_2(uint64_t v) -> uint64_t
+    {
+        v &= 0x0000'0000'001f'ffff;
+        v = (v | (v << 32)) & 0x001f'0000'0000'ffff;
+        v = (v | (v << 16)) & 0x001f'0000'ff00'00ff;
+        v = (v | (v << 8))  & 0x100f'00f0'0f00'f00f;
+        v = (v | (v << 4))  & 0x10c3'0c30'c30c'30c3;
+        v = (v | (v << 2))  & 0x1249'2492'4924'9249;
+        return v;
+    }
+
+    // 10 bits per axis, coordinates wrap
+    inline auto morton_code(int32_t x, int32_t y, int32_t z) -> uint32_t
+    {
+        return part_1_by_2(static_cast<uint32_t>(x))
+             | (part_1_by_2(static_cast<uint32_t>(y)) << 1)
+             | (part_1_by_2(static_cast<uint32_t>(z)) << 2);
+    }
+
+    // 21 bits per axis
+    inline auto morton_code_64(uint32_t x, uint32_t y, uint32_t z) -> uint64_t
+    {
+        return part_1_by_2(static_cast<uint64_t>(x))
+             | (part_1_by_2(static_cast<uint64_t>(y)) << 1)
+             | (part_1_by_2(static_cast<uint64_t>(z)) << 2);
+    }
+
+    constexpr auto morton_64_axis_bits = 21u;
+}
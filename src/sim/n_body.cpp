@@ -0,0 +1,326 @@
+#include "n_body.h"
+
+#include "simd.h"
+#include "morton.h"
+#include "radix_sort.h"
+
+#include "../os/job_system.h"
+
+using namespace sim;
+using namespace sim::simd;
+using namespace DirectX;
+
+namespace
+{
+    constexpr auto leaf_size = 16u;
+    constexpr auto max_depth = morton_64_axis_bits;
+    constexpr auto max_stack = 8u * max_depth + 8u;
+    constexpr auto bounds_block = 4096u;
+}
+
+n_body_gravity::n_body_gravity(const desc &desc_) :
+    gravitational_constant{desc_.gravitational_constant},
+    opening_angle{desc_.opening_angle},
+    softening_sq{desc_.softening * desc_.softening},
+    direct_sum_threshold{desc_.direct_sum_threshold}
+{ }
+
+n_body_gravity::~n_body_gravity() = default;
+
+void n_body_gravity::compute_accelerations(const std::vector<XMFLOAT3> &positions,
+                                           const std::vector<float> &masses,
+                                           std::vector<XMFLOAT3> &accelerations,
+                                           frame_arena &arena)
+{
+    assert(positions.size() == masses.size());
+
+    auto count = static_cast<uint32_t>(positions.size());
+    accelerations.resize(count);
+    if (count == 0)
+    {
+        return;
+    }
+
+    auto direct = count < direct_sum_threshold;
+    load_bodies(positions, masses, not direct, arena);
+    if (not direct)
+    {
+        build_tree(arena);
+    }
+
+    os::parallel_for(0, count, [&, direct, count](uint32_t i)
+    {
+        auto p = XMVectorSet(x[i], y[i], z[i], 0.0f);
+        auto a = direct ? sum_range(p, 0, count) : sum_tree(p);
+
+        XMStoreFloat3(&accelerations[order[i]], a * gravitational_constant);
+    });
+}
+
+void n_body_gravity::load_bodies(const std::vector<XMFLOAT3> &positions,
+                                 const std::vector<float> &masses,
+                                 bool morton_sort,
+                                 frame_arena &arena)
+{
+    auto count = static_cast<uint32_t>(positions.size());
+
+    body_ids.resize(count);
+    std::iota(std::begin(body_ids), std::end(body_ids), 0u);
+    order = body_ids;
+
+    if (morton_sort)
+    {
+        // Bounds per block in parallel, then over the blocks
+        auto block_count = (count + bounds_block - 1) / bounds_block;
+        auto block_lo = arena.allocate_array<XMFLOAT3>(block_count);
+        auto block_hi = arena.allocate_array<XMFLOAT3>(block_count);
+        os::parallel_for(0, block_count, [&, count](uint32_t b)
+        {
+            auto block_min = XMVectorReplicate(std::numeric_limits<float>::max());
+            auto block_max = XMVectorReplicate(std::numeric_limits<float>::lowest());
+            for (auto i = b * bounds_block; i < std::min((b + 1) * bounds_block, count); i++)
+            {
+                auto v = XMLoadFloat3(&positions[i]);
+                block_min = XMVectorMin(block_min, v);
+                block_max = XMVectorMax(block_max, v);
+            }
+            XMStoreFloat3(&block_lo[b], block_min);
+            XMStoreFloat3(&block_hi[b], block_max);
+        }, 1);
+
+        auto lo = XMLoadFloat3(&block_lo[0]);
+        auto hi = XMLoadFloat3(&block_hi[0]);
+        for (auto b = 1u; b < block_count; b++)
+        {
+            lo = XMVectorMin(lo, XMLoadFloat3(&block_lo[b]));
+            hi = XMVectorMax(hi, XMLoadFloat3(&block_hi[b]));
+        }
+
+        auto extent = hi - lo;
+        root_width = std::max({XMVectorGetX(extent), XMVectorGetY(extent), XMVectorGetZ(extent), 1e-6f}) * 1.0001f;
+
+        constexpr auto cells = static_cast<float>((1u << morton_64_axis_bits) - 1);
+        auto scale = cells / root_width;
+
+        codes.resize(count);
+        os::parallel_for(0, count, [&, scale](uint32_t i)
+        {
+            auto q = (XMLoadFloat3(&positions[i]) - lo) * scale;
+            codes[i] = morton_code_64(static_cast<uint32_t>(XMVectorGetX(q)),
+                                      static_cast<uint32_t>(XMVectorGetY(q)),
+                                      static_cast<uint32_t>(XMVectorGetZ(q)));
+        });
+
+        radix_sort(codes, order, arena);
+    }
+
+    auto padded = count + simd_width - 1;
+    for (auto v : {&x, &y, &z, &m})
+    {
+        v->assign(padded, 0.0f);
+    }
+
+    os::parallel_for(0, count, [&](uint32_t i)
+    {
+        auto &p = positions[order[i]];
+        x[i] = p.x;
+        y[i] = p.y;
+        z[i] = p.z;
+        m[i] = masses[order[i]];
+    });
+}
+
+void n_body_gravity::build_tree(frame_arena &arena)
+{
+    auto count = static_cast<uint32_t>(body_ids.size());
+    auto allocator = arena_allocator<node>(arena);
+
+    nodes.clear();
+    nodes.push_back(make_node(0, count, root_width));
+    if (count <= leaf_size)
+    {
+        return;
+    }
+
+    // Split the root here, then build each octant's subtree in parallel
+    auto top = arena_vector<node>(allocator);
+    top.push_back(nodes.front());
+    split_node(top, 0, 0);
+
+    auto &root = top.front();
+    auto subtrees = arena_vector<arena_vector<node>>(arena_allocator<arena_vector<node>>(arena));
+    for (auto o = 0u; o < root.child_count; o++)
+    {
+        subtrees.emplace_back(allocator);
+    }
+
+    os::parallel_for(0, root.child_count, [&](uint32_t o)
+    {
+        auto &tree = subtrees[o];
+        tree.push_back(top[root.first_child + o]);
+        build_subtree(tree, 0, 1);
+    }, 1);
+
+    // Flatten, child links in a subtree are local with the subtree root at 0
+    nodes.front() = root;
+    nodes.resize(1 + root.child_count);
+    for (auto o = 0u; o < subtrees.size(); o++)
+    {
+        auto &tree = subtrees[o];
+        auto base = static_cast<uint32_t>(nodes.size());
+
+        auto relink = [base](node nd)
+        {
+            if (nd.child_count > 0)
+            {
+                nd.first_child = base + nd.first_child - 1;
+            }
+            return nd;
+        };
+
+        nodes[root.first_child + o] = relink(tree.front());
+        std::transform(std::begin(tree) + 1, std::end(tree), std::back_inserter(nodes), relink);
+    }
+}
+
+auto n_body_gravity::make_node(uint32_t first, uint32_t count, float width) const -> node
+{
+    auto mass = 0.0f;
+    auto weighted = XMVectorZero();
+    for (auto i = first; i < first + count; i++)
+    {
+        mass += m[i];
+        weighted += XMVectorSet(x[i], y[i], z[i], 0.0f) * m[i];
+    }
+
+    auto com = XMFLOAT3{};
+    XMStoreFloat3(&com, mass > 0.0f ? weighted / mass : XMVectorSet(x[first], y[first], z[first], 0.0f));
+
+    return node
+    {
+        .centre_of_mass = com,
+        .mass = mass,
+        .width = width,
+        .first_child = 0,
+        .child_count = 0,
+        .first_body = first,
+        .body_count = count,
+    };
+}
+
+void n_body_gravity::split_node(arena_vector<node> &tree, uint32_t index, uint32_t depth) const
+{
+    // Bodies of a node share a Morton prefix, the next 3 bits pick the octant
+    auto shift = 3 * (max_depth - depth - 1);
+    auto octant_of = [&, shift](uint32_t i)
+    {
+        return (codes[i] >> shift) & 0b111;
+    };
+
+    auto parent = tree[index];
+    auto first_child = static_cast<uint32_t>(tree.size());
+    auto end = parent.first_body + parent.body_count;
+
+    for (auto first = parent.first_body; first < end;)
+    {
+        auto octant = octant_of(first);
+        auto it = std::partition_point(std::begin(body_ids) + first, std::begin(body_ids) + end, [&](uint32_t i)
+        {
+            return octant_of(i) == octant;
+        });
+        auto last = static_cast<uint32_t>(std::distance(std::begin(body_ids), it));
+
+        tree.push_back(make_node(first, last - first, parent.width * 0.5f));
+        first = last;
+    }
+
+    tree[index].first_child = first_child;
+    tree[index].child_count = static_cast<uint32_t>(tree.size()) - first_child;
+}
+
+void n_body_gravity::build_subtree(arena_vector<node> &tree, uint32_t index, uint32_t depth) const
+{
+    if (tree[index].body_count <= leaf_size or depth >= max_depth)
+    {
+        return;
+    }
+
+    split_node(tree, index, depth);
+
+    auto first_child = tree[index].first_child,
+         child_count = tree[index].child_count;
+    for (auto c = first_child; c < first_child + child_count; c++)
+    {
+        build_subtree(tree, c, depth + 1);
+    }
+}
+
+auto n_body_gravity::sum_range(FXMVECTOR position, uint32_t first, uint32_t last) const -> XMVECTOR
+{
+    auto eps = XMVectorReplicate(softening_sq);
+    auto px = XMVectorSplatX(position),
+         py = XMVectorSplatY(position),
+         pz = XMVectorSplatZ(position);
+    auto ax = XMVectorZero(),
+         ay = XMVectorZero(),
+         az = XMVectorZero();
+
+    for (auto j = first; j < last; j += simd_width)
+    {
+        auto dx = load4(x, j) - px,
+             dy = load4(y, j) - py,
+             dz = load4(z, j) - pz;
+        auto r2 = dx * dx + dy * dy + dz * dz;
+
+        // Skip self and lanes past the end
+        auto valid = XMVectorAndInt(XMVectorGreater(r2, XMVectorZero()), lane_mask(last - j));
+
+        auto inv_r = XMVectorReciprocalSqrt(r2 + eps);
+        auto s = load4(m, j) * inv_r * inv_r * inv_r;
+
+        ax += XMVectorSelect(XMVectorZero(), dx * s, valid);
+        ay += XMVectorSelect(XMVectorZero(), dy * s, valid);
+        az += XMVectorSelect(XMVectorZero(), dz * s, valid);
+    }
+
+    return XMVectorSet(horizontal_sum(ax), horizontal_sum(ay), horizontal_sum(az), 0.0f);
+}
+
+auto n_body_gravity::sum_tree(FXMVECTOR position) const -> XMVECTOR
+{
+    auto theta_sq = opening_angle * opening_angle;
+    auto acceleration = XMVectorZero();
+
+    auto stack = std::array<uint32_t, max_stack>{};
+    auto top = 0u;
+    stack[top++] = 0;
+
+    while (top > 0)
+    {
+        auto &nd = nodes[stack[--top]];
+
+        if (nd.child_count == 0)
+        {
+            acceleration += sum_range(position, nd.first_body, nd.first_body + nd.body_count);
+            continue;
+        }
+
+        auto d = XMLoadFloat3(&nd.centre_of_mass) - position;
+        auto dist_sq = XMVectorGetX(XMVector3LengthSq(d));
+
+        // Far enough away, treat the whole cell as one point mass
+        if (nd.width * nd.width < theta_sq * dist_sq)
+        {
+            auto inv_r = 1.0f / std::sqrt(dist_sq + softening_sq);
+            acceleration += d * (nd.mass * inv_r * inv_r * inv_r);
+            continue;
+        }
+
+        for (auto c = nd.first_child; c < nd.first_child + nd.child_count; c++)
+        {
+            stack[top++] = c;
+        }
+    }
+
+    return acceleration;
+}
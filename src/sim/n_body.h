@@ -0,0 +1,71 @@
+#pragma once
+
+#include "frame_arena.h"
+
+namespace sim
+{
+    // Mutual gravitation between bodies.
+    // Builds a Barnes-Hut octree over Morton sorted bodies every call,
+    // below the direct sum threshold sums all pairs instead.
+    class n_body_gravity
+    {
+    public:
+        struct desc
+        {
+            float gravitational_constant = 1.0f;
+            float opening_angle = 0.5f;
+            float softening = 0.01f;
+            uint32_t direct_sum_threshold = 1024;
+        };
+
+    public:
+        n_body_gravity() = delete;
+        n_body_gravity(const desc &description);
+        ~n_body_gravity();
+
+        void compute_accelerations(const std::vector<DirectX::XMFLOAT3> &positions,
+                                   const std::vector<float> &masses,
+                                   std::vector<DirectX::XMFLOAT3> &accelerations,
+                                   frame_arena &arena);
+
+    private:
+        struct node
+        {
+            DirectX::XMFLOAT3 centre_of_mass;
+            float mass;
+            float width;
+            uint32_t first_child;
+            uint32_t child_count;
+            uint32_t first_body;
+            uint32_t body_count;
+        };
+
+        void load_bodies(const std::vector<DirectX::XMFLOAT3> &positions,
+                         const std::vector<float> &masses,
+                         bool morton_sort,
+                         frame_arena &arena);
+        void build_tree(frame_arena &arena);
+        auto make_node(uint32_t first, uint32_t count, float width) const -> node;
+        void split_node(arena_vector<node> &tree, uint32_t index, uint32_t depth) const;
+        void build_subtree(arena_vector<node> &tree, uint32_t index, uint32_t depth) const;
+
+        auto sum_range(DirectX::FXMVECTOR position, uint32_t first, uint32_t last) const -> DirectX::XMVECTOR;
+        auto sum_tree(DirectX::FXMVECTOR position) const -> DirectX::XMVECTOR;
+
+    private:
+        float gravitational_constant{},
+              opening_angle{},
+              softening_sq{};
+        uint32_t direct_sum_threshold{};
+
+        std::vector<uint32_t> body_ids{};
+        std::vector<uint32_t> order{};
+        std::vector<uint64_t> codes{};
+
+        // Bodies in sorted order, padded by a SIMD width with zero mass
+        std::vector<float> x{}, y{}, z{}, m{};
+        float root_width{};
+
+        std::vector<node> nodes{};
+    };
+}
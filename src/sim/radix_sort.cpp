@@ -0,0 +1,128 @@
+#include "radix_sort.h"
+
+#include "../os/job_system.h"
+
+using namespace sim;
+
+namespace
+{
+    constexpr auto radix_bits = 8u;
+    constexpr auto radix = 1u << radix_bits;
+    constexpr auto digit_mask = radix - 1;
+    constexpr auto block_size = 4096u;
+
+    static_assert(radix_sort_passes * radix_bits == 32);
+    static_assert(radix_sort_passes_64 * radix_bits == 64);
+
+    template <typename key_t>
+    auto sort_pass(std::span<const key_t> keys, std::span<const uint32_t> values,
+                   std::span<key_t> keys_out, std::span<uint32_t> values_out,
+                   uint32_t pass, frame_arena &arena) -> bool
+    {
+        assert(keys.size() == values.size() and keys_out.size() >= keys.size() and values_out.size() >= keys.size());
+
+        auto count = static_cast<uint32_t>(keys.size());
+        auto shift = pass * radix_bits;
+        auto block_count = (count + block_size - 1) / block_size;
+        auto offsets = arena.allocate_array<uint32_t>(block_count * radix);
+
+        os::parallel_for(0, block_count, [&, shift](uint32_t b)
+        {
+            auto histogram = offsets.subspan(b * radix, radix);
+            for (auto i = b * block_size; i < std::min((b + 1) * block_size, count); i++)
+            {
+                histogram[(keys[i] >> shift) & digit_mask]++;
+            }
+        }, 1);
+
+        // Digit major, so a block scatters each digit after the earlier blocks' keys with that digit
+        auto total = 0u;
+        auto one_digit = false;
+        for (auto d = 0u; d < radix; d++)
+        {
+            auto digit_start = total;
+            for (auto b = 0u; b < block_count; b++)
+            {
+                auto n = offsets[b * radix + d];
+                offsets[b * radix + d] = total;
+                total += n;
+            }
+            one_digit = one_digit or total - digit_start == count;
+        }
+
+        if (one_digit)
+        {
+            return false;
+        }
+
+        os::parallel_for(0, block_count, [&, shift](uint32_t b)
+        {
+            auto next = offsets.subspan(b * radix, radix);
+            for (auto i = b * block_size; i < std::min((b + 1) * block_size, count); i++)
+            {
+                auto to = next[(keys[i] >> shift) & digit_mask]++;
+                keys_out[to] = keys[i];
+                values_out[to] = values[i];
+            }
+        }, 1);
+
+        return true;
+    }
+
+    template <typename key_t>
+    void sort_by_digits(std::span<key_t> keys, std::span<uint32_t> values, frame_arena &arena)
+    {
+        assert(keys.size() == values.size());
+
+        auto count = keys.size();
+        if (count < 2)
+        {
+            return;
+        }
+
+        auto src_keys = keys;
+        auto src_values = values;
+        auto dst_keys = arena.allocate_array<key_t>(count);
+        auto dst_values = arena.allocate_array<uint32_t>(count);
+
+        for (auto pass = 0u; pass < sizeof(key_t) * 8 / radix_bits; pass++)
+        {
+            if (sort_pass<key_t>(src_keys, src_values, dst_keys, dst_values, pass, arena))
+            {
+                std::swap(src_keys, dst_keys);
+                std::swap(src_values, dst_values);
+            }
+        }
+
+        // An odd number of passes ran, the result is in the scratch buffers
+        if (src_keys.data() != keys.data())
+        {
+            std::copy(std::begin(src_keys), std::end(src_keys), std::begin(keys));
+            std::copy(std::begin(src_values), std::end(src_values), std::begin(values));
+        }
+    }
+}
+
+void sim::radix_sort(std::span<uint32_t> keys, std::span<uint32_t> values, frame_arena &arena)
+{
+    sort_by_digits(keys, values, arena);
+}
+
+void sim::radix_sort(std::span<uint64_t> keys, std::span<uint32_t> values, frame_arena &arena)
+{
+    sort_by_digits(keys, values, arena);
+}
+
+auto sim::radix_sort_pass(std::span<const uint32_t> keys, std::span<const uint32_t> values,
+                          std::span<uint32_t> keys_out, std::span<uint32_t> values_out,
+                          uint32_t pass, frame_arena &arena) -> bool
+{
+    return sort_pass(keys, values, keys_out, values_out, pass, arena);
+}
+
+auto sim::radix_sort_pass(std::span<const uint64_t> keys, std::span<const uint32_t> values,
+                          std::span<uint64_t> keys_out, std::span<uint32_t> values_out,
+                          uint32_t pass, frame_arena &arena) -> bool
+{
+    return sort_pass(keys, values, keys_out, values_out, pass, arena);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "frame_arena.h"
+
+namespace sim
+{
+    constexpr auto radix_sort_passes = 4u;
+    constexpr auto radix_sort_passes_64 = 8u;
+
+    // Stable LSD radix sort of values by their 32 or 64 bit keys, both sorted in place.
+    // Each pass histograms and scatters fixed size blocks in parallel, passes
+    // where every key has the same digit are skipped. Scratch comes from the arena.
+    void radix_sort(std::span<uint32_t> keys, std::span<uint32_t> values, frame_arena &arena);
+    void radix_sort(std::span<uint64_t> keys, std::span<uint32_t> values, frame_arena &arena);
+
+    // One pass of the sort, for callers that spread it over frames. Scatters keys and
+    // values by digit pass into keys_out and values_out, or returns false without
+    // writing when every key has the same digit. Only the histograms use the arena.
+    auto radix_sort_pass(std::span<const uint32_t> keys, std::span<const uint32_t> values,
+                         std::span<uint32_t> keys_out, std::span<uint32_t> values_out,
+                         uint32_t pass, frame_arena &arena) -> bool;
+    auto radix_sort_pass(std::span<const uint64_t> keys, std::span<const uint32_t> values,
+                         std::span<uint64_t> keys_out, std::span<uint32_t> values_out,
+                         uint32_t pass, frame_arena &arena) -> bool;
+}
@@ -1,11 +1,17 @@
 #include "sim_data.h"
 
-#include "../gfx/gpu_data.h"
+#include "../gfx/render_data.h"
+#include "../os/job_system.h"
 
 using namespace sim;
 using namespace gfx;
 using namespace DirectX;
 
+namespace
+{
+    constexpr auto vertices_per_block = 4096u;
+}
+
 auto sim::make_bounding_box(const gfx::mesh &model) -> std::array<DirectX::XMFLOAT3, 2>
 {
     auto min_vertex = [](const XMFLOAT3 &a, const vertex &v_b)
@@ -31,17 +37,63 @@ auto sim::make_bounding_box(const gfx::mesh &model) -> std::array<DirectX::XMFLO
         };
     };
 
-    return
+    // Each block of vertices is bounded on the job pool, then the blocks are merged
+    auto count = static_cast<uint32_t>(model.vertices.size());
+    auto block_count = (count + vertices_per_block - 1) / vertices_per_block;
+    auto block_bounds = std::vector<std::array<XMFLOAT3, 2>>(block_count);
+
+    os::parallel_for(0, block_count, [&](uint32_t b)
     {
-        std::accumulate(std::begin(model.vertices), std::end(model.vertices), XMFLOAT3{0.0f, 0.0f, 0.0f}, min_vertex),
-        std::accumulate(std::begin(model.vertices), std::end(model.vertices), XMFLOAT3{0.0f, 0.0f, 0.0f}, max_vertex),
-    }; 
+        auto first = std::begin(model.vertices) + b * vertices_per_block;
+        auto last = std::begin(model.vertices) + std::min((b + 1) * vertices_per_block, count);
+        block_bounds[b] =
+        {
+            std::accumulate(first, last, XMFLOAT3{0.0f, 0.0f, 0.0f}, min_vertex),
+            std::accumulate(first, last, XMFLOAT3{0.0f, 0.0f, 0.0f}, max_vertex),
+        };
+    }, 1);
+
+    auto bounds = std::array{XMFLOAT3{0.0f, 0.0f, 0.0f}, XMFLOAT3{0.0f, 0.0f, 0.0f}};
+    for (auto &block : block_bounds)
+    {
+        bounds[0] = min_vertex(bounds[0], {.position = block[0]});
+        bounds[1] = max_vertex(bounds[1], {.position = block[1]});
+    }
+    return bounds;
+}
+
+auto sim::inverse_inertia(float mass, const std::array<XMFLOAT3, 2> &bounding_box) -> XMFLOAT3
+{
+    // Solid box filling the bounding box, diagonal in body space
+    auto size = XMLoadFloat3(&bounding_box[1]) - XMLoadFloat3(&bounding_box[0]);
+    auto sq = size * size;
+    auto x = XMVectorGetX(sq),
+         y = XMVectorGetY(sq),
+         z = XMVectorGetZ(sq);
+
+    auto inverse = [&](float a, float b)
+    {
+        auto i = mass * (a + b) / 12.0f;
+        return i > 0.0f ? 1.0f / i : 0.0f;
+    };
+
+    return {inverse(y, z), inverse(x, z), inverse(x, y)};
 }
 
 void sim::update_transforms(const rigid_body &body, gfx::matrix &transform)
 {
     auto pos = XMLoadFloat3(&body.position);
+    auto rot = XMLoadFloat4(&body.orientation);
+
+    transform.data = XMMatrixRotationQuaternion(rot) * XMMatrixTranslationFromVector(pos);
+    transform.data = XMMatrixTranspose(transform.data);
+}
 
-    transform.data = XMMatrixTranslationFromVector(pos);
+void sim::update_transforms(const rigid_body &body, const XMFLOAT3 &offset, gfx::matrix &transform)
+{
+    auto pos = XMLoadFloat3(&body.position) + XMLoadFloat3(&offset);
+    auto rot = XMLoadFloat4(&body.orientation);
+
+    transform.data = XMMatrixRotationQuaternion(rot) * XMMatrixTranslationFromVector(pos);
     transform.data = XMMatrixTranspose(transform.data);
-}
\ No newline at end of file
+}
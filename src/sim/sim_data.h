@@ -8,14 +8,39 @@ namespace gfx
 
 namespace sim
 {
+    // Position in a large world, see simulation::use_floating_origin
+    struct world_position
+    {
+        double x{}, y{}, z{};
+    };
+
     struct rigid_body
     {
         DirectX::XMFLOAT3 position;
         DirectX::XMFLOAT3 velocity;
 
         std::array<DirectX::XMFLOAT3, 2> bounding_box;
+
+        float mass{1.0f};
+
+        DirectX::XMFLOAT4 orientation{0.0f, 0.0f, 0.0f, 1.0f};
+        DirectX::XMFLOAT3 angular_velocity{};
+
+        // Scales the distance simulation LOD sees, above 1 keeps the body at a higher rate
+        float importance{1.0f};
+
+        // Two bodies can collide only when each one's layer is in the other's mask
+        uint32_t collision_layer{1};
+        uint32_t collision_mask{~0u};
+
+        // Sensor volume, reports overlaps through trigger events and never collides
+        bool trigger{false};
     };
 
     auto make_bounding_box(const gfx::mesh &model) -> std::array<DirectX::XMFLOAT3, 2>;
+    auto inverse_inertia(float mass, const std::array<DirectX::XMFLOAT3, 2> &bounding_box) -> DirectX::XMFLOAT3;
     void update_transforms(const rigid_body &body, gfx::matrix &transform);
+
+    // Relative to a camera, offset is simulation::offset_from(eye)
+    void update_transforms(const rigid_body &body, const DirectX::XMFLOAT3 &offset, gfx::matrix &transform);
 };
\ No newline at end of file
@@ -0,0 +1,145 @@
+#include "sim_thread.h"
+
+#include "../os/profiler.h"
+
+using namespace sim;
+using namespace DirectX;
+
+sim_thread::sim_thread(simulation &sim_, const desc &desc_) :
+    sim{sim_},
+    step_dt{1.0 / desc_.step_rate},
+    max_steps_per_tick{desc_.max_steps_per_tick},
+    pacer{{.target_rate = desc_.step_rate}}
+{ }
+
+sim_thread::~sim_thread()
+{
+    stop();
+}
+
+void sim_thread::start()
+{
+    assert(not thread.joinable());
+
+    thread = std::jthread([this](std::stop_token stop)
+    {
+        run(stop);
+    });
+}
+
+void sim_thread::stop()
+{
+    if (thread.joinable())
+    {
+        thread.request_stop();
+        thread.join();
+    }
+}
+
+void sim_thread::submit(command cmd)
+{
+    auto lock = std::lock_guard{command_mutex};
+    pending.push_back(std::move(cmd));
+}
+
+auto sim_thread::track(body_handle body) -> uint32_t
+{
+    auto slot = slot_count++;
+    submit([this, body, slot](simulation &)
+    {
+        tracked.emplace_back(body, slot);
+    });
+    return slot;
+}
+
+auto sim_thread::transforms() -> gfx::transform_buffer &
+{
+    return published;
+}
+
+void sim_thread::run(std::stop_token stop)
+{
+    using hrc = std::chrono::steady_clock;
+
+    auto step_duration = std::chrono::duration_cast<hrc::duration>(std::chrono::duration<double>(step_dt));
+    auto next_step = hrc::now();
+
+    PROFILE_THREAD("simulation");
+
+    while (not stop.stop_requested())
+    {
+        run_commands();
+        tick_clock.tick();
+
+        auto now = hrc::now();
+        auto steps = 0u;
+        while (next_step <= now and steps < max_steps_per_tick)
+        {
+            sim.step(step_dt);
+            next_step += step_duration;
+            steps++;
+        }
+
+        // Too far behind, drop the backlog rather than spiral
+        if (next_step <= now)
+        {
+            next_step = now + step_duration;
+        }
+
+        if (steps > 0)
+        {
+            // The last step ran ahead to next_step, blend back from it to now
+            auto behind = std::chrono::duration<double>(next_step - now).count() / step_dt;
+            publish_transforms(static_cast<float>(std::clamp(1.0 - behind, 0.0, 1.0)));
+            sim.maintain(tick_clock);
+        }
+
+        // sleep_until alone wakes up to a scheduler tick late
+        pacer.wait_until(next_step);
+    }
+}
+
+void sim_thread::run_commands()
+{
+    {
+        // Never wait on the main thread, pick the commands up next step instead
+        auto lock = std::unique_lock{command_mutex, std::try_to_lock};
+        if (not lock.owns_lock())
+        {
+            return;
+        }
+        std::swap(pending, running);
+    }
+
+    for (auto &cmd : running)
+    {
+        cmd(sim);
+    }
+    running.clear();
+}
+
+void sim_thread::publish_transforms(float alpha)
+{
+    PROFILE_ZONE("publish transforms");
+
+    auto &bodies = sim.body_store();
+    batch.update(bodies, alpha);
+
+    auto matrices = batch.matrices();
+    auto &frame = published.back();
+    frame.resize(tracked.size());
+
+    for (auto &[body, slot] : tracked)
+    {
+        // Removed bodies collapse to nothing rather than show a stale pose
+        if (not bodies.is_valid(body))
+        {
+            frame[slot].data = XMMatrixScaling(0.0f, 0.0f, 0.0f);
+            continue;
+        }
+
+        frame[slot] = matrices[bodies.index_of(body)];
+    }
+
+    published.publish();
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "simulation.h"
+#include "transform_batch.h"
+
+#include "../gfx/render_data.h"
+#include "../os/frame_pacer.h"
+
+namespace sim
+{
+    // Runs a simulation on its own thread at a fixed step rate.
+    // After every step the tracked bodies' transforms, interpolated to the
+    // time they are published, go to a triple buffer for the renderer, so
+    // neither thread waits on the other.
+    // Everything else that touches the simulation goes through submit().
+    class sim_thread
+    {
+    public:
+        using command = std::function<void(simulation &)>;
+
+        struct desc
+        {
+            double step_rate = 120.0;
+            uint32_t max_steps_per_tick = 4;
+        };
+
+    public:
+        sim_thread() = delete;
+        sim_thread(simulation &sim, const desc &description);
+        ~sim_thread();
+
+        void start();
+        void stop();
+
+        // Runs on the sim thread before its next step
+        void submit(command cmd);
+
+        // Reserves a slot in the published transforms for this body
+        auto track(body_handle body) -> uint32_t;
+
+        auto transforms() -> gfx::transform_buffer &;
+
+    private:
+        void run(std::stop_token stop);
+        void run_commands();
+        void publish_transforms(float alpha);
+
+    private:
+        simulation &sim;
+        double step_dt{};
+        uint32_t max_steps_per_tick{};
+        os::frame_pacer pacer;
+        os::clock tick_clock{};    // times the maintenance budget after each batch of steps
+
+        std::mutex command_mutex{};
+        std::vector<command> pending{};
+        std::vector<command> running{};
+
+        std::atomic<uint32_t> slot_count{};
+        std::vector<std::pair<body_handle, uint32_t>> tracked{};
+        transform_batch batch{};
+
+        gfx::transform_buffer published{};
+
+        std::jthread thread{};
+    };
+}
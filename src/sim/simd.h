@@ -0,0 +1,30 @@
+#pragma once
+
+// Helpers for running DirectXMath vectors across 4 entries of SoA float arrays.
+// Arrays read with load4 must be padded by simd_width - 1 entries.
+namespace sim::simd
+{
+    constexpr auto simd_width = 4u;
+
+    inline auto load4(const std::vector<float> &v, uint32_t i) -> DirectX::XMVECTOR
+    {
+        return DirectX::XMLoadFloat4(reinterpret_cast<const DirectX::XMFLOAT4 *>(&v[i]));
+    }
+
+    inline void store4(std::vector<float> &v, uint32_t i, DirectX::FXMVECTOR x)
+    {
+        DirectX::XMStoreFloat4(reinterpret_cast<DirectX::XMFLOAT4 *>(&v[i]), x);
+    }
+
+    inline auto horizontal_sum(DirectX::FXMVECTOR v) -> float
+    {
+        return DirectX::XMVectorGetX(DirectX::XMVector4Dot(v, DirectX::XMVectorSplatOne()));
+    }
+
+    // Lanes [0, remaining) are valid
+    inline auto lane_mask(uint32_t remaining) -> DirectX::XMVECTOR
+    {
+        static const auto lane_index = DirectX::XMVectorSet(0.0f, 1.0f, 2.0f, 3.0f);
+        return DirectX::XMVectorLess(lane_index, DirectX::XMVectorReplicate(static_cast<float>(remaining)));
+    }
+}
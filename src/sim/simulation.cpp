@@ -1,47 +1,700 @@
 #include "simulation.h"
 
+#include "../os/profiler.h"
+#include "../os/job_system.h"
+
+#include "morton.h"
+#include "radix_sort.h"
+
+#include <cmath>
+
 using namespace sim;
 using namespace DirectX;
 
+namespace
+{
+	constexpr auto bounds_block = 4096u;
+
+	// Re-sort once this fraction of neighbouring pairs are out of order
+	constexpr auto reorder_disorder = 1.0f / 16.0f;
+
+	// Bodies per bounds or codes slice
+	constexpr auto reorder_chunk = 65536u;
+
+	// Moving out a tier takes this much more distance than moving back in, so bodies on the edge stay put
+	constexpr auto lod_hysteresis = 1.1f;
+
+	// Refits loosen the query tree as bodies move, rebuild it this often
+	constexpr auto query_tree_rebuild_interval = 30u;
+	constexpr auto query_tree_nodes_per_slice = 256u;
+}
+
 simulation::simulation(const XMFLOAT3 &gravity_vector) :
-	gravity{gravity_vector}
+	simulation(gravity_vector, frame_arena::desc{})
 { }
 
+simulation::simulation(const XMFLOAT3 &gravity_vector, const frame_arena::desc &arena_settings) :
+	gravity{gravity_vector},
+	arena{arena_settings},
+	upkeep{{}}
+{
+	reorder_task = upkeep.add_task("reorder bodies", [this]()
+	{
+		return reorder_slice();
+	});
+	query_tree_task = upkeep.add_task("rebuild query tree", [this]()
+	{
+		return rebuild_query_tree_slice();
+	});
+}
+
 simulation::~simulation() = default;
 
-void simulation::add_body(rigid_body &body)
+auto simulation::add_body(const rigid_body &body) -> body_handle
+{
+	query_tree_dirty = true;
+	body_set_version++;
+	auto handle = bodies.add(body);
+	discard_staged_reorder();
+
+	// Reorder scratch and both trees grow with the store, so maintenance never allocates
+	for (auto v : {&reorder.codes, &reorder.order, &reorder.sorted_codes, &reorder.sorted_order})
+	{
+		v->resize(bodies.size());
+	}
+	query_tree.reserve(bodies.size());
+	next_query_tree.reserve(bodies.size());
+	return handle;
+}
+
+auto simulation::remove_body(body_handle body) -> bool
+{
+	query_tree_dirty = true;
+	body_set_version++;
+	discard_staged_reorder();
+	return bodies.remove(body);
+}
+
+auto simulation::get_body(body_handle body) const -> rigid_body
+{
+	return bodies.get(body);
+}
+
+void simulation::set_body(body_handle body, const rigid_body &state)
 {
-	bodies.push_back(&body);
+	query_tree_moved = true;
+	bodies.set(body, state);
+	discard_staged_reorder();
+}
+
+auto simulation::body_store() const -> const body_registry &
+{
+	return bodies;
+}
+
+void simulation::add_soft_body(soft_body &body)
+{
+	soft_bodies.push_back(&body);
+}
+
+void simulation::add_fluid(fluid &body)
+{
+	fluids.push_back(&body);
+}
+
+auto simulation::add_joint(const joint_system::desc &joint) -> uint32_t
+{
+	return joints.add_joint(joint, bodies);
+}
+
+auto simulation::is_joint_broken(uint32_t joint) const -> bool
+{
+	return joints.is_broken(joint);
 }
 
 void simulation::change_gravity(const DirectX::XMFLOAT3 &gravity_vector)
 {
 	gravity = gravity_vector;
+	n_body.reset();
+}
+
+void simulation::use_n_body_gravity(const n_body_gravity::desc &settings)
+{
+	n_body = std::make_unique<n_body_gravity>(settings);
+}
+
+void simulation::use_floating_origin(float distance)
+{
+	rebase_distance = distance;
+}
+
+void simulation::set_focus(const world_position &focus)
+{
+	focus_point = focus;
+}
+
+auto simulation::origin() const -> world_position
+{
+	return world_origin;
+}
+
+auto simulation::to_local(const world_position &position) const -> XMFLOAT3
+{
+	return
+	{
+		static_cast<float>(position.x - world_origin.x),
+		static_cast<float>(position.y - world_origin.y),
+		static_cast<float>(position.z - world_origin.z),
+	};
+}
+
+auto simulation::to_world(const XMFLOAT3 &position) const -> world_position
+{
+	return
+	{
+		world_origin.x + position.x,
+		world_origin.y + position.y,
+		world_origin.z + position.z,
+	};
+}
+
+auto simulation::world_position_of(body_handle body) const -> world_position
+{
+	return to_world(bodies.get(body).position);
+}
+
+auto simulation::offset_from(const world_position &eye) const -> XMFLOAT3
+{
+	return
+	{
+		static_cast<float>(world_origin.x - eye.x),
+		static_cast<float>(world_origin.y - eye.y),
+		static_cast<float>(world_origin.z - eye.z),
+	};
+}
+
+void simulation::use_lod(const lod_desc &settings)
+{
+	lod = settings;
+	lod_enabled = true;
+}
+
+void simulation::set_reorder_interval(uint32_t steps)
+{
+	reorder_interval = steps;
+	steps_since_reorder = 0;
+}
+
+void simulation::maintain(const os::clock &clk)
+{
+	PROFILE_ZONE("simulation::maintain");
+	upkeep.run(clk);
+}
+
+auto simulation::maintenance() -> os::budget_scheduler &
+{
+	return upkeep;
 }
 
 void simulation::update(const os::clock &clk)
 {
-    using namespace DirectX;
+	PROFILE_ZONE("simulation::update");
+
 	using sec = std::ratio<1>;
 
-    auto dt = clk.delta<sec>();
-	auto tt = clk.count<sec>();
+	step(clk.delta<sec>());
+	maintain(clk);
+}
+
+void simulation::step(double dt)
+{
+	PROFILE_ZONE("simulation::step");
+
+	arena.reset();
+
+	if (rebase_distance > 0.0f)
+	{
+		rebase_origin();
+	}
+
+	if (reorder_interval > 0 and ++steps_since_reorder >= reorder_interval)
+	{
+		upkeep.wake(reorder_task);
+		steps_since_reorder = 0;
+	}
+
+	if (++steps_since_tree_build >= query_tree_rebuild_interval)
+	{
+		upkeep.wake(query_tree_task);
+		steps_since_tree_build = 0;
+	}
+
+	bodies.save_previous_pose();
+	query_tree_moved = true;
+
+	auto body_dt = std::span<const float>{};
+	if (lod_enabled)
+	{
+		PROFILE_ZONE("lod");
+		body_dt = lod_step_times(dt);
+	}
+
+	if (n_body)
+	{
+		PROFILE_ZONE("n-body gravity");
+		apply_n_body_gravity(dt, body_dt);
+	}
+	else
+	{
+		PROFILE_ZONE("gravity");
+		apply_gravity(dt, body_dt);
+	}
+
+	{
+		PROFILE_ZONE("joints");
+		joints.solve(bodies, dt, arena);
+	}
+
+	{
+		PROFILE_ZONE("integrate");
+		integrate_positions(dt, body_dt);
+	}
+
+	for (auto body : soft_bodies)
+	{
+		PROFILE_ZONE("soft body");
+		body->step(gravity, dt);
+	}
+
+	for (auto body : fluids)
+	{
+		PROFILE_ZONE("fluid");
+		body->step(gravity, dt, arena);
+	}
 
-	for (auto body : bodies)
 	{
-		apply_gravity(*body, dt);
-	}	
+		PROFILE_ZONE("triggers");
+		update_triggers();
+	}
+
+	step_index++;
+}
+
+auto simulation::trigger_events() const -> std::span<const trigger_event>
+{
+	return triggers.events();
+}
+
+auto simulation::arena_stats() const -> frame_arena::statistics
+{
+	return arena.stats();
+}
+
+void simulation::raycast(std::span<const ray> rays, std::span<ray_hit> hits)
+{
+	PROFILE_ZONE("simulation::raycast");
+	refresh_query_tree();
+	query_tree.cast(bodies, rays, hits);
+}
+
+void simulation::sphere_cast(std::span<const sphere_sweep> sweeps, std::span<ray_hit> hits)
+{
+	PROFILE_ZONE("simulation::sphere_cast");
+	refresh_query_tree();
+	query_tree.cast(bodies, sweeps, hits);
+}
+
+auto simulation::find_pairs() -> std::span<const body_pair>
+{
+	PROFILE_ZONE("simulation::find_pairs");
+	refresh_query_tree();
+	return query_tree.find_pairs(bodies, joints.excluded_pairs(arena), arena);
 }
 
-void simulation::apply_gravity(rigid_body &body, double dt)
+void simulation::apply_gravity(double dt, std::span<const float> body_dt)
 {
 	auto g = XMLoadFloat3(&gravity);
-	auto p = XMLoadFloat3(&body.position);
-	auto v = XMLoadFloat3(&body.velocity);
+	auto step = static_cast<float>(dt);
+
+	for (auto i = 0u; i < bodies.size(); i++)
+	{
+		auto h = body_dt.empty() ? step : body_dt[i];
+		auto &velocity = bodies.velocities[i];
+		XMStoreFloat3(&velocity, XMLoadFloat3(&velocity) + g * h);
+	}
+}
+
+void simulation::apply_n_body_gravity(double dt, std::span<const float> body_dt)
+{
+	n_body->compute_accelerations(bodies.positions, bodies.masses, n_body_accelerations, arena);
+
+	auto step = static_cast<float>(dt);
+
+	for (auto i = 0u; i < bodies.size(); i++)
+	{
+		auto h = body_dt.empty() ? step : body_dt[i];
+		auto a = XMLoadFloat3(&n_body_accelerations[i]);
+		auto v = XMLoadFloat3(&bodies.velocities[i]);
+
+		v = v + (a * h);
+
+		XMStoreFloat3(&bodies.velocities[i], v);
+	}
+}
+
+void simulation::integrate_positions(double dt, std::span<const float> body_dt)
+{
+	os::parallel_for(0, bodies.size(), [&, body_dt, step = static_cast<float>(dt)](uint32_t i)
+	{
+		auto h = body_dt.empty() ? step : body_dt[i];
+		if (h == 0.0f)
+		{
+			return;
+		}
+
+		auto p = XMLoadFloat3(&bodies.positions[i]);
+		auto v = XMLoadFloat3(&bodies.velocities[i]);
+		XMStoreFloat3(&bodies.positions[i], p + v * h);
+
+		// dq/dt = 0.5 * w * q
+		auto q = XMLoadFloat4(&bodies.orientations[i]);
+		auto w = XMVectorSetW(XMLoadFloat3(&bodies.angular_velocities[i]), 0.0f);
+		auto dq = XMQuaternionMultiply(q, w) * (0.5f * h);
+		XMStoreFloat4(&bodies.orientations[i], XMQuaternionNormalize(q + dq));
+	});
+}
+
+auto simulation::lod_step_times(double dt) -> std::span<const float>
+{
+	auto times = arena.allocate_array<float>(bodies.size());
+	auto focus = to_local(focus_point);
+
+	// Joints push every body they hold every step, a held body that skipped
+	// steps would integrate that accumulated push over its whole pending time
+	auto jointed = arena.allocate_array<uint8_t>(bodies.size());
+	joints.mark_jointed(bodies, jointed);
+
+	os::parallel_for(0, bodies.size(), [&, step = static_cast<float>(dt)](uint32_t i)
+	{
+		auto distance = XMVectorGetX(XMVector3Length(XMLoadFloat3(&bodies.positions[i]) - XMLoadFloat3(&focus)));
+		auto importance = bodies.importances[i];
+		auto seen = importance > 0.0f ? distance / importance : std::numeric_limits<float>::infinity();
+
+		auto tier = bodies.lod_tiers[i];
+		auto next = uint8_t{};
+		while (not jointed[i] and next < lod_tier_count - 1 and seen > lod.distances[next] * (next < tier ? 1.0f : lod_hysteresis))
+		{
+			next++;
+		}
+		bodies.lod_tiers[i] = next;
+
+		// Skipped time carries over a tier change, so a body never gains or loses time
+		auto pending = bodies.lod_pending[i] + step;
+		auto period = 1u << next;
+		if ((step_index + bodies.handle_of(i).slot) % period == 0)
+		{
+			times[i] = pending;
+			pending = 0.0f;
+		}
+		bodies.lod_pending[i] = pending;
+	});
+
+	return times;
+}
+
+void simulation::refresh_query_tree()
+{
+	if (query_tree_dirty or query_tree.body_count() != bodies.size())
+	{
+		PROFILE_ZONE("build query tree");
+		query_tree.build(bodies);
+		query_tree_dirty = false;
+		query_tree_moved = false;
+		steps_since_tree_build = 0;
+	}
+	else if (query_tree_moved)
+	{
+		PROFILE_ZONE("refit query tree");
+		query_tree.refit(bodies);
+		query_tree_moved = false;
+	}
+}
+
+auto simulation::rebuild_query_tree_slice() -> bool
+{
+	if (not query_tree_rebuilding)
+	{
+		next_query_tree.begin_build(bodies);
+		rebuild_version = body_set_version;
+		query_tree_rebuilding = true;
+		return true;
+	}
+
+	// Bodies came or went since it started, the next query builds in full anyway
+	if (rebuild_version != body_set_version)
+	{
+		query_tree_rebuilding = false;
+		return false;
+	}
+
+	if (next_query_tree.build_slice(query_tree_nodes_per_slice))
+	{
+		return true;
+	}
+
+	// Shaped by where bodies were when it started, boxes from where they are now
+	next_query_tree.refit(bodies);
+	std::swap(query_tree, next_query_tree);
+	query_tree_dirty = false;
+	query_tree_moved = false;
+	query_tree_rebuilding = false;
+	return false;
+}
+
+void simulation::update_triggers()
+{
+	auto sensors = arena.allocate_array<uint32_t>(bodies.size());
+	auto count = 0u;
+	for (auto i = 0u; i < bodies.size(); i++)
+	{
+		if (bodies.triggers[i])
+		{
+			sensors[count++] = i;
+		}
+	}
+
+	// Once the last trigger goes, one more update turns its overlaps into exits
+	if (count == 0 and triggers.overlap_count() == 0)
+	{
+		triggers.clear();
+		return;
+	}
+
+	refresh_query_tree();
+	triggers.update(bodies, query_tree.find_overlaps(sensors.first(count), arena), arena);
+}
+
+void simulation::discard_staged_reorder()
+{
+	// Staged arrays would miss the change, stage them again
+	if (reorder.phase == reorder_phase::apply)
+	{
+		reorder.cursor = 0;
+	}
+}
+
+void simulation::rebase_origin()
+{
+	auto distance = std::max({std::abs(focus_point.x - world_origin.x),
+	                          std::abs(focus_point.y - world_origin.y),
+	                          std::abs(focus_point.z - world_origin.z)});
+	if (distance <= rebase_distance)
+	{
+		return;
+	}
+
+	PROFILE_ZONE("rebase origin");
+
+	// On a power of two grid the shift is exact in float, so bodies near the focus lose nothing
+	auto grid = std::exp2(std::ceil(std::log2(static_cast<double>(rebase_distance))));
+	auto snap = [grid](double v)
+	{
+		return std::round(v / grid) * grid;
+	};
+	auto new_origin = world_position{snap(focus_point.x), snap(focus_point.y), snap(focus_point.z)};
+
+	auto shift = XMFLOAT3
+	{
+		static_cast<float>(world_origin.x - new_origin.x),
+		static_cast<float>(world_origin.y - new_origin.y),
+		static_cast<float>(world_origin.z - new_origin.z),
+	};
+	world_origin = new_origin;
+
+	bodies.translate(shift);
+	for (auto body : soft_bodies)
+	{
+		body->translate(shift);
+	}
+	for (auto body : fluids)
+	{
+		body->translate(shift);
+	}
+	joints.set_world_position(to_local({}));
+	query_tree_moved = true;
+}
+
+auto simulation::reorder_slice() -> bool
+{
+	auto &r = reorder;
+	auto count = bodies.size();
+
+	if (r.phase == reorder_phase::bounds and r.cursor == 0)
+	{
+		r.count = count;
+		r.out_of_order = 0;
+		r.lo = XMFLOAT3{std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
+		r.hi = XMFLOAT3{std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest()};
+		r.codes.resize(count);
+		r.order.resize(count);
+		r.sorted_codes.resize(count);
+		r.sorted_order.resize(count);
+	}
+
+	auto finish = [&r]()
+	{
+		r.phase = reorder_phase::bounds;
+		r.cursor = 0;
+		return false;
+	};
+
+	if (count < 2)
+	{
+		return finish();
+	}
+
+	// Bodies came or went between slices, start over
+	if (count != r.count)
+	{
+		r.phase = reorder_phase::bounds;
+		r.cursor = 0;
+		return true;
+	}
+
+	auto first = r.cursor;
+	auto last = std::min(first + reorder_chunk, count);
+	auto &positions = bodies.positions;
 
-	v = v + (g * static_cast<float>(dt));
-	p = p + (v * static_cast<float>(dt));
+	switch (r.phase)
+	{
+		case reorder_phase::bounds:
+		{
+			auto block_count = (last - first + bounds_block - 1) / bounds_block;
+			auto block_lo = arena.allocate_array<XMFLOAT3>(block_count);
+			auto block_hi = arena.allocate_array<XMFLOAT3>(block_count);
+			os::parallel_for(0, block_count, [&](uint32_t b)
+			{
+				auto block_min = XMVectorReplicate(std::numeric_limits<float>::max());
+				auto block_max = XMVectorReplicate(std::numeric_limits<float>::lowest());
+				for (auto i = first + b * bounds_block; i < std::min(first + (b + 1) * bounds_block, last); i++)
+				{
+					auto v = XMLoadFloat3(&positions[i]);
+					block_min = XMVectorMin(block_min, v);
+					block_max = XMVectorMax(block_max, v);
+				}
+				XMStoreFloat3(&block_lo[b], block_min);
+				XMStoreFloat3(&block_hi[b], block_max);
+			}, 1);
+
+			auto lo = XMLoadFloat3(&r.lo);
+			auto hi = XMLoadFloat3(&r.hi);
+			for (auto b = 0u; b < block_count; b++)
+			{
+				lo = XMVectorMin(lo, XMLoadFloat3(&block_lo[b]));
+				hi = XMVectorMax(hi, XMLoadFloat3(&block_hi[b]));
+			}
+			XMStoreFloat3(&r.lo, lo);
+			XMStoreFloat3(&r.hi, hi);
+
+			r.cursor = last;
+			if (last == count)
+			{
+				// 10 bits per axis over the cube around all bodies, finer does not help locality
+				auto extent = hi - lo;
+				auto width = std::max({XMVectorGetX(extent), XMVectorGetY(extent), XMVectorGetZ(extent), 1e-6f}) * 1.0001f;
+				r.scale = 1023.0f / width;
+				r.phase = reorder_phase::codes;
+				r.cursor = 0;
+			}
+			return true;
+		}
+
+		case reorder_phase::codes:
+		{
+			auto lo = XMLoadFloat3(&r.lo);
+			os::parallel_for(first, last, [&, lo](uint32_t i)
+			{
+				// Bodies may have left the bounds since they were measured, clamp rather than wrap
+				auto q = XMVectorClamp((XMLoadFloat3(&positions[i]) - lo) * r.scale, XMVectorZero(), XMVectorReplicate(1023.0f));
+				r.codes[i] = morton_code(static_cast<int32_t>(XMVectorGetX(q)),
+				                         static_cast<int32_t>(XMVectorGetY(q)),
+				                         static_cast<int32_t>(XMVectorGetZ(q)));
+				r.order[i] = i;
+			});
+
+			for (auto i = std::max(first, 1u); i < last; i++)
+			{
+				r.out_of_order += r.codes[i] < r.codes[i - 1] ? 1 : 0;
+			}
+
+			r.cursor = last;
+			if (last == count)
+			{
+				// Bodies only drift a little between checks, most of the time the store is still in order
+				if (r.out_of_order <= static_cast<uint32_t>(count * reorder_disorder))
+				{
+					return finish();
+				}
+				r.phase = reorder_phase::sort;
+				r.cursor = 0;
+			}
+			return true;
+		}
+
+		case reorder_phase::sort:
+		{
+			// A digit per slice, passes where every code has the same digit write nothing
+			if (radix_sort_pass(r.codes, r.order, r.sorted_codes, r.sorted_order, r.cursor, arena))
+			{
+				std::swap(r.codes, r.sorted_codes);
+				std::swap(r.order, r.sorted_order);
+			}
 
-	XMStoreFloat3(&body.velocity, v);
-	XMStoreFloat3(&body.position, p);
-}
\ No newline at end of file
+			if (++r.cursor == radix_sort_passes)
+			{
+				r.phase = reorder_phase::apply;
+				r.cursor = 0;
+				r.restaged = false;
+			}
+			return true;
+		}
+
+		case reorder_phase::apply:
+		{
+			// The store only changes order on commit, after the last array is staged
+			// in the same slice. Arrays a step writes go stale if a step comes between.
+			constexpr auto first_step_written = body_registry::first_step_written;
+			auto together = false;
+			if (r.cursor > first_step_written and r.staged_step != step_index)
+			{
+				together = r.restaged;
+				r.restaged = true;
+				r.cursor = first_step_written;
+			}
+			if (r.cursor == first_step_written)
+			{
+				r.staged_step = step_index;
+			}
+
+			auto last = together ? body_registry::reorder_array_count : r.cursor + 1;
+			for (auto a = r.cursor; a < last; a++)
+			{
+				bodies.stage_reorder(a, r.order);
+			}
+			r.cursor = last;
+
+			if (r.cursor < body_registry::reorder_array_count)
+			{
+				return true;
+			}
+
+			// Same bodies under new indices, a refit keeps queries right until the rebuild
+			bodies.commit_reorder();
+			query_tree_moved = true;
+			upkeep.wake(query_tree_task);
+			return finish();
+		}
+	}
+
+	return finish();
+}
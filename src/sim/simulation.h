@@ -1,29 +1,181 @@
 #pragma once
 
-#include "..\os\clock.h"
+#include "../os/clock.h"
+#include "../os/budget_scheduler.h"
 
 #include "sim_data.h"
+#include "body_registry.h"
+#include "broadphase.h"
+#include "soft_body.h"
+#include "fluid.h"
+#include "n_body.h"
+#include "joints.h"
+#include "triggers.h"
+#include "frame_arena.h"
 
 namespace sim
 {
     class simulation
     {
+    public:
+        static constexpr auto lod_tier_count = 3u;
+
+        struct lod_desc
+        {
+            // Bodies further than distances[t] from the focus, over their importance, drop below tier t
+            std::array<float, lod_tier_count - 1> distances{50.0f, 200.0f};
+        };
+
     public:
         simulation() = delete;
         simulation(const DirectX::XMFLOAT3 &gravity_vector);
+        simulation(const DirectX::XMFLOAT3 &gravity_vector, const frame_arena::desc &arena_settings);
         ~simulation();
 
-        void add_body(rigid_body &body);
+        auto add_body(const rigid_body &body) -> body_handle;
+        auto remove_body(body_handle body) -> bool;
+        auto get_body(body_handle body) const -> rigid_body;
+        void set_body(body_handle body, const rigid_body &state);
+        auto body_store() const -> const body_registry &;
+
+        void add_soft_body(soft_body &body);
+        void add_fluid(fluid &body);
+        auto add_joint(const joint_system::desc &joint) -> uint32_t;
+        auto is_joint_broken(uint32_t joint) const -> bool;
         void change_gravity(const DirectX::XMFLOAT3 &gravity_vector);
+        void use_n_body_gravity(const n_body_gravity::desc &settings);
+
+        // Large world mode. Bodies, joints, soft bodies and fluids stay in float
+        // relative to an origin kept in double. Once the focus, usually the
+        // camera, is further than rebase_distance from it on any axis, the
+        // origin moves onto the focus and everything shifts to match.
+        void use_floating_origin(float rebase_distance);
+        void set_focus(const world_position &focus);
+        auto origin() const -> world_position;
+        auto to_local(const world_position &position) const -> DirectX::XMFLOAT3;
+        auto to_world(const DirectX::XMFLOAT3 &position) const -> world_position;
+        auto world_position_of(body_handle body) const -> world_position;
+
+        // Add to positions to make them relative to eye, for camera relative transforms
+        auto offset_from(const world_position &eye) const -> DirectX::XMFLOAT3;
+
+        // Simulation LOD. Tier t bodies move every 2^t steps by the time they skipped,
+        // staggered by slot so every step moves a similar share. Measured from the focus.
+        // Bodies held by a joint stay at full rate, joints solve them every step.
+        void use_lod(const lod_desc &settings);
+
+        // How many steps between checks whether the body store has drifted out of Morton order, 0 turns it off
+        void set_reorder_interval(uint32_t steps);
+
+        // Upkeep that need not happen every step, like reordering, done in
+        // slices within the scheduler's budget. update() calls it after stepping.
+        void maintain(const os::clock &clk);
+        auto maintenance() -> os::budget_scheduler &;
 
         void update(const os::clock &clk);
+        void step(double dt);
 
-    public:
-        void apply_gravity(rigid_body &body, double dt);
+        auto arena_stats() const -> frame_arena::statistics;
+
+        // Closest hit per query, hits must be at least as long as the queries
+        void raycast(std::span<const ray> rays, std::span<ray_hit> hits);
+        void sphere_cast(std::span<const sphere_sweep> sweeps, std::span<ray_hit> hits);
+
+        // Overlapping body pairs whose layers and masks accept each other,
+        // less pairs held by a joint. Valid until the next step.
+        auto find_pairs() -> std::span<const body_pair>;
+
+        // What trigger bodies started, kept and stopped overlapping in the last step
+        auto trigger_events() const -> std::span<const trigger_event>;
+
+    private:
+        // body_dt is each body's step this time, 0 to stay put, or empty to step all by dt
+        void apply_gravity(double dt, std::span<const float> body_dt);
+        void apply_n_body_gravity(double dt, std::span<const float> body_dt);
+        void integrate_positions(double dt, std::span<const float> body_dt);
+        auto lod_step_times(double dt) -> std::span<const float>;
+        void refresh_query_tree();
+        auto rebuild_query_tree_slice() -> bool;
+        void update_triggers();
+        auto reorder_slice() -> bool;
+        void discard_staged_reorder();
+        void rebase_origin();
 
     private:
         DirectX::XMFLOAT3 gravity{};
 
-        std::vector<rigid_body *> bodies{};
+        // When set, bodies attract each other instead of falling along gravity
+        std::unique_ptr<n_body_gravity> n_body{};
+        std::vector<DirectX::XMFLOAT3> n_body_accelerations{};
+
+        joint_system joints{};
+
+        // Per step scratch memory, rewound at the start of every update
+        frame_arena arena{};
+
+        body_registry bodies{};
+
+        // Off while rebase_distance is 0
+        world_position world_origin{};
+        world_position focus_point{};
+        float rebase_distance{};
+
+        bool lod_enabled{};
+        lod_desc lod{};
+        uint64_t step_index{};
+
+        os::budget_scheduler upkeep;
+
+        // Keeps neighbouring bodies close in memory as they move.
+        // Bounds and codes are worked out a chunk per slice, then sorted a digit
+        // per slice and applied an array per slice.
+        enum class reorder_phase : uint8_t
+        {
+            bounds,
+            codes,
+            sort,
+            apply,
+        };
+
+        struct reorder_state
+        {
+            reorder_phase phase{};
+            uint32_t cursor{};
+            uint32_t count{};
+            uint32_t out_of_order{};
+            DirectX::XMFLOAT3 lo{}, hi{};
+            float scale{};
+            std::vector<uint32_t> codes{}, order{};
+            std::vector<uint32_t> sorted_codes{}, sorted_order{};
+
+            // Step the arrays steps write started staging in, they start over once if
+            // a step lands in between, then go in one slice so the reorder finishes
+            uint64_t staged_step{};
+            bool restaged{};
+        };
+
+        uint32_t reorder_interval{32};
+        uint32_t steps_since_reorder{};
+        uint32_t reorder_task{};
+        reorder_state reorder{};
+
+        // Built on the first query after bodies are added or removed, refit on
+        // the first query after they move. A fresh tree is built into next_query_tree
+        // a slice at a time by upkeep, every few steps and after a reorder, then swapped in.
+        broadphase query_tree{};
+        broadphase next_query_tree{};
+        bool query_tree_dirty{true};
+        bool query_tree_moved{};
+        bool query_tree_rebuilding{};
+        uint32_t steps_since_tree_build{};
+        uint32_t query_tree_task{};
+
+        // Counts adds and removes, a sliced build started before one is thrown away
+        uint32_t body_set_version{};
+        uint32_t rebuild_version{};
+
+        trigger_tracker triggers{};
+        std::vector<soft_body *> soft_bodies{};
+        std::vector<fluid *> fluids{};
     };
 }
\ No newline at end of file
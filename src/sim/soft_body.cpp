@@ -0,0 +1,347 @@
+#include "soft_body.h"
+
+#include "../gfx/render_data.h"
+#include "../os/job_system.h"
+
+using namespace sim;
+using namespace DirectX;
+
+namespace
+{
+    constexpr auto min_length = 1e-6f;
+
+    auto edge_key(uint32_t a, uint32_t b) -> uint64_t
+    {
+        return (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+    }
+
+    auto tet_volume(const std::vector<XMFLOAT3> &positions, const std::array<uint32_t, 4> &ids) -> float
+    {
+        auto p0 = XMLoadFloat3(&positions[ids[0]]);
+        auto e1 = XMLoadFloat3(&positions[ids[1]]) - p0;
+        auto e2 = XMLoadFloat3(&positions[ids[2]]) - p0;
+        auto e3 = XMLoadFloat3(&positions[ids[3]]) - p0;
+
+        return XMVectorGetX(XMVector3Dot(XMVector3Cross(e1, e2), e3)) / 6.0f;
+    }
+
+    // Greedy graph colouring, no two constraints in a colour share a particle.
+    // Sorts constraints by colour and returns the batch offsets.
+    template <typename T>
+    auto colour_batches(std::vector<T> &constraints, uint32_t particle_count) -> std::vector<uint32_t>
+    {
+        auto taken = std::vector<std::vector<bool>>{};
+        auto colours = std::vector<uint32_t>(constraints.size());
+
+        for (auto i = 0u; i < constraints.size(); i++)
+        {
+            auto &ids = constraints[i].ids;
+            auto colour = 0u;
+            for (;; colour++)
+            {
+                if (colour == taken.size())
+                {
+                    taken.emplace_back(particle_count, false);
+                }
+
+                auto &used = taken[colour];
+                auto free = std::none_of(std::begin(ids), std::end(ids), [&](uint32_t id)
+                {
+                    return used[id];
+                });
+
+                if (free)
+                {
+                    break;
+                }
+            }
+
+            for (auto id : ids)
+            {
+                taken[colour][id] = true;
+            }
+            colours[i] = colour;
+        }
+
+        auto batches = std::vector<uint32_t>(taken.size() + 1, 0);
+        for (auto colour : colours)
+        {
+            batches[colour + 1]++;
+        }
+        std::partial_sum(std::begin(batches), std::end(batches), std::begin(batches));
+
+        auto sorted = std::vector<T>(constraints.size());
+        auto cursor = batches;
+        for (auto i = 0u; i < constraints.size(); i++)
+        {
+            sorted[cursor[colours[i]]++] = constraints[i];
+        }
+        constraints = std::move(sorted);
+
+        return batches;
+    }
+
+    template <typename T, typename Fn>
+    void solve_batches(std::vector<T> &constraints, const std::vector<uint32_t> &batches, Fn &&solve)
+    {
+        for (auto b = 0u; b + 1 < batches.size(); b++)
+        {
+            os::parallel_for(batches[b], batches[b + 1], [&](uint32_t i)
+            {
+                solve(constraints[i]);
+            });
+        }
+    }
+}
+
+soft_body::soft_body(const gfx::mesh &model, const desc &desc_) :
+    stretch_compliance{desc_.stretch_compliance},
+    bend_compliance{desc_.bend_compliance},
+    volume_compliance{desc_.volume_compliance},
+    substeps{std::max<uint8_t>(desc_.substeps, 1)}
+{
+    auto count = model.vertices.size();
+
+    positions_.reserve(count);
+    for (auto &v : model.vertices)
+    {
+        positions_.push_back(v.position);
+    }
+    previous_positions = positions_;
+    velocities.resize(count, XMFLOAT3{0.0f, 0.0f, 0.0f});
+    inverse_masses.resize(count, 1.0f / desc_.particle_mass);
+
+    for (auto id : desc_.pinned_particles)
+    {
+        inverse_masses[id] = 0.0f;
+    }
+
+    make_distance_constraints(model);
+    make_volume_constraints(desc_.tetrahedrons);
+    colour_constraints();
+}
+
+soft_body::~soft_body() = default;
+
+void soft_body::step(const XMFLOAT3 &gravity, double dt)
+{
+    if (dt <= 0.0)
+    {
+        return;
+    }
+
+    auto sdt = static_cast<float>(dt) / substeps;
+
+    for (auto s = 0u; s < substeps; s++)
+    {
+        integrate(gravity, sdt);
+
+        solve_distance(stretch_constraints, stretch_batches, stretch_compliance, sdt);
+        solve_distance(bend_constraints, bend_batches, bend_compliance, sdt);
+        solve_volume(sdt);
+
+        update_velocities(sdt);
+    }
+}
+
+auto soft_body::particle_count() const -> uint32_t
+{
+    return static_cast<uint32_t>(positions_.size());
+}
+
+auto soft_body::positions() const -> const std::vector<XMFLOAT3> &
+{
+    return positions_;
+}
+
+void soft_body::translate(const XMFLOAT3 &offset)
+{
+    auto d = XMLoadFloat3(&offset);
+    for (auto p : {&positions_, &previous_positions})
+    {
+        for (auto &v : *p)
+        {
+            XMStoreFloat3(&v, XMLoadFloat3(&v) + d);
+        }
+    }
+}
+
+void soft_body::make_distance_constraints(const gfx::mesh &model)
+{
+    auto &indices = model.indicies;
+    auto edge_opposite = std::unordered_map<uint64_t, uint32_t>{};
+
+    auto rest_length = [&](uint32_t a, uint32_t b)
+    {
+        auto d = XMLoadFloat3(&positions_[a]) - XMLoadFloat3(&positions_[b]);
+        return XMVectorGetX(XMVector3Length(d));
+    };
+
+    for (auto t = 0u; t + 2 < indices.size(); t += 3)
+    {
+        auto tri = std::array{indices[t], indices[t + 1], indices[t + 2]};
+
+        for (auto e = 0u; e < 3; e++)
+        {
+            auto a = tri[e],
+                 b = tri[(e + 1) % 3],
+                 opposite = tri[(e + 2) % 3];
+
+            auto [it, first] = edge_opposite.insert({edge_key(a, b), opposite});
+            if (first)
+            {
+                stretch_constraints.push_back({{a, b}, rest_length(a, b), 0.0f});
+            }
+            else if (it->second != opposite)
+            {
+                // Edge shared by two triangles, bend across it
+                bend_constraints.push_back({{it->second, opposite}, rest_length(it->second, opposite), 0.0f});
+            }
+        }
+    }
+}
+
+void soft_body::make_volume_constraints(const std::vector<std::array<uint32_t, 4>> &tetrahedrons)
+{
+    for (auto &tet : tetrahedrons)
+    {
+        volume_constraints.push_back({tet, tet_volume(positions_, tet), 0.0f});
+    }
+}
+
+void soft_body::colour_constraints()
+{
+    auto count = particle_count();
+
+    stretch_batches = colour_batches(stretch_constraints, count);
+    bend_batches = colour_batches(bend_constraints, count);
+    volume_batches = colour_batches(volume_constraints, count);
+}
+
+void soft_body::integrate(const XMFLOAT3 &gravity, float dt)
+{
+    auto g = XMLoadFloat3(&gravity);
+
+    os::parallel_for(0, particle_count(), [&](uint32_t i)
+    {
+        previous_positions[i] = positions_[i];
+
+        if (inverse_masses[i] == 0.0f)
+        {
+            return;
+        }
+
+        auto v = XMLoadFloat3(&velocities[i]) + g * dt;
+        auto p = XMLoadFloat3(&positions_[i]) + v * dt;
+
+        XMStoreFloat3(&velocities[i], v);
+        XMStoreFloat3(&positions_[i], p);
+    });
+
+    // XPBD with substepping runs one iteration per substep, start lambda over each time
+    for (auto &c : stretch_constraints) c.lambda = 0.0f;
+    for (auto &c : bend_constraints) c.lambda = 0.0f;
+    for (auto &c : volume_constraints) c.lambda = 0.0f;
+}
+
+void soft_body::solve_distance(std::vector<distance_constraint> &constraints,
+                               const std::vector<uint32_t> &batches,
+                               float compliance, float dt)
+{
+    auto alpha = compliance / (dt * dt);
+
+    solve_batches(constraints, batches, [&, alpha](distance_constraint &c)
+    {
+        auto [i0, i1] = c.ids;
+        auto w0 = inverse_masses[i0],
+             w1 = inverse_masses[i1];
+        auto w = w0 + w1;
+        if (w == 0.0f)
+        {
+            return;
+        }
+
+        auto p0 = XMLoadFloat3(&positions_[i0]),
+             p1 = XMLoadFloat3(&positions_[i1]);
+        auto d = p0 - p1;
+        auto length = XMVectorGetX(XMVector3Length(d));
+        if (length < min_length)
+        {
+            return;
+        }
+
+        auto n = d / length;
+        auto C = length - c.rest_length;
+        auto d_lambda = (-C - alpha * c.lambda) / (w + alpha);
+        c.lambda += d_lambda;
+
+        XMStoreFloat3(&positions_[i0], p0 + n * (d_lambda * w0));
+        XMStoreFloat3(&positions_[i1], p1 - n * (d_lambda * w1));
+    });
+}
+
+void soft_body::solve_volume(float dt)
+{
+    // Gradient of the tet volume w.r.t. each corner is the cross of the two opposite edges
+    static constexpr auto face_order = std::array<std::array<uint8_t, 3>, 4>
+    {{
+        {1, 3, 2},
+        {0, 2, 3},
+        {0, 3, 1},
+        {0, 1, 2},
+    }};
+
+    auto alpha = volume_compliance / (dt * dt);
+
+    solve_batches(volume_constraints, volume_batches, [&, alpha](volume_constraint &c)
+    {
+        auto p = std::array<XMVECTOR, 4>{};
+        for (auto j = 0u; j < 4; j++)
+        {
+            p[j] = XMLoadFloat3(&positions_[c.ids[j]]);
+        }
+
+        auto gradients = std::array<XMVECTOR, 4>{};
+        auto w = 0.0f;
+        for (auto j = 0u; j < 4; j++)
+        {
+            auto &[a, b, d] = face_order[j];
+            gradients[j] = XMVector3Cross(p[b] - p[a], p[d] - p[a]) / 6.0f;
+            w += inverse_masses[c.ids[j]] * XMVectorGetX(XMVector3LengthSq(gradients[j]));
+        }
+        if (w == 0.0f)
+        {
+            return;
+        }
+
+        auto C = tet_volume(positions_, c.ids) - c.rest_volume;
+        auto d_lambda = (-C - alpha * c.lambda) / (w + alpha);
+        c.lambda += d_lambda;
+
+        for (auto j = 0u; j < 4; j++)
+        {
+            auto id = c.ids[j];
+            XMStoreFloat3(&positions_[id], p[j] + gradients[j] * (d_lambda * inverse_masses[id]));
+        }
+    });
+}
+
+void soft_body::update_velocities(float dt)
+{
+    os::parallel_for(0, particle_count(), [&](uint32_t i)
+    {
+        auto v = (XMLoadFloat3(&positions_[i]) - XMLoadFloat3(&previous_positions[i])) / dt;
+        XMStoreFloat3(&velocities[i], v);
+    });
+}
+
+void sim::update_vertices(const soft_body &body, gfx::mesh &model)
+{
+    auto &positions = body.positions();
+    assert(model.vertices.size() <= positions.size());
+
+    for (auto i = 0u; i < model.vertices.size(); i++)
+    {
+        model.vertices[i].position = positions[i];
+    }
+}
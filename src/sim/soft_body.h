@@ -0,0 +1,86 @@
+#pragma once
+
+namespace gfx
+{
+    struct mesh;
+};
+
+namespace sim
+{
+    // XPBD cloth and soft body.
+    // Particles and constraints live in flat arrays, constraints are
+    // grouped by graph colour so each colour can be solved in parallel.
+    class soft_body
+    {
+    public:
+        struct desc
+        {
+            float particle_mass = 1.0f;
+            float stretch_compliance = 0.0f;
+            float bend_compliance = 1.0f;
+            float volume_compliance = 0.0f;
+            uint8_t substeps = 10;
+            std::vector<uint32_t> pinned_particles{};
+            std::vector<std::array<uint32_t, 4>> tetrahedrons{};
+        };
+
+    public:
+        soft_body() = delete;
+        soft_body(const gfx::mesh &model, const desc &description);
+        ~soft_body();
+
+        void step(const DirectX::XMFLOAT3 &gravity, double dt);
+
+        auto particle_count() const -> uint32_t;
+        auto positions() const -> const std::vector<DirectX::XMFLOAT3> &;
+
+        void translate(const DirectX::XMFLOAT3 &offset);
+
+    private:
+        struct distance_constraint
+        {
+            std::array<uint32_t, 2> ids;
+            float rest_length;
+            float lambda;
+        };
+
+        struct volume_constraint
+        {
+            std::array<uint32_t, 4> ids;
+            float rest_volume;
+            float lambda;
+        };
+
+        void make_distance_constraints(const gfx::mesh &model);
+        void make_volume_constraints(const std::vector<std::array<uint32_t, 4>> &tetrahedrons);
+        void colour_constraints();
+
+        void integrate(const DirectX::XMFLOAT3 &gravity, float dt);
+        void solve_distance(std::vector<distance_constraint> &constraints,
+                            const std::vector<uint32_t> &batches,
+                            float compliance, float dt);
+        void solve_volume(float dt);
+        void update_velocities(float dt);
+
+    private:
+        float stretch_compliance{},
+              bend_compliance{},
+              volume_compliance{};
+        uint8_t substeps{};
+
+        std::vector<DirectX::XMFLOAT3> positions_{};
+        std::vector<DirectX::XMFLOAT3> previous_positions{};
+        std::vector<DirectX::XMFLOAT3> velocities{};
+        std::vector<float> inverse_masses{};
+
+        // Constraints are sorted by colour, batch i is [batches[i], batches[i + 1])
+        std::vector<distance_constraint> stretch_constraints{};
+        std::vector<distance_constraint> bend_constraints{};
+        std::vector<volume_constraint> volume_constraints{};
+        std::vector<uint32_t> stretch_batches{};
+        std::vector<uint32_t> bend_batches{};
+        std::vector<uint32_t> volume_batches{};
+    };
+
+    void update_vertices(const soft_body &body, gfx::mesh &model);
+};
@@ -0,0 +1,87 @@
+#include "transform_batch.h"
+
+using namespace sim;
+using namespace DirectX;
+
+namespace
+{
+    // Transpose of (R * T) without the multiply or the transpose.
+    // Rotating by conj(q) gives R^T, translation goes in each row's w.
+    auto make_transposed_world(FXMVECTOR position, FXMVECTOR orientation) -> XMMATRIX
+    {
+        auto m = XMMatrixRotationQuaternion(XMQuaternionConjugate(orientation));
+
+        auto select_w = XMVectorSelectControl(0, 0, 0, 1);
+        m.r[0] = XMVectorSelect(m.r[0], XMVectorSplatX(position), select_w);
+        m.r[1] = XMVectorSelect(m.r[1], XMVectorSplatY(position), select_w);
+        m.r[2] = XMVectorSelect(m.r[2], XMVectorSplatZ(position), select_w);
+        return m;
+    }
+}
+
+transform_batch::transform_batch() = default;
+
+transform_batch::~transform_batch() = default;
+
+auto transform_batch::update(const body_registry &bodies, float alpha, const XMFLOAT3 &offset) -> uint32_t
+{
+    auto count = bodies.size();
+
+    // Shrinks on remove, new entries start from a pose no body can have so they are always built
+    auto unbuilt = XMFLOAT4{std::numeric_limits<float>::quiet_NaN(), 0.0f, 0.0f, 0.0f};
+    transforms.resize(count);
+    built_positions.resize(count, unbuilt);
+    built_orientations.resize(count, unbuilt);
+
+    // A moved camera moves every matrix
+    auto d = XMLoadFloat3(&offset);
+    if (not XMVector3Equal(d, XMLoadFloat3(&built_offset)))
+    {
+        std::fill(std::begin(built_positions), std::end(built_positions), unbuilt);
+        built_offset = offset;
+    }
+
+    auto interpolate = alpha < 1.0f;
+    auto written = 0u;
+
+    for (auto i = 0u; i < count; i++)
+    {
+        auto p = XMLoadFloat3(&bodies.positions[i]);
+        auto q = XMLoadFloat4(&bodies.orientations[i]);
+
+        auto p0 = XMLoadFloat3(&bodies.previous_positions[i]);
+        auto q0 = XMLoadFloat4(&bodies.previous_orientations[i]);
+        auto at_rest = XMVector3Equal(p0, p) and XMVector4Equal(q0, q);
+
+        if (interpolate and not at_rest)
+        {
+            // Take the short way round, then nlerp, close enough over one step
+            if (XMVectorGetX(XMVector4Dot(q0, q)) < 0.0f)
+            {
+                q0 = -q0;
+            }
+
+            p = XMVectorLerp(p0, p, alpha);
+            q = XMQuaternionNormalize(XMVectorLerp(q0, q, alpha));
+        }
+
+        // Bit for bit the same pose as last time, the matrix is still good
+        if (XMVector3Equal(p, XMLoadFloat4(&built_positions[i]))
+            and XMVector4Equal(q, XMLoadFloat4(&built_orientations[i])))
+        {
+            continue;
+        }
+
+        XMStoreFloat4(&built_positions[i], p);
+        XMStoreFloat4(&built_orientations[i], q);
+        transforms[i].data = make_transposed_world(p + d, q);
+        written++;
+    }
+
+    return written;
+}
+
+auto transform_batch::matrices() const -> std::span<const gfx::matrix>
+{
+    return transforms;
+}
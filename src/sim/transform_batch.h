@@ -0,0 +1,34 @@
+#pragma once
+
+#include "body_registry.h"
+
+#include "../gfx/render_data.h"
+
+namespace sim
+{
+    // World matrices for every registered body in one contiguous array,
+    // already transposed for HLSL and in dense body order, ready for upload.
+    // Matrices are only rebuilt for bodies whose pose changed since the last update.
+    class transform_batch
+    {
+    public:
+        transform_batch();
+        ~transform_batch();
+
+        // alpha blends from the previous step's pose (0) to the current one (1),
+        // offset is added to every position, for camera relative matrices.
+        // Returns how many matrices were rewritten.
+        auto update(const body_registry &bodies, float alpha = 1.0f, const DirectX::XMFLOAT3 &offset = {}) -> uint32_t;
+
+        auto matrices() const -> std::span<const gfx::matrix>;
+
+    private:
+        // XMMATRIX alignment keeps every row 16 byte aligned for SIMD stores
+        std::vector<gfx::matrix> transforms{};
+
+        // Pose each matrix was last built from
+        std::vector<DirectX::XMFLOAT4> built_positions{};
+        std::vector<DirectX::XMFLOAT4> built_orientations{};
+        DirectX::XMFLOAT3 built_offset{};
+    };
+}
@@ -0,0 +1,130 @@
+#include "triggers.h"
+#include "radix_sort.h"
+
+#include "../os/job_system.h"
+
+using namespace sim;
+
+namespace
+{
+    constexpr auto overlaps_per_task = 256u;
+
+    auto key_of(body_handle trigger, body_handle other) -> uint64_t
+    {
+        return (static_cast<uint64_t>(trigger.slot) << 32) | other.slot;
+    }
+}
+
+trigger_tracker::trigger_tracker() = default;
+trigger_tracker::~trigger_tracker() = default;
+
+void trigger_tracker::update(const body_registry &bodies, std::span<const body_pair> overlaps, frame_arena &arena)
+{
+    std::swap(previous, current);
+
+    auto count = static_cast<uint32_t>(overlaps.size());
+    auto found = arena.allocate_array<overlap>(count);
+    auto keys = arena.allocate_array<uint32_t>(count);
+    auto order = arena.allocate_array<uint32_t>(count);
+    os::parallel_for(0, count, [&](uint32_t i)
+    {
+        auto trigger = bodies.handle_of(overlaps[i].a);
+        auto other = bodies.handle_of(overlaps[i].b);
+        found[i] = {.key = key_of(trigger, other), .trigger = trigger, .other = other};
+        keys[i] = other.slot;
+        order[i] = i;
+    });
+
+    // Sorted by key with two stable radix sorts, other slot then trigger slot
+    radix_sort(keys, order, arena);
+    os::parallel_for(0, count, [&](uint32_t i)
+    {
+        keys[i] = found[order[i]].trigger.slot;
+    });
+    radix_sort(keys, order, arena);
+
+    current.resize(count);
+    os::parallel_for(0, count, [&](uint32_t i)
+    {
+        current[i] = found[order[i]];
+    });
+
+    // Every current overlap is one enter or stay, in the same place
+    auto prev_count = static_cast<uint32_t>(previous.size());
+    if (event_list.size() < count + prev_count)
+    {
+        event_list.resize(count + prev_count);
+    }
+
+    os::parallel_for(0, count, [&](uint32_t i)
+    {
+        auto &o = current[i];
+        event_list[i] = {
+            .trigger = o.trigger,
+            .other = o.other,
+            .type = find(previous, o) ? trigger_event_type::stay : trigger_event_type::enter,
+        };
+    });
+
+    // Previous overlaps missing now are exits, counted per task then written at each task's offset
+    auto task_count = (prev_count + overlaps_per_task - 1) / overlaps_per_task;
+    auto offsets = arena.allocate_array<uint32_t>(task_count + 1);
+    os::parallel_for(0, task_count, [&, prev_count](uint32_t task)
+    {
+        auto exits = 0u;
+        for (auto i = task * overlaps_per_task; i < std::min((task + 1) * overlaps_per_task, prev_count); i++)
+        {
+            exits += find(current, previous[i]) ? 0 : 1;
+        }
+        offsets[task + 1] = exits;
+    }, 1);
+
+    std::partial_sum(std::begin(offsets), std::end(offsets), std::begin(offsets));
+
+    os::parallel_for(0, task_count, [&, prev_count](uint32_t task)
+    {
+        auto next = count + offsets[task];
+        for (auto i = task * overlaps_per_task; i < std::min((task + 1) * overlaps_per_task, prev_count); i++)
+        {
+            auto &o = previous[i];
+            if (not find(current, o))
+            {
+                event_list[next++] = {.trigger = o.trigger, .other = o.other, .type = trigger_event_type::exit};
+            }
+        }
+    }, 1);
+
+    event_count = count + offsets[task_count];
+}
+
+auto trigger_tracker::events() const -> std::span<const trigger_event>
+{
+    return {event_list.data(), event_count};
+}
+
+auto trigger_tracker::overlap_count() const -> uint32_t
+{
+    return static_cast<uint32_t>(current.size());
+}
+
+void trigger_tracker::clear()
+{
+    previous.clear();
+    current.clear();
+    event_count = 0;
+}
+
+auto trigger_tracker::find(std::span<const overlap> set, const overlap &o) -> const overlap *
+{
+    auto it = std::lower_bound(std::begin(set), std::end(set), o.key, [](const overlap &a, uint64_t key)
+    {
+        return a.key < key;
+    });
+
+    // Same slots but a different generation is a different body
+    if (it == std::end(set) or it->key != o.key or it->trigger != o.trigger or it->other != o.other)
+    {
+        return nullptr;
+    }
+    return &*it;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "body_registry.h"
+#include "broadphase.h"
+#include "frame_arena.h"
+
+namespace sim
+{
+    enum class trigger_event_type : uint8_t
+    {
+        enter,
+        stay,
+        exit,
+    };
+
+    struct trigger_event
+    {
+        body_handle trigger;
+        body_handle other;      // may be stale on exit, if the body was removed
+        trigger_event_type type;
+    };
+
+    // Turns each step's trigger overlaps into enter, stay and exit events.
+    // Overlaps are kept sorted by (trigger, other) slot, so both sides of the
+    // diff are binary searches that run in parallel. A slot reused by a new
+    // body counts as an exit and an enter. Buffers only grow, so once they
+    // fit the busiest step nothing allocates.
+    class trigger_tracker
+    {
+    public:
+        trigger_tracker();
+        ~trigger_tracker();
+
+        trigger_tracker(const trigger_tracker &) = delete;
+        auto operator=(const trigger_tracker &) -> trigger_tracker & = delete;
+
+        // overlaps are (trigger, other) dense indices, replaces the last step's events
+        void update(const body_registry &bodies, std::span<const body_pair> overlaps, frame_arena &arena);
+
+        // Enters and stays by trigger, then exits. Valid until the next update.
+        auto events() const -> std::span<const trigger_event>;
+        auto overlap_count() const -> uint32_t;
+
+        void clear();
+
+    private:
+        struct overlap
+        {
+            uint64_t key;
+            body_handle trigger;
+            body_handle other;
+        };
+
+        static auto find(std::span<const overlap> set, const overlap &o) -> const overlap *;
+
+    private:
+        std::vector<overlap> previous{};
+        std::vector<overlap> current{};
+        std::vector<trigger_event> event_list{};
+        uint32_t event_count{};
+    };
+}
@@ -0,0 +1,80 @@
+#include "world_batch.h"
+
+#include "../os/profiler.h"
+
+using namespace sim;
+
+world_batch::world_batch(const desc &desc_, const setup_fn &setup) :
+    worlds(desc_.world_count),
+    pack_bodies{std::max(desc_.pack_bodies, 1u)},
+    clocks(desc_.world_count)
+{
+    os::parallel_for(0, desc_.world_count, [&](uint32_t i)
+    {
+        worlds[i] = std::make_unique<simulation>(desc_.gravity, desc_.arena);
+        setup(*worlds[i], i);
+    }, 1);
+}
+
+world_batch::~world_batch() = default;
+
+void world_batch::run(uint32_t step_count, double dt)
+{
+    PROFILE_ZONE("world_batch::run");
+
+    // Setup or earlier runs may have changed body counts
+    build_packs();
+
+    os::parallel_for(0, pack_count(), [&, step_count, dt](uint32_t p)
+    {
+        // One world at a time, so its data stays in this core's cache for all its steps
+        for (auto w = pack_starts[p]; w < pack_starts[p + 1]; w++)
+        {
+            for (auto s = 0u; s < step_count; s++)
+            {
+                worlds[w]->step(dt);
+            }
+
+            clocks[w].tick();
+            worlds[w]->maintain(clocks[w]);
+        }
+    }, 1);
+}
+
+auto world_batch::world(uint32_t index) -> simulation &
+{
+    return *worlds[index];
+}
+
+auto world_batch::world_count() const -> uint32_t
+{
+    return static_cast<uint32_t>(worlds.size());
+}
+
+auto world_batch::pack_count() const -> uint32_t
+{
+    return pack_starts.empty() ? 0 : static_cast<uint32_t>(pack_starts.size() - 1);
+}
+
+void world_batch::build_packs()
+{
+    pack_starts.clear();
+    pack_starts.push_back(0);
+
+    auto bodies = 0u;
+    for (auto w = 0u; w < world_count(); w++)
+    {
+        // Every world counts for at least one body, so empty worlds still spread out
+        bodies += std::max(worlds[w]->body_store().size(), 1u);
+        if (bodies >= pack_bodies)
+        {
+            pack_starts.push_back(w + 1);
+            bodies = 0;
+        }
+    }
+
+    if (pack_starts.back() != world_count())
+    {
+        pack_starts.push_back(world_count());
+    }
+}
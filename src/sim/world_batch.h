@@ -0,0 +1,76 @@
+#pragma once
+
+#include "simulation.h"
+
+#include "../os/job_system.h"
+
+namespace sim
+{
+    // Many independent simulations stepped together, for offline sweeps.
+    // Consecutive worlds are packed into one job until the pack holds about
+    // pack_bodies bodies, so a worker steps several small worlds back to back
+    // while big worlds get a job each. Results are gathered into one slot
+    // per world, so nothing is shared and nothing locks.
+    class world_batch
+    {
+    public:
+        // Builds world index, runs on pool threads so it must only touch that world
+        using setup_fn = std::function<void(simulation &world, uint32_t index)>;
+
+        struct desc
+        {
+            uint32_t world_count = 0;
+            DirectX::XMFLOAT3 gravity{0.0f, -9.8f, 0.0f};    // setup can change it per world
+            uint32_t pack_bodies = 512;
+
+            // Per world, one small sub-arena as a world only ever runs on one worker at a time
+            frame_arena::desc arena{.sub_arena_size = 64 * 1024, .sub_arena_count = 1};
+        };
+
+    public:
+        world_batch() = delete;
+        world_batch(const desc &description, const setup_fn &setup);
+        ~world_batch();
+
+        world_batch(const world_batch &) = delete;
+        auto operator=(const world_batch &) -> world_batch & = delete;
+
+        // Steps every world step_count times, spread over the job pool. Each world
+        // then runs its maintenance once, against its own budget from that point.
+        void run(uint32_t step_count, double dt);
+
+        // Calls fn(world, index) for every world in parallel, its result lands in slot index
+        template <typename Fn>
+        auto collect(const Fn &fn) const
+        {
+            using result = std::invoke_result_t<const Fn &, const simulation &, uint32_t>;
+            static_assert(not std::is_same_v<result, bool>, "std::vector<bool> packs bits, parallel writes to it race, return uint8_t");
+
+            auto results = std::vector<result>(worlds.size());
+            os::parallel_for(0, world_count(), [&](uint32_t i)
+            {
+                results[i] = fn(*worlds[i], i);
+            });
+            return results;
+        }
+
+        auto world(uint32_t index) -> simulation &;
+        auto world_count() const -> uint32_t;
+
+        // Of the last run
+        auto pack_count() const -> uint32_t;
+
+    private:
+        void build_packs();
+
+    private:
+        std::vector<std::unique_ptr<simulation>> worlds{};
+        uint32_t pack_bodies{};
+
+        // Per world, ticked just before its maintenance so the budget starts there
+        std::vector<os::clock> clocks{};
+
+        // Pack p steps worlds [pack_starts[p], pack_starts[p + 1])
+        std::vector<uint32_t> pack_starts{};
+    };
+}
@@ -0,0 +1,136 @@
+#include "world_lanes.h"
+
+#include "../os/job_system.h"
+
+using namespace sim;
+using namespace sim::simd;
+using namespace DirectX;
+
+world_lanes::world_lanes(const desc &desc_) :
+    worlds{desc_.world_count},
+    bodies{desc_.body_count},
+    group_count{(desc_.world_count + lane_count - 1) / lane_count}
+{
+    // Spare lanes of the last group step harmlessly from rest
+    auto size = group_count * bodies * lane_count;
+    for (auto v : {&px, &py, &pz, &vx, &vy, &vz, &qx, &qy, &qz, &wx, &wy, &wz})
+    {
+        v->assign(size, 0.0f);
+    }
+    qw.assign(size, 1.0f);
+    masses.assign(size, 1.0f);
+
+    for (auto v : {&gx, &gy, &gz})
+    {
+        v->assign(group_count * lane_count, 0.0f);
+    }
+
+    bounding_boxes.resize(bodies);
+}
+
+world_lanes::~world_lanes() = default;
+
+void world_lanes::set_gravity(uint32_t world, const XMFLOAT3 &gravity)
+{
+    gx[world] = gravity.x;
+    gy[world] = gravity.y;
+    gz[world] = gravity.z;
+}
+
+void world_lanes::set_body(uint32_t world, uint32_t body, const rigid_body &state)
+{
+    auto i = index_of(world, body);
+    px[i] = state.position.x;
+    py[i] = state.position.y;
+    pz[i] = state.position.z;
+    vx[i] = state.velocity.x;
+    vy[i] = state.velocity.y;
+    vz[i] = state.velocity.z;
+    qx[i] = state.orientation.x;
+    qy[i] = state.orientation.y;
+    qz[i] = state.orientation.z;
+    qw[i] = state.orientation.w;
+    wx[i] = state.angular_velocity.x;
+    wy[i] = state.angular_velocity.y;
+    wz[i] = state.angular_velocity.z;
+    masses[i] = state.mass;
+    bounding_boxes[body] = state.bounding_box;
+}
+
+auto world_lanes::get_body(uint32_t world, uint32_t body) const -> rigid_body
+{
+    auto i = index_of(world, body);
+    return rigid_body
+    {
+        .position = {px[i], py[i], pz[i]},
+        .velocity = {vx[i], vy[i], vz[i]},
+        .bounding_box = bounding_boxes[body],
+        .mass = masses[i],
+        .orientation = {qx[i], qy[i], qz[i], qw[i]},
+        .angular_velocity = {wx[i], wy[i], wz[i]},
+    };
+}
+
+void world_lanes::step(double dt)
+{
+    auto h = XMVectorReplicate(static_cast<float>(dt));
+    auto half_h = XMVectorReplicate(0.5f * static_cast<float>(dt));
+
+    os::parallel_for(0, group_count, [&, h, half_h](uint32_t g)
+    {
+        auto gravity_x = load4(gx, g * lane_count) * h,
+             gravity_y = load4(gy, g * lane_count) * h,
+             gravity_z = load4(gz, g * lane_count) * h;
+
+        for (auto b = 0u; b < bodies; b++)
+        {
+            auto i = (g * bodies + b) * lane_count;
+
+            auto vel_x = load4(vx, i) + gravity_x,
+                 vel_y = load4(vy, i) + gravity_y,
+                 vel_z = load4(vz, i) + gravity_z;
+            store4(vx, i, vel_x);
+            store4(vy, i, vel_y);
+            store4(vz, i, vel_z);
+
+            store4(px, i, load4(px, i) + vel_x * h);
+            store4(py, i, load4(py, i) + vel_y * h);
+            store4(pz, i, load4(pz, i) + vel_z * h);
+
+            // dq/dt = 0.5 * w * q, the Hamilton product written out per component
+            auto x = load4(qx, i), y = load4(qy, i), z = load4(qz, i), w = load4(qw, i);
+            auto ax = load4(wx, i), ay = load4(wy, i), az = load4(wz, i);
+
+            auto dx = w * ax + ay * z - az * y,
+                 dy = w * ay + az * x - ax * z,
+                 dz = w * az + ax * y - ay * x,
+                 dw = -(ax * x + ay * y + az * z);
+
+            x = x + dx * half_h;
+            y = y + dy * half_h;
+            z = z + dz * half_h;
+            w = w + dw * half_h;
+
+            auto inv_length = XMVectorReciprocalSqrt(x * x + y * y + z * z + w * w);
+            store4(qx, i, x * inv_length);
+            store4(qy, i, y * inv_length);
+            store4(qz, i, z * inv_length);
+            store4(qw, i, w * inv_length);
+        }
+    }, 1);
+}
+
+auto world_lanes::world_count() const -> uint32_t
+{
+    return worlds;
+}
+
+auto world_lanes::body_count() const -> uint32_t
+{
+    return bodies;
+}
+
+auto world_lanes::index_of(uint32_t world, uint32_t body) const -> uint32_t
+{
+    return ((world / lane_count) * bodies + body) * lane_count + world % lane_count;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "sim_data.h"
+#include "simd.h"
+
+namespace sim
+{
+    // Tiny identical worlds stepped side by side, one world per SIMD lane.
+    // Every world has the same bodies in the same order, only their state
+    // and gravity differ. Body b of lane_count worlds sits in one vector, so
+    // each integrator op advances that many worlds at once. Groups of
+    // lane_count worlds are spread over the job pool.
+    class world_lanes
+    {
+    public:
+        static constexpr auto lane_count = simd::simd_width;
+
+        struct desc
+        {
+            uint32_t world_count;
+            uint32_t body_count;
+        };
+
+    public:
+        world_lanes() = delete;
+        world_lanes(const desc &description);
+        ~world_lanes();
+
+        void set_gravity(uint32_t world, const DirectX::XMFLOAT3 &gravity);
+        void set_body(uint32_t world, uint32_t body, const rigid_body &state);
+        auto get_body(uint32_t world, uint32_t body) const -> rigid_body;
+
+        // Same integrator as simulation::step without joints
+        void step(double dt);
+
+        auto world_count() const -> uint32_t;
+        auto body_count() const -> uint32_t;
+
+    private:
+        auto index_of(uint32_t world, uint32_t body) const -> uint32_t;
+
+    private:
+        uint32_t worlds{};
+        uint32_t bodies{};
+        uint32_t group_count{};
+
+        // Per body, lanes of a group are adjacent: ((group * bodies + body) * lane_count + lane)
+        std::vector<float> px{}, py{}, pz{};
+        std::vector<float> vx{}, vy{}, vz{};
+        std::vector<float> qx{}, qy{}, qz{}, qw{};
+        std::vector<float> wx{}, wy{}, wz{};
+        std::vector<float> masses{};
+
+        // Per world, padded to whole groups
+        std::vector<float> gx{}, gy{}, gz{};
+
+        // Shared by every world
+        std::vector<std::array<DirectX::XMFLOAT3, 2>> bounding_boxes{};
+    };
+}
@@ -1,5 +1,1842 @@
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch.hpp>
 
-int main()
+#include "sim/simulation.h"
+#include "sim/transform_batch.h"
+#include "sim/radix_sort.h"
+#include "sim/contact_cache.h"
+#include "sim/world_batch.h"
+#include "sim/world_lanes.h"
+#include "os/triple_buffer.h"
+#include "os/profiler.h"
+#include "os/clock.h"
+#include "os/frame_pacer.h"
+#include "os/job_system.h"
+#include "os/task_graph.h"
+#include "os/budget_scheduler.h"
+#include "gfx/renderer.h"
+#include "gfx/null_backend.h"
+
+#include <cstdlib>
+#include <new>
+#include <map>
+#include <sstream>
+
+namespace
+{
+	// Counts every global heap allocation made while enabled
+	std::atomic<bool> counting{false};
+	std::atomic<std::size_t> allocation_count{0};
+
+	auto counted_alloc(std::size_t size) -> void *
+	{
+		if (counting.load(std::memory_order_relaxed))
+		{
+			allocation_count.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		if (auto p = std::malloc(size == 0 ? 1 : size))
+		{
+			return p;
+		}
+		throw std::bad_alloc{};
+	}
+
+	auto counted_aligned_alloc(std::size_t size, std::align_val_t alignment) -> void *
+	{
+		if (counting.load(std::memory_order_relaxed))
+		{
+			allocation_count.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		auto align = static_cast<std::size_t>(alignment);
+		auto padded = (std::max(size, std::size_t{1}) + align - 1) / align * align;
+#ifdef _MSC_VER
+		auto p = _aligned_malloc(padded, align);
+#else
+		auto p = std::aligned_alloc(align, padded);
+#endif
+		if (p)
+		{
+			return p;
+		}
+		throw std::bad_alloc{};
+	}
+
+	void aligned_free(void *p)
+	{
+#ifdef _MSC_VER
+		_aligned_free(p);
+#else
+		std::free(p);
+#endif
+	}
+
+	constexpr auto step_count_until_warm = 4u;
+
+	// Clock is never ticked again, so every step reuses the same delta
+	auto make_frame_clock() -> os::clock
+	{
+		auto clk = os::clock{};
+		std::this_thread::sleep_for(std::chrono::milliseconds(16));
+		clk.tick();
+		return clk;
+	}
+}
+
+auto operator new(std::size_t size) -> void * { return counted_alloc(size); }
+auto operator new[](std::size_t size) -> void * { return counted_alloc(size); }
+auto operator new(std::size_t size, std::align_val_t alignment) -> void * { return counted_aligned_alloc(size, alignment); }
+auto operator new[](std::size_t size, std::align_val_t alignment) -> void * { return counted_aligned_alloc(size, alignment); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { aligned_free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { aligned_free(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept { aligned_free(p); }
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept { aligned_free(p); }
+
+TEST_CASE("frame arena bump allocates and rewinds", "[frame_arena]")
+{
+	auto arena = sim::frame_arena({.sub_arena_size = 1024, .sub_arena_count = 1});
+
+	auto a = arena.allocate(3, 1);
+	auto b = arena.allocate(16, 64);
+	REQUIRE(a != nullptr);
+	REQUIRE(reinterpret_cast<std::uintptr_t>(b) % 64 == 0);
+
+	auto values = arena.allocate_array<float>(8);
+	REQUIRE(values.size() == 8);
+	REQUIRE(std::all_of(std::begin(values), std::end(values), [](float v) { return v == 0.0f; }));
+
+	REQUIRE(arena.stats().used > 0);
+	arena.reset();
+	REQUIRE(arena.stats().used == 0);
+	REQUIRE(arena.stats().high_water_mark > 0);
+	REQUIRE(arena.allocate(3, 1) == a);
+}
+
+TEST_CASE("frame arena grows after an overflow", "[frame_arena]")
+{
+	auto arena = sim::frame_arena({.sub_arena_size = 256, .sub_arena_count = 1});
+
+	arena.allocate(200, 16);
+	arena.allocate(200, 16);
+	REQUIRE(arena.stats().overflow_count == 1);
+
+	arena.reset();
+	REQUIRE(arena.stats().capacity >= arena.stats().high_water_mark);
+
+	arena.allocate(200, 16);
+	arena.allocate(200, 16);
+	REQUIRE(arena.stats().overflow_count == 1);
+}
+
+TEST_CASE("simulation step does not allocate once warm", "[simulation]")
+{
+	using namespace DirectX;
+
+	auto clk = make_frame_clock();
+	auto sim = sim::simulation(XMFLOAT3{0.0f, -9.8f, 0.0f});
+
+	auto small_box = std::array{XMFLOAT3{-0.25f, -0.25f, -0.25f}, XMFLOAT3{0.25f, 0.25f, 0.25f}};
+
+	// Warm up, then count over many steps, after_step runs once per counted step
+	auto allocations_once_warm = [&](auto &&after_step)
+	{
+		for (auto i = 0u; i < step_count_until_warm; i++)
+		{
+			sim.update(clk);
+		}
+
+		allocation_count = 0;
+		counting = true;
+		for (auto i = 0u; i < 64; i++)
+		{
+			sim.update(clk);
+			after_step();
+		}
+		counting = false;
+
+		REQUIRE(sim.arena_stats().overflow_count == 0);
+		return allocation_count.load();
+	};
+	auto nothing = []() {};
+
+	SECTION("rigid bodies and joints")
+	{
+		constexpr auto link_count = 16u;
+		auto links = std::vector<sim::body_handle>(link_count);
+		for (auto i = 0u; i < link_count; i++)
+		{
+			links[i] = sim.add_body({
+				.position = {static_cast<float>(i), 10.0f, 0.0f},
+				.bounding_box = small_box,
+			});
+		}
+
+		sim.add_joint({
+			.type = sim::joint_type::ball,
+			.body_a = sim::joint_system::world,
+			.body_b = links[0],
+			.anchor_a = {0.0f, 10.0f, 0.0f},
+			.anchor_b = {},
+		});
+		for (auto i = 1u; i < link_count; i++)
+		{
+			sim.add_joint({
+				.type = i % 2 ? sim::joint_type::hinge : sim::joint_type::distance,
+				.body_a = links[i - 1],
+				.body_b = links[i],
+				.anchor_a = {0.5f, 0.0f, 0.0f},
+				.anchor_b = {-0.5f, 0.0f, 0.0f},
+			});
+		}
+
+		REQUIRE(allocations_once_warm(nothing) == 0);
+	}
+
+	SECTION("soft body")
+	{
+		auto model = gfx::mesh{
+			.vertices = {
+				{.position = {0.0f, 0.0f, 0.0f}},
+				{.position = {1.0f, 0.0f, 0.0f}},
+				{.position = {0.0f, 0.0f, 1.0f}},
+				{.position = {0.25f, -1.0f, 0.25f}},
+			},
+			.indicies = {0, 1, 2, 0, 1, 3, 1, 2, 3, 2, 0, 3},
+		};
+		auto body = sim::soft_body(model, {.pinned_particles = {0}, .tetrahedrons = {{0, 1, 2, 3}}});
+		sim.add_soft_body(body);
+
+		REQUIRE(allocations_once_warm(nothing) == 0);
+	}
+
+	SECTION("fluid")
+	{
+		auto particles = std::vector<XMFLOAT3>{};
+		for (auto z = 0; z < 10; z++)
+		{
+			for (auto y = 0; y < 10; y++)
+			{
+				for (auto x = 0; x < 10; x++)
+				{
+					particles.push_back({x * 0.02f, 1.0f + y * 0.02f, z * 0.02f});
+				}
+			}
+		}
+		auto body = sim::fluid(particles, {.bounds = {XMFLOAT3{-0.5f, 0.0f, -0.5f}, XMFLOAT3{0.5f, 2.0f, 0.5f}}});
+		sim.add_fluid(body);
+
+		REQUIRE(allocations_once_warm(nothing) == 0);
+	}
+
+	SECTION("n-body gravity above the direct sum threshold")
+	{
+		sim.change_gravity({0.0f, 0.0f, 0.0f});
+		sim.use_n_body_gravity({.direct_sum_threshold = 64});
+		for (auto i = 0u; i < 512; i++)
+		{
+			sim.add_body({
+				.position = {static_cast<float>(i % 8) * 2.0f, static_cast<float>(i / 8 % 8) * 2.0f, static_cast<float>(i / 64) * 2.0f},
+				.bounding_box = small_box,
+			});
+		}
+
+		REQUIRE(allocations_once_warm(nothing) == 0);
+	}
+
+	SECTION("trigger sensor")
+	{
+		sim.change_gravity({0.0f, 0.0f, 0.0f});
+		sim.add_body({
+			.position = {0.0f, 1.0f, 0.0f},
+			.bounding_box = {XMFLOAT3{-3.0f, -0.5f, -3.0f}, XMFLOAT3{3.0f, 0.5f, 3.0f}},
+			.trigger = true,
+		});
+		// Overlap buffers only grow to the busiest step, so the warm up sees the
+		// most overlaps: eight bodies start inside and leave while counting,
+		// then four more enter and leave
+		for (auto i = 0u; i < 12; i++)
+		{
+			sim.add_body({
+				.position = {static_cast<float>(i % 8) * 0.75f - 2.5f, i < 8 ? 1.0f : 3.5f, static_cast<float>(i / 8)},
+				.velocity = {0.0f, -5.0f, 0.0f},
+				.bounding_box = small_box,
+			});
+		}
+
+		auto counts = std::array<uint32_t, 3>{};
+		REQUIRE(allocations_once_warm([&]()
+		{
+			for (auto &e : sim.trigger_events())
+			{
+				counts[static_cast<uint32_t>(e.type)]++;
+			}
+		}) == 0);
+		REQUIRE(counts[static_cast<uint32_t>(sim::trigger_event_type::enter)] == 4);
+		REQUIRE(counts[static_cast<uint32_t>(sim::trigger_event_type::stay)] > 0);
+		REQUIRE(counts[static_cast<uint32_t>(sim::trigger_event_type::exit)] == 12);
+	}
+}
+
+TEST_CASE("body registry detects stale handles", "[body_registry]")
+{
+	auto registry = sim::body_registry{};
+
+	auto make_body = [](float x)
+	{
+		return sim::rigid_body{.position = {x, 0.0f, 0.0f}};
+	};
+
+	auto a = registry.add(make_body(1.0f));
+	auto b = registry.add(make_body(2.0f));
+	auto c = registry.add(make_body(3.0f));
+	REQUIRE(registry.size() == 3);
+
+	// Removing from the middle moves the last body into the hole
+	REQUIRE(registry.remove(a));
+	REQUIRE(registry.size() == 2);
+	REQUIRE_FALSE(registry.is_valid(a));
+	REQUIRE_FALSE(registry.remove(a));
+	REQUIRE(registry.get(b).position.x == 2.0f);
+	REQUIRE(registry.get(c).position.x == 3.0f);
+	REQUIRE(registry.index_of(c) == 0);
+	REQUIRE(registry.handle_of(0) == c);
+
+	// New body reuses a's slot with a new generation
+	auto d = registry.add(make_body(4.0f));
+	REQUIRE(d.slot == a.slot);
+	REQUIRE_FALSE(registry.is_valid(a));
+	REQUIRE(registry.get(d).position.x == 4.0f);
+
+	registry.clear();
+	REQUIRE(registry.size() == 0);
+	REQUIRE_FALSE(registry.is_valid(b));
+	REQUIRE_FALSE(registry.is_valid(d));
+}
+
+TEST_CASE("radix sort is stable and matches a comparison sort", "[radix_sort]")
+{
+	auto arena = sim::frame_arena{};
+
+	// More than one block, keys from a small range so equal keys keep their input order
+	constexpr auto count = 20'000u;
+	auto keys = std::vector<uint32_t>(count);
+	auto values = std::vector<uint32_t>(count);
+	auto state = 12345u;
+	for (auto i = 0u; i < count; i++)
+	{
+		state = state * 1664525u + 1013904223u;
+		keys[i] = (state >> 8) % 5000u << (i % 3 * 8);
+		values[i] = i;
+	}
+
+	auto expected = values;
+	std::stable_sort(std::begin(expected), std::end(expected), [&](uint32_t a, uint32_t b)
+	{
+		return keys[a] < keys[b];
+	});
+
+	sim::radix_sort(keys, values, arena);
+	REQUIRE(std::is_sorted(std::begin(keys), std::end(keys)));
+	REQUIRE(values == expected);
+
+	// 64 bit keys, with digits in both halves
+	auto wide_keys = std::vector<uint64_t>(count);
+	for (auto i = 0u; i < count; i++)
+	{
+		state = state * 1664525u + 1013904223u;
+		wide_keys[i] = uint64_t{(state >> 8) % 5000u} << (i % 5 * 12);
+		values[i] = i;
+	}
+
+	expected = values;
+	std::stable_sort(std::begin(expected), std::end(expected), [&](uint32_t a, uint32_t b)
+	{
+		return wide_keys[a] < wide_keys[b];
+	});
+
+	arena.reset();
+	sim::radix_sort(wide_keys, values, arena);
+	REQUIRE(std::is_sorted(std::begin(wide_keys), std::end(wide_keys)));
+	REQUIRE(values == expected);
+}
+
+TEST_CASE("simulation reorders bodies along a Morton curve", "[simulation]")
+{
+	using namespace DirectX;
+
+	auto sim = sim::simulation(XMFLOAT3{});
+	sim.set_reorder_interval(1);
+
+	// Added in a scrambled order along x, so the Morton order is the x order
+	constexpr auto count = 257u;
+	auto handles = std::vector<sim::body_handle>(count);
+	for (auto i = 0u; i < count; i++)
+	{
+		auto x = static_cast<float>(i * 97 % count);
+		handles[i] = sim.add_body({.position = {x, 0.0f, 0.0f}, .mass = x});
+	}
+
+	// The step only asks for the reorder, maintenance does it
+	auto clk = make_frame_clock();
+	sim.maintenance().set_budget(std::chrono::seconds(1));
+	sim.step(1.0 / 60.0);
+	REQUIRE(sim.maintenance().is_pending(0));
+	sim.maintain(clk);
+	REQUIRE_FALSE(sim.maintenance().is_pending(0));
+
+	auto &store = sim.body_store();
+	for (auto i = 0u; i < count; i++)
+	{
+		REQUIRE(store.positions[i].x == static_cast<float>(i));
+	}
+
+	// Handles follow their bodies to the new slots
+	for (auto i = 0u; i < count; i++)
+	{
+		auto body = sim.get_body(handles[i]);
+		REQUIRE(body.position.x == static_cast<float>(i * 97 % count));
+		REQUIRE(body.mass == body.position.x);
+		REQUIRE(store.handle_of(store.index_of(handles[i])) == handles[i]);
+	}
+
+	REQUIRE(sim.remove_body(handles[0]));
+	REQUIRE_FALSE(store.is_valid(handles[0]));
+	REQUIRE(sim.get_body(handles[1]).position.x == 97.0f);
+
+	// With no budget the reorder goes a slice per frame, steps in between never see a half applied order
+	auto sliced = sim::simulation(XMFLOAT3{});
+	sliced.set_reorder_interval(1);
+	sliced.maintenance().set_budget(std::chrono::microseconds(0));
+	for (auto i = 0u; i < count; i++)
+	{
+		auto x = static_cast<float>(i * 97 % count);
+		handles[i] = sliced.add_body({.position = {x, 0.0f, 0.0f}, .mass = x});
+	}
+
+	auto frames = 0u;
+	sliced.step(1.0 / 60.0);
+	while (sliced.maintenance().is_pending(0))
+	{
+		sliced.maintain(clk);
+		sliced.set_reorder_interval(0);
+		sliced.step(1.0 / 60.0);
+		frames++;
+
+		for (auto i = 0u; i < count; i++)
+		{
+			auto body = sliced.get_body(handles[i]);
+			REQUIRE(body.position.x == static_cast<float>(i * 97 % count));
+			REQUIRE(body.mass == body.position.x);
+		}
+	}
+	REQUIRE(frames > sim::radix_sort_passes + sim::body_registry::first_step_written);
+	for (auto i = 0u; i < count; i++)
+	{
+		REQUIRE(sliced.body_store().positions[i].x == static_cast<float>(i));
+	}
+}
+
+TEST_CASE("floating origin keeps precision far from the world origin", "[simulation]")
+{
+	using namespace DirectX;
+
+	auto sim = sim::simulation(XMFLOAT3{});
+	sim.use_floating_origin(1000.0f);
+	sim.set_reorder_interval(0);
+
+	auto home = sim.add_body({.position = {1.5f, 2.0f, 0.0f}});
+
+	// Ten thousand km out, the origin snaps to a multiple of 1024
+	sim.set_focus({1.0e7, 0.0, 0.0});
+	sim.step(1.0 / 64.0);
+	REQUIRE(sim.origin().x == 9766.0 * 1024.0);
+	REQUIRE(sim.world_position_of(home).x == Approx(1.5).margin(1.0));
+	REQUIRE(sim.world_position_of(home).y == 2.0);
+
+	// A float world position this far out would round 0.125 away
+	auto far = sim.add_body({
+		.position = sim.to_local({1.0e7 + 0.125, 0.0, 0.0}),
+		.velocity = {0.5f, 0.0f, 0.0f},
+	});
+	for (auto i = 0; i < 64; i++)
+	{
+		sim.step(1.0 / 64.0);
+	}
+	REQUIRE(sim.world_position_of(far).x == 1.0e7 + 0.625);
+
+	// Moving within the rebase distance keeps the origin
+	sim.set_focus({1.0e7 + 900.0, 0.0, 0.0});
+	sim.step(0.0);
+	REQUIRE(sim.origin().x == 9766.0 * 1024.0);
+
+	// Camera relative matrices put the translation in each row's w
+	auto eye = sim::world_position{1.0e7, -1.0, 0.0};
+	auto m = gfx::matrix{};
+	sim::update_transforms(sim.get_body(far), sim.offset_from(eye), m);
+	REQUIRE(XMVectorGetW(m.data.r[0]) == 0.625f);
+	REQUIRE(XMVectorGetW(m.data.r[1]) == 1.0f);
+}
+
+TEST_CASE("simulation LOD steps distant bodies less often", "[simulation]")
+{
+	using namespace DirectX;
+
+	auto sim = sim::simulation(XMFLOAT3{});
+	sim.set_reorder_interval(0);
+	sim.use_lod({.distances = {50.0f, 200.0f}});
+
+	// One per tier, the unimportant one is near but treated as far
+	auto starts = std::array{0.0f, 100.0f, 1000.0f, 10.0f};
+	auto handles = std::vector<sim::body_handle>{};
+	for (auto x : starts)
+	{
+		handles.push_back(sim.add_body({
+			.position = {x, 0.0f, 0.0f},
+			.velocity = {1.0f, 0.0f, 0.0f},
+			.importance = x == 10.0f ? 0.01f : 1.0f,
+		}));
+	}
+
+	constexpr auto dt = 1.0 / 64.0;
+	constexpr auto steps = 16u;
+	auto moves = std::array<uint32_t, 4>{};
+	for (auto s = 1u; s <= steps; s++)
+	{
+		auto before = std::array<float, 4>{};
+		for (auto b = 0u; b < 4; b++)
+		{
+			before[b] = sim.get_body(handles[b]).position.x;
+		}
+
+		sim.step(dt);
+
+		// Whenever a body moves it catches up on all the time it skipped
+		for (auto b = 0u; b < 4; b++)
+		{
+			auto x = sim.get_body(handles[b]).position.x;
+			if (x != before[b])
+			{
+				moves[b]++;
+				REQUIRE(x - starts[b] == Approx(s * dt));
+			}
+		}
+	}
+	REQUIRE(moves == std::array<uint32_t, 4>{16, 8, 4, 4});
+
+	// Moving the focus onto a far body brings it straight up to full rate, without losing time
+	sim.set_focus({1000.0, 0.0, 0.0});
+	sim.step(dt);
+	REQUIRE(sim.get_body(handles[2]).position.x - starts[2] == Approx((steps + 1) * dt));
+
+	// Far bodies held by a joint stay at full rate, a loose one next to them does not
+	auto held = sim.add_body({.position = {-1000.0f, 0.0f, 0.0f}});
+	auto other = sim.add_body({.position = {-1002.0f, 0.0f, 0.0f}});
+	auto loose = sim.add_body({.position = {-1004.0f, 0.0f, 0.0f}});
+	sim.add_joint({.type = sim::joint_type::distance, .body_a = held, .body_b = other, .anchor_a = {}, .anchor_b = {}});
+	sim.step(dt);
+
+	auto tier_of = [&](sim::body_handle body)
+	{
+		return sim.body_store().lod_tiers[sim.body_store().index_of(body)];
+	};
+	REQUIRE(tier_of(held) == 0);
+	REQUIRE(tier_of(other) == 0);
+	REQUIRE(tier_of(loose) == 2);
+}
+
+TEST_CASE("world batch steps every world and collects per world results", "[world_batch]")
+{
+	using namespace DirectX;
+
+	constexpr auto world_count = 100u;
+	auto batch = sim::world_batch({.world_count = world_count, .pack_bodies = 8}, [](sim::simulation &world, uint32_t i)
+	{
+		world.change_gravity({0.0f, -static_cast<float>(i), 0.0f});
+
+		// Every tenth world is big enough to get a pack of its own
+		auto count = i % 10 == 0 ? 8u : 1u;
+		for (auto b = 0u; b < count; b++)
+		{
+			world.add_body({.position = {static_cast<float>(b), 0.0f, 0.0f}});
+		}
+	});
+
+	// Packs are {0}, {1..8}, {9, 10}, {11..18}, ... {91..98}, {99}
+	batch.run(60, 1.0 / 60.0);
+	REQUIRE(batch.pack_count() == 21);
+
+	// The reorder check the steps asked for ran as each world's maintenance
+	for (auto i = 0u; i < world_count; i++)
+	{
+		REQUIRE_FALSE(batch.world(i).maintenance().is_pending(0));
+	}
+
+	auto speeds = batch.collect([](const sim::simulation &world, uint32_t)
+	{
+		auto &store = world.body_store();
+		return store.velocities[store.size() - 1].y;
+	});
+	REQUIRE(speeds.size() == world_count);
+	for (auto i = 0u; i < world_count; i++)
+	{
+		REQUIRE(speeds[i] == Approx(-static_cast<float>(i)).margin(1e-4));
+	}
+}
+
+TEST_CASE("world lanes match separately stepped simulations", "[world_lanes]")
+{
+	using namespace DirectX;
+
+	// Not a whole number of lane groups, so the last group has spare lanes
+	constexpr auto world_count = 6u;
+	constexpr auto body_count = 3u;
+	auto lanes = sim::world_lanes({.world_count = world_count, .body_count = body_count});
+
+	auto worlds = std::vector<std::unique_ptr<sim::simulation>>{};
+	for (auto w = 0u; w < world_count; w++)
+	{
+		auto gravity = XMFLOAT3{0.1f * w, -9.8f + w, 0.0f};
+		worlds.push_back(std::make_unique<sim::simulation>(gravity));
+		worlds.back()->set_reorder_interval(0);
+		lanes.set_gravity(w, gravity);
+
+		for (auto b = 0u; b < body_count; b++)
+		{
+			auto f = static_cast<float>(w * body_count + b);
+			auto body = sim::rigid_body{
+				.position = {f, 2.0f * f, -f},
+				.velocity = {0.5f * f, 1.0f, -0.25f * f},
+				.mass = 1.0f + f,
+				.angular_velocity = {0.3f * f, -0.2f, 0.1f * f},
+			};
+			worlds.back()->add_body(body);
+			lanes.set_body(w, b, body);
+		}
+	}
+
+	for (auto s = 0; s < 30; s++)
+	{
+		lanes.step(1.0 / 60.0);
+		for (auto &world : worlds)
+		{
+			world->step(1.0 / 60.0);
+		}
+	}
+
+	for (auto w = 0u; w < world_count; w++)
+	{
+		for (auto b = 0u; b < body_count; b++)
+		{
+			auto expected = worlds[w]->body_store().body(b);
+			auto actual = lanes.get_body(w, b);
+			REQUIRE(actual.mass == expected.mass);
+			REQUIRE(actual.position.x == Approx(expected.position.x).margin(1e-4));
+			REQUIRE(actual.position.y == Approx(expected.position.y).margin(1e-4));
+			REQUIRE(actual.velocity.y == Approx(expected.velocity.y).margin(1e-4));
+			REQUIRE(actual.orientation.x == Approx(expected.orientation.x).margin(1e-4));
+			REQUIRE(actual.orientation.y == Approx(expected.orientation.y).margin(1e-4));
+			REQUIRE(actual.orientation.z == Approx(expected.orientation.z).margin(1e-4));
+			REQUIRE(actual.orientation.w == Approx(expected.orientation.w).margin(1e-4));
+		}
+	}
+}
+
+TEST_CASE("contact cache finds, ages out and regrows pairs", "[contact_cache]")
+{
+	auto cache = sim::contact_cache{};
+
+	auto handle = [](uint32_t slot)
+	{
+		return sim::body_handle{.slot = slot};
+	};
+	REQUIRE(sim::pair_key(handle(3), handle(7)) == sim::pair_key(handle(7), handle(3)));
+
+	// Enough pairs to grow a few times, manifolds tagged with their index
+	constexpr auto count = 1000u;
+	auto pairs = std::vector<uint64_t>(count);
+	auto manifolds = std::vector<sim::contact_manifold>(count);
+	for (auto i = 0u; i < count; i++)
+	{
+		pairs[i] = sim::pair_key(handle(i), handle(i + 1));
+		manifolds[i].point_count = 1;
+		manifolds[i].points[0].normal_impulse = static_cast<float>(i);
+	}
+
+	cache.next_frame();
+	cache.insert(pairs, manifolds);
+	REQUIRE(cache.size() == count);
+	REQUIRE(cache.capacity() >= 2 * count);
+	for (auto i = 0u; i < count; i++)
+	{
+		auto *m = cache.find(pairs[i]);
+		REQUIRE(m);
+		REQUIRE(m->points[0].normal_impulse == static_cast<float>(i));
+	}
+	REQUIRE(cache.find(sim::pair_key(handle(5), handle(9))) == nullptr);
+
+	// Only the even pairs stay in contact, the odd ones age out
+	for (auto frame = 0; frame < 3; frame++)
+	{
+		cache.next_frame();
+		auto even_pairs = std::vector<uint64_t>{};
+		auto even_manifolds = std::vector<sim::contact_manifold>{};
+		for (auto i = 0u; i < count; i += 2)
+		{
+			even_pairs.push_back(pairs[i]);
+			even_manifolds.push_back(manifolds[i]);
+			even_manifolds.back().points[0].normal_impulse += 0.5f;
+		}
+		cache.insert(even_pairs, even_manifolds);
+	}
+
+	REQUIRE(cache.evict(2) == count / 2);
+	REQUIRE(cache.size() == count / 2);
+	for (auto i = 0u; i < count; i++)
+	{
+		auto *m = cache.find(pairs[i]);
+		REQUIRE((m != nullptr) == (i % 2 == 0));
+		if (m)
+		{
+			REQUIRE(m->points[0].normal_impulse == static_cast<float>(i) + 0.5f);
+		}
+	}
+
+	cache.clear();
+	REQUIRE(cache.size() == 0);
+	REQUIRE(cache.find(pairs[0]) == nullptr);
+
+	// A body added into a removed body's slot does not inherit its contacts
+	auto store = sim::body_registry{};
+	auto a = store.add(sim::rigid_body{});
+	auto b = store.add(sim::rigid_body{});
+	cache.next_frame();
+	cache.insert(std::array{sim::pair_key(a, b)}, std::array{manifolds[0]});
+	REQUIRE(cache.find(sim::pair_key(b, a)));
+
+	store.remove(b);
+	auto c = store.add(sim::rigid_body{});
+	REQUIRE(c.slot == b.slot);
+	REQUIRE(cache.find(sim::pair_key(a, c)) == nullptr);
+}
+
+TEST_CASE("joints break when a body is removed", "[simulation]")
+{
+	using namespace DirectX;
+
+	auto clk = make_frame_clock();
+	auto sim = sim::simulation(XMFLOAT3{0.0f, -9.8f, 0.0f});
+
+	auto box = std::array{XMFLOAT3{-0.5f, -0.5f, -0.5f}, XMFLOAT3{0.5f, 0.5f, 0.5f}};
+	auto a = sim.add_body({.position = {0.0f, 5.0f, 0.0f}, .bounding_box = box});
+	auto b = sim.add_body({.position = {0.0f, 3.0f, 0.0f}, .bounding_box = box});
+	auto c = sim.add_body({.position = {0.0f, 1.0f, 0.0f}, .bounding_box = box});
+
+	auto joint = sim.add_joint({
+		.type = sim::joint_type::distance,
+		.body_a = b,
+		.body_b = c,
+		.anchor_a = {},
+		.anchor_b = {},
+	});
+
+	sim.update(clk);
+	REQUIRE(sim.remove_body(a));
+	sim.update(clk);
+	REQUIRE(sim.body_store().is_valid(c));
+	REQUIRE_FALSE(sim.is_joint_broken(joint));
+
+	REQUIRE(sim.remove_body(b));
+	sim.update(clk);
+	REQUIRE(sim.body_store().size() == 1);
+	REQUIRE(sim.is_joint_broken(joint));
+	REQUIRE(sim.get_body(c).velocity.y < 0.0f);
+}
+
+TEST_CASE("ball joints hold their anchor and hinges turn only about their axis", "[simulation]")
 {
-	return 0;
-}
\ No newline at end of file
+	using namespace DirectX;
+
+	auto clk = make_frame_clock();
+	auto sim = sim::simulation(XMFLOAT3{0.0f, -9.8f, 0.0f});
+	auto box = std::array{XMFLOAT3{-0.5f, -0.5f, -0.5f}, XMFLOAT3{0.5f, 0.5f, 0.5f}};
+
+	// A pendulum hanging from a world point, kicked sideways
+	auto bob = sim.add_body({.position = {0.0f, -1.0f, 0.0f}, .velocity = {2.0f, 0.0f, 1.0f}, .bounding_box = box});
+	sim.add_joint({
+		.type = sim::joint_type::ball,
+		.body_a = sim::joint_system::world,
+		.body_b = bob,
+		.anchor_a = {0.0f, 0.0f, 0.0f},
+		.anchor_b = {0.0f, 1.0f, 0.0f},
+	});
+
+	// A door hinged about world z, pushed and spun about every axis
+	auto door = sim.add_body({
+		.position = {5.0f, -1.0f, 0.0f},
+		.velocity = {1.0f, 0.0f, 0.0f},
+		.bounding_box = box,
+		.angular_velocity = {1.0f, 1.0f, 1.0f},
+	});
+	sim.add_joint({
+		.type = sim::joint_type::hinge,
+		.body_a = sim::joint_system::world,
+		.body_b = door,
+		.anchor_a = {5.0f, 0.0f, 0.0f},
+		.anchor_b = {0.0f, 1.0f, 0.0f},
+		.axis = {0.0f, 0.0f, 1.0f},
+	});
+
+	auto anchor_of = [&](sim::body_handle body)
+	{
+		auto b = sim.get_body(body);
+		auto q = XMLoadFloat4(&b.orientation);
+		return XMLoadFloat3(&b.position) + XMVector3Rotate(XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f), q);
+	};
+
+	auto swing = 0.0f;
+	for (auto i = 0; i < 120; i++)
+	{
+		sim.update(clk);
+
+		REQUIRE(XMVectorGetX(XMVector3Length(anchor_of(bob))) < 0.05f);
+		REQUIRE(XMVectorGetX(XMVector3Length(anchor_of(door) - XMVectorSet(5.0f, 0.0f, 0.0f, 0.0f))) < 0.05f);
+
+		// The door's own z stays on the hinge axis while it swings about it
+		auto state = sim.get_body(door);
+		auto z = XMVector3Rotate(XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), XMLoadFloat4(&state.orientation));
+		REQUIRE(XMVectorGetZ(z) > 0.99f);
+		swing = std::max(swing, std::abs(state.position.x - 5.0f));
+	}
+	REQUIRE(swing > 0.1f);
+}
+
+TEST_CASE("soft body keeps its rest shape and volume", "[soft_body]")
+{
+	using namespace DirectX;
+
+	// One tetrahedron hanging from its top face
+	auto model = gfx::mesh{
+		.vertices = {
+			{.position = {0.0f, 0.0f, 0.0f}},
+			{.position = {1.0f, 0.0f, 0.0f}},
+			{.position = {0.0f, 0.0f, 1.0f}},
+			{.position = {0.25f, -1.0f, 0.25f}},
+		},
+		.indicies = {0, 1, 2, 0, 1, 3, 1, 2, 3, 2, 0, 3},
+	};
+
+	auto volume = [](const std::vector<XMFLOAT3> &p)
+	{
+		auto p0 = XMLoadFloat3(&p[0]);
+		auto e1 = XMLoadFloat3(&p[1]) - p0;
+		auto e2 = XMLoadFloat3(&p[2]) - p0;
+		auto e3 = XMLoadFloat3(&p[3]) - p0;
+		return XMVectorGetX(XMVector3Dot(XMVector3Cross(e1, e2), e3)) / 6.0f;
+	};
+	auto rest_volume = volume(sim::soft_body(model, {}).positions());
+	REQUIRE(rest_volume != 0.0f);
+
+	// Unloaded, the constraints are already satisfied and nothing moves
+	{
+		auto body = sim::soft_body(model, {.tetrahedrons = {{0, 1, 2, 3}}});
+		for (auto i = 0; i < 30; i++)
+		{
+			body.step({}, 1.0 / 60.0);
+		}
+		for (auto i = 0u; i < model.vertices.size(); i++)
+		{
+			auto d = XMLoadFloat3(&body.positions()[i]) - XMLoadFloat3(&model.vertices[i].position);
+			REQUIRE(XMVectorGetX(XMVector3Length(d)) < 1e-5f);
+		}
+	}
+
+	// With loose edges only the volume constraint holds the free corner up
+	auto hang = [&](float volume_compliance)
+	{
+		auto body = sim::soft_body(model, {
+			.stretch_compliance = 1.0f,
+			.bend_compliance = 1.0f,
+			.volume_compliance = volume_compliance,
+			.pinned_particles = {0, 1, 2},
+			.tetrahedrons = {{0, 1, 2, 3}},
+		});
+		for (auto i = 0; i < 60; i++)
+		{
+			body.step({0.0f, -9.8f, 0.0f}, 1.0 / 60.0);
+		}
+		return volume(body.positions());
+	};
+	REQUIRE(hang(0.0f) == Approx(rest_volume).epsilon(0.01));
+	REQUIRE(std::abs(hang(1.0f)) > 1.5f * std::abs(rest_volume));
+}
+
+TEST_CASE("Barnes-Hut matches the direct sum when fully opened", "[n_body]")
+{
+	using namespace DirectX;
+
+	constexpr auto count = 2000u;
+	auto positions = std::vector<XMFLOAT3>(count);
+	auto masses = std::vector<float>(count);
+	auto seed = 7u;
+	auto random = [&]()
+	{
+		seed = seed * 1664525u + 1013904223u;
+		return static_cast<float>(seed >> 8) / (1 << 24);
+	};
+	for (auto i = 0u; i < count; i++)
+	{
+		positions[i] = {random() * 2.0f - 1.0f, random() * 2.0f - 1.0f, random() * 2.0f - 1.0f};
+		masses[i] = 0.5f + random();
+	}
+
+	// Softened pairwise sum in double
+	auto desc = sim::n_body_gravity::desc{};
+	auto reference = std::vector<XMFLOAT3>(count);
+	for (auto i = 0u; i < count; i++)
+	{
+		auto a = std::array<double, 3>{};
+		for (auto j = 0u; j < count; j++)
+		{
+			auto d = std::array{double{positions[j].x} - positions[i].x,
+			                    double{positions[j].y} - positions[i].y,
+			                    double{positions[j].z} - positions[i].z};
+			auto r2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2] + double{desc.softening} * desc.softening;
+			auto s = desc.gravitational_constant * masses[j] / (r2 * std::sqrt(r2));
+			for (auto k = 0; k < 3; k++)
+			{
+				a[k] += s * d[k];
+			}
+		}
+		reference[i] = {static_cast<float>(a[0]), static_cast<float>(a[1]), static_cast<float>(a[2])};
+	}
+
+	auto arena = sim::frame_arena{};
+	auto error = [&](const sim::n_body_gravity::desc &d)
+	{
+		auto gravity = sim::n_body_gravity(d);
+		auto result = std::vector<XMFLOAT3>{};
+
+		arena.reset();
+		gravity.compute_accelerations(positions, masses, result, arena);
+		REQUIRE(result.size() == count);
+
+		// Worst error relative to each body's acceleration
+		auto worst = 0.0f;
+		for (auto i = 0u; i < count; i++)
+		{
+			auto expected = XMLoadFloat3(&reference[i]);
+			auto diff = XMVectorGetX(XMVector3Length(XMLoadFloat3(&result[i]) - expected));
+			worst = std::max(worst, diff / XMVectorGetX(XMVector3Length(expected)));
+		}
+		return worst;
+	};
+
+	// Below the threshold, and the tree with an opening angle of zero so every node is opened
+	REQUIRE(error({.direct_sum_threshold = count + 1}) < 1e-3f);
+	REQUIRE(error({.opening_angle = 0.0f, .direct_sum_threshold = 0}) < 1e-3f);
+
+	// The approximation stays close at the default angle
+	REQUIRE(error({.direct_sum_threshold = 0}) < 0.1f);
+}
+
+TEST_CASE("fluid cell list finds every neighbour for density", "[fluid]")
+{
+	using namespace DirectX;
+
+	// A jittered lattice away from the origin, with cells on both sides of zero on x
+	auto particles = std::vector<XMFLOAT3>{};
+	auto jitter = 0u;
+	for (auto z = 0; z < 10; z++)
+	{
+		for (auto y = 0; y < 10; y++)
+		{
+			for (auto x = -5; x < 5; x++)
+			{
+				jitter = jitter * 1664525u + 1013904223u;
+				auto j = static_cast<float>(jitter >> 8) / (1 << 24) * 0.004f;
+				particles.push_back({x * 0.02f + j, 3.0f + y * 0.02f - j, -2.0f + z * 0.02f + j});
+			}
+		}
+	}
+
+	auto desc = sim::fluid::desc{};
+	auto arena = sim::frame_arena{};
+	auto body = sim::fluid(particles, desc);
+	body.step({}, 1e-7, arena);
+	REQUIRE(body.particle_count() == particles.size());
+
+	// Default bounds do not pull anything towards the origin
+	for (auto i = 0u; i < body.particle_count(); i++)
+	{
+		REQUIRE(body.position(i).y >= 2.99f);
+	}
+
+	// Same poly6 sum over every pair
+	auto h2 = static_cast<double>(desc.smoothing_radius) * desc.smoothing_radius;
+	auto poly6 = 315.0 / (64.0 * XM_PI * std::pow(static_cast<double>(desc.smoothing_radius), 9.0));
+	for (auto i = 0u; i < body.particle_count(); i++)
+	{
+		auto pi = body.position(i);
+		auto sum = 0.0;
+		for (auto j = 0u; j < body.particle_count(); j++)
+		{
+			auto pj = body.position(j);
+			auto dx = double{pj.x} - pi.x, dy = double{pj.y} - pi.y, dz = double{pj.z} - pi.z;
+			auto r2 = dx * dx + dy * dy + dz * dz;
+			if (r2 < h2)
+			{
+				sum += (h2 - r2) * (h2 - r2) * (h2 - r2);
+			}
+		}
+
+		auto expected = desc.particle_mass * poly6 * sum;
+		REQUIRE(body.density_of(i) == Approx(expected).epsilon(1e-3));
+	}
+
+	// Buckets keep a fixed order, so runs agree to the bit however the jobs were scheduled
+	auto run = [&]()
+	{
+		auto splash = sim::fluid(particles, {.bounds = {XMFLOAT3{-0.2f, 2.9f, -2.1f}, XMFLOAT3{0.2f, 3.5f, -1.7f}}});
+		for (auto i = 0; i < 20; i++)
+		{
+			arena.reset();
+			splash.step({0.0f, -9.8f, 0.0f}, 1.0 / 60.0, arena);
+		}
+
+		auto positions = std::vector<XMFLOAT3>(splash.particle_count());
+		for (auto i = 0u; i < splash.particle_count(); i++)
+		{
+			positions[i] = splash.position(i);
+		}
+		return positions;
+	};
+
+	auto first = run();
+	for (auto attempt = 0; attempt < 4; attempt++)
+	{
+		REQUIRE(std::memcmp(run().data(), first.data(), first.size() * sizeof(XMFLOAT3)) == 0);
+	}
+}
+
+TEST_CASE("triple buffer hands over the latest frame", "[triple_buffer]")
+{
+	auto buffer = os::triple_buffer<uint32_t>{};
+
+	REQUIRE_FALSE(buffer.update());
+
+	buffer.back() = 1;
+	buffer.publish();
+	buffer.back() = 2;
+	buffer.publish();
+
+	// Frame 1 was never read and is dropped
+	REQUIRE(buffer.update());
+	REQUIRE(buffer.front() == 2);
+	REQUIRE_FALSE(buffer.update());
+
+	// Reader only ever sees increasing frames while the writer runs
+	constexpr auto frame_count = 100'000u;
+	auto writer = std::thread([&]()
+	{
+		for (auto i = 3u; i <= frame_count; i++)
+		{
+			buffer.back() = i;
+			buffer.publish();
+		}
+	});
+
+	auto last = buffer.front();
+	auto in_order = true;
+	while (last < frame_count)
+	{
+		if (buffer.update())
+		{
+			in_order = in_order and buffer.front() > last;
+			last = buffer.front();
+		}
+	}
+	writer.join();
+
+	REQUIRE(in_order);
+	REQUIRE(last == frame_count);
+}
+
+TEST_CASE("transform batch matches per body transforms", "[transform_batch]")
+{
+	using namespace DirectX;
+
+	auto registry = sim::body_registry{};
+	for (auto i = 0u; i < 10; i++)
+	{
+		auto f = static_cast<float>(i);
+		auto q = XMFLOAT4{};
+		XMStoreFloat4(&q, XMQuaternionRotationRollPitchYaw(0.3f * f, 0.1f * f, -0.2f * f));
+		registry.add({.position = {f, 2.0f * f, -f}, .orientation = q});
+	}
+
+	auto batch = sim::transform_batch{};
+	REQUIRE(batch.update(registry) == 10);
+	REQUIRE(batch.matrices().size() == 10);
+	REQUIRE(reinterpret_cast<std::uintptr_t>(batch.matrices().data()) % 16 == 0);
+
+	auto same = [](const gfx::matrix &a, const gfx::matrix &b)
+	{
+		for (auto r = 0; r < 4; r++)
+		{
+			if (not XMVector4NearEqual(a.data.r[r], b.data.r[r], XMVectorReplicate(1e-5f)))
+			{
+				return false;
+			}
+		}
+		return true;
+	};
+
+	for (auto i = 0u; i < 10; i++)
+	{
+		auto expected = gfx::matrix{};
+		sim::update_transforms(registry.body(i), expected);
+		REQUIRE(same(batch.matrices()[i], expected));
+	}
+
+	// Nothing moved, nothing rebuilt
+	REQUIRE(batch.update(registry) == 0);
+
+	registry.positions[3].x += 1.0f;
+	REQUIRE(batch.update(registry) == 1);
+
+	// Halfway between the previous and current pose
+	registry.save_previous_pose();
+	registry.positions[5].y += 2.0f;
+	REQUIRE(batch.update(registry, 0.5f) == 1);
+
+	auto halfway = registry.body(5);
+	halfway.position.y -= 1.0f;
+	auto expected = gfx::matrix{};
+	sim::update_transforms(halfway, expected);
+	REQUIRE(same(batch.matrices()[5], expected));
+}
+
+TEST_CASE("batched raycasts hit the nearest body", "[broadphase]")
+{
+	using namespace DirectX;
+
+	auto sim = sim::simulation(XMFLOAT3{0.0f, -9.8f, 0.0f});
+
+	// 20 x 20 grid of unit boxes, top faces at y = 0.5
+	constexpr auto grid = 20;
+	auto box = std::array{XMFLOAT3{-0.5f, -0.5f, -0.5f}, XMFLOAT3{0.5f, 0.5f, 0.5f}};
+	auto handles = std::vector<sim::body_handle>{};
+	for (auto x = 0; x < grid; x++)
+	{
+		for (auto z = 0; z < grid; z++)
+		{
+			handles.push_back(sim.add_body({
+				.position = {2.0f * x, 0.0f, 2.0f * z},
+				.bounding_box = box,
+			}));
+		}
+	}
+
+	// Straight down onto every box, and into every gap
+	auto rays = std::vector<sim::ray>{};
+	for (auto x = 0; x < grid; x++)
+	{
+		for (auto z = 0; z < grid; z++)
+		{
+			rays.push_back({.origin = {2.0f * x, 10.0f, 2.0f * z}, .direction = {0.0f, -1.0f, 0.0f}});
+			rays.push_back({.origin = {2.0f * x + 1.0f, 10.0f, 2.0f * z}, .direction = {0.0f, -2.0f, 0.0f}});
+		}
+	}
+
+	auto hits = std::vector<sim::ray_hit>(rays.size());
+	sim.raycast(rays, hits);
+
+	for (auto i = 0u; i < rays.size(); i++)
+	{
+		if (i % 2 == 0)
+		{
+			REQUIRE(hits[i].hit);
+			REQUIRE(hits[i].body == handles[i / 2]);
+			REQUIRE(hits[i].distance == Approx(9.5f));
+			REQUIRE(hits[i].normal.y == Approx(1.0f));
+		}
+		else
+		{
+			REQUIRE_FALSE(hits[i].hit);
+		}
+	}
+
+	// One at a time gives the same answers as the packets
+	for (auto i = 0u; i < rays.size(); i += 37)
+	{
+		auto single = std::array<sim::ray_hit, 1>{};
+		sim.raycast(std::span{&rays[i], 1}, single);
+		REQUIRE(single[0].hit == hits[i].hit);
+		REQUIRE(single[0].distance == hits[i].distance);
+	}
+
+	// Sweeping a sphere down a gap touches the neighbours' edges
+	auto sweeps = std::array{
+		sim::sphere_sweep{.origin = {0.0f, 10.0f, 0.0f}, .direction = {0.0f, -1.0f, 0.0f}, .radius = 0.25f},
+		sim::sphere_sweep{.origin = {1.0f, 10.0f, 0.0f}, .direction = {0.0f, -1.0f, 0.0f}, .radius = 0.6f},
+		sim::sphere_sweep{.origin = {1.0f, 10.0f, 0.0f}, .direction = {0.0f, -1.0f, 0.0f}, .radius = 0.4f},
+	};
+	auto sweep_hits = std::array<sim::ray_hit, 3>{};
+	sim.sphere_cast(sweeps, sweep_hits);
+
+	REQUIRE(sweep_hits[0].distance == Approx(9.25f));
+	REQUIRE(sweep_hits[1].hit);
+	REQUIRE_FALSE(sweep_hits[2].hit);
+
+	// Limited range
+	auto short_ray = std::array{sim::ray{.origin = {0.0f, 10.0f, 0.0f}, .direction = {0.0f, -1.0f, 0.0f}, .max_distance = 5.0f}};
+	auto short_hit = std::array<sim::ray_hit, 1>{};
+	sim.raycast(short_ray, short_hit);
+	REQUIRE_FALSE(short_hit[0].hit);
+}
+
+TEST_CASE("query tree follows moving bodies between rebuilds", "[broadphase]")
+{
+	using namespace DirectX;
+
+	auto sim = sim::simulation(XMFLOAT3{});
+	auto box = std::array{XMFLOAT3{-0.5f, -0.5f, -0.5f}, XMFLOAT3{0.5f, 0.5f, 0.5f}};
+	auto handles = std::vector<sim::body_handle>{};
+	for (auto i = 0; i < 200; i++)
+	{
+		handles.push_back(sim.add_body({
+			.position = {2.0f * i, 0.0f, 0.0f},
+			.velocity = {0.0f, 0.0f, 1.0f},
+			.bounding_box = box,
+		}));
+	}
+
+	auto cast_down = [&](float x, float z)
+	{
+		auto ray = std::array{sim::ray{.origin = {x, 10.0f, z}, .direction = {0.0f, -1.0f, 0.0f}}};
+		auto hit = std::array<sim::ray_hit, 1>{};
+		sim.raycast(ray, hit);
+		return hit[0];
+	};
+	REQUIRE(cast_down(20.0f, 0.0f).body == handles[10]);
+
+	// Refit, the tree keeps its shape but finds the body where it went
+	auto moved = sim.get_body(handles[10]);
+	moved.position = {-50.0f, 0.0f, 0.0f};
+	sim.set_body(handles[10], moved);
+	REQUIRE_FALSE(cast_down(20.0f, 0.0f).hit);
+	REQUIRE(cast_down(-50.0f, 0.0f).body == handles[10]);
+
+	// With no budget the rebuild goes a slice per frame, queries in between use the refit tree
+	auto clk = make_frame_clock();
+	sim.maintenance().set_budget(std::chrono::microseconds(0));
+	for (auto frame = 0; frame < 90; frame++)
+	{
+		sim.step(1.0 / 60.0);
+		sim.maintain(clk);
+
+		auto z = sim.get_body(handles[20]).position.z;
+		auto hit = cast_down(40.0f, z);
+		REQUIRE(hit.body == handles[20]);
+		REQUIRE(hit.distance == Approx(9.5f));
+	}
+}
+
+TEST_CASE("pair finding honours collision layers and joints", "[broadphase]")
+{
+	using namespace DirectX;
+
+	auto sim = sim::simulation(XMFLOAT3{0.0f, -9.8f, 0.0f});
+
+	// Everything overlaps everything, bar the far body
+	auto box = std::array{XMFLOAT3{-1.0f, -1.0f, -1.0f}, XMFLOAT3{1.0f, 1.0f, 1.0f}};
+	auto add = [&](float x, uint32_t layer, uint32_t mask)
+	{
+		return sim.add_body({.position = {x, 0.0f, 0.0f}, .bounding_box = box, .collision_layer = layer, .collision_mask = mask});
+	};
+
+	auto a1 = add(0.0f, 1, 3);
+	auto a2 = add(0.1f, 1, 3);
+	auto a3 = add(0.2f, 1, 3);
+	auto b1 = add(0.3f, 2, 1);
+	auto b2 = add(0.4f, 2, 1);
+	auto c = add(0.5f, 4, ~0u);
+	add(100.0f, 1, ~0u);
+
+	sim.add_joint({
+		.type = sim::joint_type::ball,
+		.body_a = a1,
+		.body_b = a2,
+		.anchor_a = {},
+		.anchor_b = {},
+	});
+
+	auto &store = sim.body_store();
+	auto found = std::vector<uint64_t>{};
+	for (auto &p : sim.find_pairs())
+	{
+		REQUIRE(p.a < p.b);
+		found.push_back(sim::pair_key(store.handle_of(p.a), store.handle_of(p.b)));
+	}
+	std::sort(std::begin(found), std::end(found));
+
+	// c takes every layer, but no one takes c's. The jointed pair is left out.
+	auto expected = std::vector<uint64_t>{
+		sim::pair_key(a1, a3), sim::pair_key(a2, a3),
+		sim::pair_key(a1, b1), sim::pair_key(a1, b2),
+		sim::pair_key(a2, b1), sim::pair_key(a2, b2),
+		sim::pair_key(a3, b1), sim::pair_key(a3, b2),
+	};
+	std::sort(std::begin(expected), std::end(expected));
+	REQUIRE(found == expected);
+	REQUIRE_FALSE(std::binary_search(std::begin(found), std::end(found), sim::pair_key(a1, c)));
+}
+
+TEST_CASE("trigger volumes report enter, stay and exit", "[triggers]")
+{
+	using namespace DirectX;
+
+	auto sim = sim::simulation(XMFLOAT3{0.0f, 0.0f, 0.0f});
+	auto box = std::array{XMFLOAT3{-0.5f, -0.5f, -0.5f}, XMFLOAT3{0.5f, 0.5f, 0.5f}};
+	auto big = std::array{XMFLOAT3{-1.0f, -1.0f, -1.0f}, XMFLOAT3{1.0f, 1.0f, 1.0f}};
+
+	auto sensor = sim.add_body({.position = {}, .bounding_box = big, .trigger = true});
+	auto a = sim.add_body({.position = {0.5f, 0.0f, 0.0f}, .bounding_box = box});
+	auto b = sim.add_body({.position = {5.0f, 0.0f, 0.0f}, .bounding_box = box});
+
+	auto move = [&](sim::body_handle body, float x)
+	{
+		auto state = sim.get_body(body);
+		state.position.x = x;
+		sim.set_body(body, state);
+	};
+
+	auto events = [&]()
+	{
+		auto list = std::vector<std::pair<sim::body_handle, sim::trigger_event_type>>{};
+		for (auto &e : sim.trigger_events())
+		{
+			REQUIRE(e.trigger == sensor);
+			list.push_back({e.other, e.type});
+		}
+		return list;
+	};
+
+	using enum sim::trigger_event_type;
+	using list = std::vector<std::pair<sim::body_handle, sim::trigger_event_type>>;
+
+	sim.step(1.0 / 60.0);
+	REQUIRE(events() == list{{a, enter}});
+
+	move(b, -0.5f);
+	sim.step(1.0 / 60.0);
+	REQUIRE(events() == list{{a, stay}, {b, enter}});
+
+	// The trigger never pairs up for collision
+	auto pairs = sim.find_pairs();
+	REQUIRE(pairs.size() == 1);
+	REQUIRE(sim.body_store().triggers[pairs[0].a] == 0);
+	REQUIRE(sim.body_store().triggers[pairs[0].b] == 0);
+
+	move(a, 5.0f);
+	sim.step(1.0 / 60.0);
+	REQUIRE(events() == list{{b, stay}, {a, exit}});
+
+	// Steady overlaps cost no allocations
+	allocation_count = 0;
+	counting = true;
+	for (auto i = 0u; i < 8; i++)
+	{
+		sim.step(1.0 / 60.0);
+	}
+	counting = false;
+	REQUIRE(allocation_count == 0);
+
+	// A removed body exits under its old handle
+	REQUIRE(sim.remove_body(b));
+	sim.step(1.0 / 60.0);
+	REQUIRE(events() == list{{b, exit}});
+
+	sim.step(1.0 / 60.0);
+	REQUIRE(sim.trigger_events().empty());
+}
+
+TEST_CASE("profiler records nested zones and exports a chrome trace", "[profiler]")
+{
+#ifdef PROFILER_ENABLED
+	{
+		PROFILE_ZONE("before clear");
+	}
+	os::clear_profile();
+	REQUIRE(os::get_profile_stats().zone_count == 0);
+
+	constexpr auto zone_count = 10'000u;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (auto i = 0u; i < zone_count; i++)
+	{
+		PROFILE_ZONE("outer");
+		{
+			PROFILE_ZONE("inner");
+		}
+	}
+	auto elapsed = std::chrono::high_resolution_clock::now() - start;
+
+	auto per_zone = std::chrono::duration<double, std::nano>(elapsed).count() / (2 * zone_count);
+	WARN("Profiler overhead per zone: " << per_zone << " ns");
+
+	REQUIRE(os::get_profile_stats().zone_count == 2 * zone_count);
+
+	auto worker = std::thread([]()
+	{
+		PROFILE_THREAD("worker");
+		PROFILE_ZONE("worker zone");
+	});
+	worker.join();
+
+	auto path = std::filesystem::temp_directory_path() / "physics_eg_trace.json";
+	REQUIRE(os::write_chrome_trace(path));
+
+	auto file = std::ifstream(path);
+	auto json = std::string(std::istreambuf_iterator<char>(file), {});
+	REQUIRE(json.starts_with("{\"traceEvents\":["));
+	REQUIRE(json.find("\"name\":\"inner\",\"ph\":\"X\"") != std::string::npos);
+	REQUIRE(json.find("\"name\":\"worker zone\"") != std::string::npos);
+	REQUIRE(json.find("\"args\":{\"name\":\"worker\"}") != std::string::npos);
+	REQUIRE(json.find("before clear") == std::string::npos);
+
+	// Exporting while another thread laps its ring only drops events, it never tears them
+	auto stop = std::atomic<bool>{};
+	auto busy = std::thread([&]()
+	{
+		PROFILE_THREAD("busy");
+		while (not stop.load(std::memory_order_relaxed))
+		{
+			PROFILE_ZONE("busy zone");
+		}
+	});
+	for (auto i = 0; i < 3; i++)
+	{
+		REQUIRE(os::write_chrome_trace(path));
+	}
+	stop = true;
+	busy.join();
+
+	file = std::ifstream(path);
+	json = std::string(std::istreambuf_iterator<char>(file), {});
+	REQUIRE(json.ends_with("\n],\"displayTimeUnit\":\"ns\"}\n"));
+#endif
+}
+
+TEST_CASE("frame statistics report percentiles and rolling means", "[clock]")
+{
+	using namespace std::chrono_literals;
+	using ms = std::milli;
+
+	auto stats = os::frame_statistics{};
+	REQUIRE(stats.percentile<ms>(0.5) == 0.0);
+	REQUIRE(stats.rolling_mean<ms>(16) == 0.0);
+
+	// 1ms to 100ms, one frame each
+	for (auto i = 1; i <= 100; i++)
+	{
+		stats.add(std::chrono::milliseconds(i));
+	}
+
+	REQUIRE(stats.frame_count() == 100);
+	REQUIRE(stats.max<ms>() == Approx(100.0));
+	REQUIRE(stats.mean<ms>() == Approx(50.5));
+	REQUIRE(stats.percentile<ms>(0.50) == Approx(50.0).epsilon(1.0 / 64));
+	REQUIRE(stats.percentile<ms>(0.95) == Approx(95.0).epsilon(1.0 / 64));
+	REQUIRE(stats.percentile<ms>(0.99) == Approx(99.0).epsilon(1.0 / 64));
+	REQUIRE(stats.percentile<ms>(1.00) == Approx(100.0));
+
+	// Last ten are 91..100
+	REQUIRE(stats.rolling_mean<ms>(10) == Approx(95.5));
+	REQUIRE(stats.rolling_mean<ms>(1000) == Approx(50.5));
+
+	// The ring keeps only the newest deltas, the histogram keeps everything
+	for (auto i = 0u; i < os::frame_statistics::history_size; i++)
+	{
+		stats.add(2ms);
+	}
+	REQUIRE(stats.rolling_mean<ms>(1000) == Approx(2.0));
+	REQUIRE(stats.max<ms>() == Approx(100.0));
+
+	auto out = std::ostringstream{};
+	stats.write_json(out);
+	auto json = out.str();
+	REQUIRE(json.find("\"frames\": 356") != std::string::npos);
+	REQUIRE(json.find("\"histogram_ms\": [") != std::string::npos);
+
+	stats.reset();
+	REQUIRE(stats.frame_count() == 0);
+	REQUIRE(stats.max<ms>() == 0.0);
+
+	auto clk = os::clock{};
+	auto calls = 0u;
+	clk.set_stats_hook([&](const os::clock &c)
+	{
+		calls++;
+		REQUIRE(c.stats().frame_count() % 4 == 0);
+	}, 4);
+	for (auto i = 0; i < 10; i++)
+	{
+		clk.tick();
+	}
+	REQUIRE(calls == 2);
+	REQUIRE(clk.stats().frame_count() == 10);
+}
+
+TEST_CASE("frame pacer holds the target rate", "[frame_pacer]")
+{
+	using steady = std::chrono::steady_clock;
+	using ms = std::milli;
+
+	constexpr auto rate = 250.0;
+	constexpr auto frames = 50;
+
+	auto pacer = os::frame_pacer({.target_rate = rate});
+
+	// The first deadline is one period after the first wait
+	auto start = steady::now();
+	for (auto i = 0; i < frames; i++)
+	{
+		pacer.wait();
+	}
+	auto elapsed = std::chrono::duration<double, ms>(steady::now() - start).count();
+
+	// Never early, and loose on the late side for loaded machines
+	auto expected = 1000.0 * frames / rate;
+	REQUIRE(elapsed >= expected);
+	REQUIRE(elapsed < expected * 2.0);
+
+	auto &overshoot = pacer.overshoot();
+	REQUIRE(overshoot.frame_count() > 0);
+	WARN("Pacer overshoot p50 " << overshoot.percentile<ms>(0.5) << " ms, p99 " << overshoot.percentile<ms>(0.99) << " ms");
+
+	// Unpaced returns straight away
+	pacer.set_target_rate(0.0);
+	auto unpaced_start = steady::now();
+	for (auto i = 0; i < frames; i++)
+	{
+		pacer.wait();
+	}
+	REQUIRE(steady::now() - unpaced_start < std::chrono::milliseconds(5));
+}
+
+TEST_CASE("mesh bounds cover every block of vertices", "[job_system]")
+{
+	// Spread over several blocks, the extremes in the middle of different ones
+	auto model = gfx::mesh{};
+	model.vertices.resize(20000, gfx::vertex{.position = {1.0f, 1.0f, 1.0f}});
+	model.vertices[5000].position = {-3.0f, 2.0f, 0.5f};
+	model.vertices[13001].position = {4.0f, -2.0f, 7.0f};
+
+	auto bounds = sim::make_bounding_box(model);
+	REQUIRE(bounds[0].x == -3.0f);
+	REQUIRE(bounds[0].y == -2.0f);
+	REQUIRE(bounds[0].z == 0.0f);
+	REQUIRE(bounds[1].x == 4.0f);
+	REQUIRE(bounds[1].y == 2.0f);
+	REQUIRE(bounds[1].z == 7.0f);
+}
+
+TEST_CASE("job system runs every index once and waits on counters", "[job_system]")
+{
+	auto jobs = os::job_system({.worker_count = 3, .pin_threads = true});
+	REQUIRE(jobs.thread_count() == 4);
+
+	constexpr auto count = 100'000u;
+	auto visits = std::vector<std::atomic<uint32_t>>(count);
+
+	jobs.parallel_for(0, count, [&](uint32_t i)
+	{
+		visits[i].fetch_add(1, std::memory_order_relaxed);
+	});
+	REQUIRE(std::all_of(std::begin(visits), std::end(visits), [](auto &v) { return v.load() == 1; }));
+
+	// Nested loops and explicit grains, the inner waits help rather than block
+	auto total = std::atomic<uint64_t>{};
+	jobs.parallel_for(0, 64, [&](uint32_t outer)
+	{
+		jobs.parallel_for(0, 1000, [&, outer](uint32_t inner)
+		{
+			total.fetch_add(outer * 1000 + inner, std::memory_order_relaxed);
+		}, 7);
+	}, 1);
+	REQUIRE(total == uint64_t{64'000} * 63'999 / 2);
+
+	auto counter = os::job_counter{};
+	auto done = std::atomic<uint32_t>{};
+	for (auto i = 0u; i < 1000; i++)
+	{
+		auto *d = &done;
+		jobs.submit([d]()
+		{
+			d->fetch_add(1, std::memory_order_relaxed);
+		}, counter);
+	}
+	jobs.wait(counter);
+	REQUIRE(counter.done());
+	REQUIRE(done == 1000);
+
+	// Empty and tiny ranges never reach the workers
+	jobs.parallel_for(5, 5, [](uint32_t) { FAIL("empty range ran"); });
+	auto small = 0u;
+	jobs.parallel_for(0, 4, [&](uint32_t) { small++; });
+	REQUIRE(small == 4);
+
+	// More jobs in flight than a ring holds, with the workers held up so the ring wraps onto queued entries
+	auto release = std::atomic<bool>{};
+	auto held = os::job_counter{};
+	for (auto i = 0u; i < 3; i++)
+	{
+		auto *r = &release;
+		jobs.submit([r]()
+		{
+			while (not r->load())
+			{
+				std::this_thread::yield();
+			}
+		}, held);
+	}
+
+	constexpr auto flood = 10'000u;
+	auto runs = std::vector<std::atomic<uint32_t>>(flood);
+	auto flooded = os::job_counter{};
+	for (auto i = 0u; i < flood; i++)
+	{
+		auto *run = &runs[i];
+		jobs.submit([run]()
+		{
+			run->fetch_add(1, std::memory_order_relaxed);
+		}, flooded);
+	}
+	release = true;
+	jobs.wait(flooded);
+	jobs.wait(held);
+	REQUIRE(std::all_of(std::begin(runs), std::end(runs), [](auto &r) { return r.load() == 1; }));
+}
+
+TEST_CASE("task graph orders conflicting stages and overlaps frames", "[task_graph]")
+{
+	auto jobs = os::job_system({.worker_count = 2});
+	auto graph = os::task_graph(jobs);
+
+	auto log_mutex = std::mutex{};
+	auto log = std::vector<char>{};
+	auto record = [&](char stage)
+	{
+		auto lock = std::lock_guard{log_mutex};
+		log.push_back(stage);
+	};
+
+	// a -> b -> c through x and y, d only shares a read with b
+	auto sim_steps = std::atomic<uint64_t>{};
+	auto overlapped = std::atomic<uint32_t>{};
+	graph.add_stage({.name = "a", .writes = {"x"}}, [&]() { record('a'); });
+	graph.add_stage({.name = "b", .reads = {"x"}, .writes = {"y"}}, [&]() { record('b'); });
+	graph.add_stage({.name = "c", .reads = {"y"}, .thread = os::task_thread::main}, [&]() { record('c'); });
+	graph.add_stage({.name = "sim", .writes = {"bodies"}}, [&]() { sim_steps++; });
+	graph.add_stage({.name = "draw", .reads = {"gpu"}, .thread = os::task_thread::main}, [&]()
+	{
+		// Next frame's sim only conflicts with itself, so it can run while this frame draws
+		auto frame = graph.frame_count();
+		auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+		while (sim_steps.load() < frame + 2 and std::chrono::steady_clock::now() < give_up)
+		{
+			std::this_thread::yield();
+		}
+		overlapped += sim_steps.load() >= frame + 2 ? 1 : 0;
+	});
+
+	constexpr auto frames = 20u;
+	for (auto f = 0u; f < frames; f++)
+	{
+		graph.run_frame();
+	}
+	graph.wait_idle();
+
+	REQUIRE(graph.rebuild_count() == 1);
+	REQUIRE(overlapped == frames);
+
+	// Where each frame's a, b and c landed in the log
+	auto at = std::map<char, std::vector<size_t>>{};
+	for (auto i = 0u; i < log.size(); i++)
+	{
+		at[log[i]].push_back(i);
+	}
+	REQUIRE(at['a'].size() >= frames);
+	REQUIRE(at['b'].size() >= frames);
+	REQUIRE(at['c'].size() == frames);
+	for (auto f = 0u; f < frames; f++)
+	{
+		REQUIRE(at['a'][f] < at['b'][f]);
+		REQUIRE(at['b'][f] < at['c'][f]);
+
+		// The next a only waits for this b, the next b waits for this c
+		if (f + 1 < frames)
+		{
+			REQUIRE(at['b'][f] < at['a'][f + 1]);
+			REQUIRE(at['c'][f] < at['b'][f + 1]);
+		}
+	}
+
+	// Adding a stage rebuilds once, a frame later, the frame after may already have started it
+	auto extra = std::atomic<uint32_t>{};
+	graph.add_stage({.name = "extra", .reads = {"y"}}, [&]() { extra++; });
+	graph.run_frame();
+	graph.run_frame();
+	graph.run_frame();
+	graph.wait_idle();
+
+	REQUIRE(graph.rebuild_count() == 2);
+	REQUIRE(extra >= 2);
+	REQUIRE(sim_steps >= frames + 3);
+}
+
+TEST_CASE("budget scheduler slices work across frames", "[budget_scheduler]")
+{
+	auto clk = make_frame_clock();
+	auto scheduler = os::budget_scheduler({.budget = std::chrono::microseconds{0}});
+
+	// Each task has a number of units left to do
+	auto left = std::array{3u, 2u};
+	auto done = std::array{0u, 0u};
+	for (auto t = 0u; t < 2; t++)
+	{
+		scheduler.add_task("work", [&, t]()
+		{
+			done[t]++;
+			return --left[t] > 0;
+		});
+	}
+
+	// Nothing pending, nothing runs
+	scheduler.run(clk);
+	REQUIRE(scheduler.units_run() == 0);
+
+	// Out of budget still runs one unit a frame, taking turns
+	scheduler.wake(0);
+	scheduler.wake(1);
+	scheduler.run(clk);
+	REQUIRE(scheduler.units_run() == 1);
+	scheduler.run(clk);
+	REQUIRE(done == std::array{1u, 1u});
+
+	// With time to spare the rest finishes in one frame
+	scheduler.set_budget(std::chrono::seconds(1));
+	scheduler.run(clk);
+	REQUIRE(scheduler.units_run() == 3);
+	REQUIRE(done == std::array{3u, 2u});
+	REQUIRE_FALSE(scheduler.is_pending(0));
+	REQUIRE_FALSE(scheduler.is_pending(1));
+}
+
+TEST_CASE("renderer runs headless on the null backend", "[renderer]")
+{
+	using namespace DirectX;
+
+	auto triangle = gfx::mesh{
+		.vertices = {{{0.0f, 0.0f, 0.0f}, {}}, {{1.0f, 0.0f, 0.0f}, {}}, {{0.0f, 1.0f, 0.0f}, {}}},
+		.indicies = {0, 1, 2},
+	};
+	auto line = gfx::mesh{
+		.vertices = {{{0.0f, 0.0f, 0.0f}, {}}, {{1.0f, 0.0f, 0.0f}, {}}},
+		.indicies = {0, 1},
+	};
+
+	auto backend = std::make_unique<gfx::null_backend>();
+	auto &null = *backend;
+	auto rndr = gfx::renderer(std::move(backend), 800, 600);
+
+	auto triangle_model = rndr.register_mesh(triangle);
+	auto line_model = rndr.register_mesh(line);
+
+	auto a = gfx::matrix{XMMatrixTranslation(1.0f, 0.0f, 0.0f)};
+	auto b = gfx::matrix{XMMatrixTranslation(2.0f, 0.0f, 0.0f)};
+	auto c = gfx::matrix{XMMatrixIdentity()};
+	rndr.add_mesh(triangle_model, a, gfx::pipeline_type::basic);
+	rndr.add_mesh(triangle_model, b, gfx::pipeline_type::basic);
+	rndr.add_mesh(line_model, c, gfx::pipeline_type::line_list);
+
+	auto clk = make_frame_clock();
+	null.reset();
+	a.data = XMMatrixTranslation(5.0f, 0.0f, 0.0f);
+	rndr.update(clk);
+	rndr.draw();
+
+	// Both triangles share a mesh and pipeline, so draw as one
+	auto stats = null.stats();
+	REQUIRE(stats.frames == 1);
+	REQUIRE(stats.uploads == 1);
+	REQUIRE(stats.upload_bytes == 3 * sizeof(gfx::matrix));
+	REQUIRE(stats.draws == 2);
+	REQUIRE(stats.instances == 3);
+	REQUIRE(stats.indices == 8);
+
+	// Projection, view and instances, then a pipeline and mesh per draw
+	REQUIRE(stats.binds == 3 + 2 * 2);
+	REQUIRE(stats.redundant_binds == 0);
+
+	auto commands = null.commands();
+	REQUIRE(commands.size() == 1 + 1 + 3 + 2 * 3 + 1);
+	REQUIRE(commands[1].type == gfx::command_type::begin_frame);
+	REQUIRE(commands[7].type == gfx::command_type::draw_instanced);
+	REQUIRE(commands[7].size == 2);
+	REQUIRE(commands[7].first == 0);
+	REQUIRE(commands[10].type == gfx::command_type::draw_instanced);
+	REQUIRE(commands[10].size == 1);
+	REQUIRE(commands[10].first == 2);
+	REQUIRE(commands.back().type == gfx::command_type::end_frame);
+
+	// Instances go batch by batch, a's new transform first
+	REQUIRE(commands[0].type == gfx::command_type::upload);
+	auto uploaded = null.instance_buffer_data(commands[0].resource);
+	REQUIRE(std::memcmp(uploaded.data(), &a, sizeof(a)) == 0);
+	REQUIRE(std::memcmp(uploaded.data() + sizeof(gfx::matrix), &b, sizeof(b)) == 0);
+	REQUIRE(std::memcmp(uploaded.data() + 2 * sizeof(gfx::matrix), &c, sizeof(c)) == 0);
+
+	// Thousands more of the same cost no more draws, only a bigger upload
+	auto many = std::vector<gfx::matrix>(2000, gfx::matrix{XMMatrixIdentity()});
+	for (auto &m : many)
+	{
+		rndr.add_mesh(triangle_model, m, gfx::pipeline_type::basic);
+	}
+
+	null.reset();
+	rndr.update(clk);
+	rndr.draw();
+
+	stats = null.stats();
+	REQUIRE(stats.uploads == 1);
+	REQUIRE(stats.upload_bytes == 2003 * sizeof(gfx::matrix));
+	REQUIRE(stats.draws == 2);
+	REQUIRE(stats.instances == 2003);
+
+	// The line's instance moved to the end, after every triangle
+	REQUIRE(null.commands()[7].size == 2002);
+	REQUIRE(null.commands()[10].first == 2002);
+	uploaded = null.instance_buffer_data(null.commands()[0].resource);
+	REQUIRE(std::memcmp(uploaded.data() + 2002 * sizeof(gfx::matrix), &c, sizeof(c)) == 0);
+
+	// Adding between frames lays out again on the next update, not on the add
+	auto d = gfx::matrix{XMMatrixTranslation(0.0f, 3.0f, 0.0f)};
+	rndr.add_mesh(triangle_model, d, gfx::pipeline_type::basic);
+
+	null.reset();
+	rndr.update(clk);
+	rndr.draw();
+
+	uploaded = null.instance_buffer_data(null.commands()[0].resource);
+	REQUIRE(null.stats().instances == 2004);
+	REQUIRE(null.commands()[10].first == 2003);
+	REQUIRE(std::memcmp(uploaded.data(), &a, sizeof(a)) == 0);
+	REQUIRE(std::memcmp(uploaded.data() + 2002 * sizeof(gfx::matrix), &d, sizeof(d)) == 0);
+	REQUIRE(std::memcmp(uploaded.data() + 2003 * sizeof(gfx::matrix), &c, sizeof(c)) == 0);
+}